@@ -1,6 +1,9 @@
 #ifndef TINY_VC_AUDIO_CAPTURE_H
 #define TINY_VC_AUDIO_CAPTURE_H
 
+#include "audio_context.h"
+#include "audio_counters.h"
+#include "audio_device.h"
 #include "audio_types.h"
 #include <stddef.h>
 
@@ -12,10 +15,29 @@ struct capture_t;
 /**
  * Create Audio Capture structure.
  *
- * @param periodSize Allocate how many periods to be buffered.
+ * @param ctx The audio context the device is opened on.
+ * @param profile Period, share mode and buffer length to ask for, NULL
+ *  for audio_device_profile_default.
  * @return Newly created capture structure, null on error.
  */
-struct capture_t* capture_create(ma_uint32 peirodSize);
+struct capture_t *capture_create(struct audio_context_t *ctx,
+                                 const struct audio_device_profile_t *profile);
+
+/**
+ * Create Audio Capture structure that does not need sound hardware.
+ * A null backend device supplies the clock and the audio is read from a WAV
+ * file (looped) or a synthetic sine wave instead of a microphone.
+ *
+ * @param ctx The audio context, must be created headless.
+ * @param profile Period, share mode and buffer length to ask for, NULL
+ *  for audio_device_profile_default.
+ * @param path The WAV file to stream, NULL for a 440 Hz sine.
+ * @return Newly created capture structure, null on error.
+ */
+struct capture_t *
+capture_create_headless(struct audio_context_t *ctx,
+                        const struct audio_device_profile_t *profile,
+                        const char *path);
 
 /**
  * Destroy Audio capture structure and free internals.
@@ -35,6 +57,8 @@ ma_result capture_start(struct capture_t *s);
 
 /**
  * Get the next available captured data.
+ * While the gate is closed this periodically returns a comfort noise
+ * descriptor (kind CAPTURE_DATA_COMFORT_NOISE) instead of audio.
  *
  * @param s Audio Capture structure.
  * @param cd The capture data pointer to populate.
@@ -44,4 +68,23 @@ ma_result capture_start(struct capture_t *s);
  */
 ma_result capture_next_available(struct capture_t *s, struct capture_data_t **cd);
 
+/**
+ * Get what the backend opened the capture device with, which may differ
+ * from what the profile asked for.
+ *
+ * @param s Audio Capture structure.
+ * @param out The device info to populate.
+ */
+void capture_get_device_info(struct capture_t *s,
+                             struct audio_device_info_t *out);
+
+/**
+ * Read the runtime counters of the audio capture.
+ * Frames captured, gated and dropped on overflow and callback overruns.
+ *
+ * @param s Audio Capture structure.
+ * @param out The snapshot to populate.
+ */
+void capture_get_counters(struct capture_t *s, struct audio_counters_t *out);
+
 #endif
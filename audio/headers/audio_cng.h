@@ -0,0 +1,120 @@
+#ifndef TINY_VC_AUDIO_CNG_H
+#define TINY_VC_AUDIO_CNG_H
+
+#include "miniaudio.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Number of reflection coefficients describing the noise spectrum.
+ */
+#define CN_ORDER 8
+
+/**
+ * Size in bytes of a marshaled comfort noise descriptor.
+ */
+#define CN_DESCRIPTOR_SIZE (1 + CN_ORDER)
+
+/**
+ * Comfort noise descriptor.
+ * Describes the background noise of a sender while it is not talking.
+ */
+struct cn_descriptor {
+  /* Quantized noise level, see audio_level_quantize. */
+  ma_uint8 level;
+  /* Reflection coefficients of the spectral envelope, scaled by 127. */
+  ma_int8 reflection[CN_ORDER];
+};
+
+/**
+ * Estimates the comfort noise descriptor from the silent periods of a sender.
+ */
+struct cn_analyzer {
+  /* Smoothed autocorrelation of the background noise. */
+  double autocorr[CN_ORDER + 1];
+  /* If any period has been analyzed yet. */
+  bool has_data;
+};
+
+/**
+ * Synthesizes comfort noise that matches a descriptor.
+ */
+struct cn_generator {
+  /* Direct form filter coefficients of the spectral envelope. */
+  float lpc[CN_ORDER];
+  /* Past outputs of the filter. */
+  float history[CN_ORDER];
+  /* Scale of the excitation noise. */
+  float excitation;
+  /* Noise generator state. */
+  ma_uint32 seed;
+};
+
+/**
+ * Initialize the comfort noise analyzer.
+ */
+void cn_analyzer_init(struct cn_analyzer *an);
+
+/**
+ * Feed a silent period of f32 audio into the analyzer.
+ *
+ * @param an The analyzer.
+ * @param input The raw f32 audio data.
+ * @param frameCount The amount of PCM frames in the input.
+ * @param channels The number of channels, only the first is analyzed.
+ */
+void cn_analyzer_update(struct cn_analyzer *an, const float *input,
+                        ma_uint32 frameCount, ma_uint32 channels);
+
+/**
+ * Produce the descriptor for the current noise estimate.
+ *
+ * @param an The analyzer.
+ * @param out The descriptor to populate.
+ */
+void cn_analyzer_descriptor(const struct cn_analyzer *an,
+                            struct cn_descriptor *out);
+
+/**
+ * Marshal the descriptor into the buffer.
+ *
+ * @param desc The descriptor.
+ * @param buffer Buffer of at least CN_DESCRIPTOR_SIZE bytes.
+ */
+void cn_descriptor_marshal(const struct cn_descriptor *desc, void *buffer);
+
+/**
+ * Unmarshal the descriptor from the buffer.
+ *
+ * @param buffer The raw descriptor.
+ * @param len The length of the buffer.
+ * @param desc The descriptor to populate.
+ * @return MA_INVALID_ARGS if the buffer is too small, MA_SUCCESS otherwise.
+ */
+ma_result cn_descriptor_unmarshal(const void *buffer, size_t len,
+                                  struct cn_descriptor *desc);
+
+/**
+ * Initialize the comfort noise generator to silence.
+ */
+void cn_generator_init(struct cn_generator *gen, ma_uint32 seed);
+
+/**
+ * Update the generator to match a new descriptor.
+ */
+void cn_generator_update(struct cn_generator *gen,
+                         const struct cn_descriptor *desc);
+
+/**
+ * Mix generated comfort noise into the output.
+ *
+ * @param gen The generator.
+ * @param out The interleaved f32 output to accumulate into.
+ * @param frameCount The number of frames to generate.
+ * @param channels The number of channels in the output.
+ * @param gain The linear gain to apply to the noise.
+ */
+void cn_generator_mix(struct cn_generator *gen, float *out,
+                      ma_uint32 frameCount, ma_uint32 channels, float gain);
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef TINY_VC_AUDIO_CONTEXT_H
+#define TINY_VC_AUDIO_CONTEXT_H
+
+#include "audio_memory.h"
+#include "miniaudio.h"
+#include <stdbool.h>
+
+/**
+ * Opaque audio context type.
+ * Holds the miniaudio context every capture and playback device is created
+ * on, so the backends are loaded and probed once per process instead of once
+ * per device. Devices of one context can be created and destroyed from any
+ * thread. The context must outlive all of its devices.
+ */
+struct audio_context_t;
+
+/**
+ * Create an audio context.
+ *
+ * @param headless Only use the null backend, its devices run on a timer
+ *  without any sound hardware. Required by capture_create_headless and
+ *  playback_create_headless.
+ * @param memory_flags Bitwise or of audio_memory_flags for the rings, the
+ *  device buffers and the structures the audio callbacks touch, 0 for the
+ *  regular heap.
+ * @return Newly created context, null on error.
+ */
+struct audio_context_t *audio_context_create(bool headless,
+                                             ma_uint32 memory_flags);
+
+/**
+ * Destroy an audio context. Destroy its devices first.
+ *
+ * @param c Audio context structure.
+ *  This function nulls out the parameter on success.
+ */
+void audio_context_destroy(struct audio_context_t **c);
+
+/**
+ * Check whether the context only has the null backend.
+ *
+ * @param c Audio context structure.
+ * @return true if created headless.
+ */
+bool audio_context_is_headless(const struct audio_context_t *c);
+
+/**
+ * Read where the context's audio memory ended up, all zero without
+ * memory flags.
+ *
+ * @param c Audio context structure.
+ * @param out The snapshot to populate.
+ */
+void audio_context_get_memory_stats(const struct audio_context_t *c,
+                                    struct audio_memory_stats_t *out);
+
+#endif
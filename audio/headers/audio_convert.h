@@ -0,0 +1,61 @@
+#ifndef TINY_VC_AUDIO_CONVERT_H
+#define TINY_VC_AUDIO_CONVERT_H
+
+#include "audio_types.h"
+#include <stdbool.h>
+
+/**
+ * Opaque audio converter type.
+ * Converts a stream of capture data between formats and sample rates,
+ * keeping the resampler state between calls so packet edges stay smooth.
+ */
+struct converter_t;
+
+/**
+ * Create an Audio Converter structure.
+ *
+ * @param formatIn The format of the incoming data.
+ * @param formatOut The format to convert to.
+ * @param channels The number of channels, the same on both sides.
+ * @param sampleRateIn The sample rate of the incoming data.
+ * @param sampleRateOut The sample rate to convert to.
+ * @return Newly created converter structure, null on error.
+ */
+struct converter_t *converter_create(ma_format formatIn, ma_format formatOut,
+                                     ma_uint32 channels,
+                                     ma_uint32 sampleRateIn,
+                                     ma_uint32 sampleRateOut);
+
+/**
+ * Destroy Audio Converter structure and free internals.
+ *
+ * @param c Audio Converter structure.
+ *  This function nulls out the parameter on success.
+ */
+void converter_destroy(struct converter_t **c);
+
+/**
+ * Check if the converter handles the given input and output.
+ *
+ * @param c Audio Converter structure.
+ * @return True if the converter was created with the same parameters.
+ */
+bool converter_matches(const struct converter_t *c, ma_format formatIn,
+                       ma_format formatOut, ma_uint32 channels,
+                       ma_uint32 sampleRateIn, ma_uint32 sampleRateOut);
+
+/**
+ * Convert the audio capture data.
+ *
+ * @param c Audio Converter structure.
+ * @param in The capture data to convert, must be CAPTURE_DATA_AUDIO.
+ * @param out The converted capture data. This function will create this
+ *  structure. User is responsible for freeing it. See capture_data_destroy.
+ * @return ma_result enum. MA_INVALID_ARGS if the frames of in do not fit
+ *  its buffer, see capture_data_frames_fit.
+ */
+ma_result converter_process(struct converter_t *c,
+                            const struct capture_data_t *in,
+                            struct capture_data_t **out);
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef TINY_VC_AUDIO_COUNTERS_H
+#define TINY_VC_AUDIO_COUNTERS_H
+
+#include "miniaudio.h"
+
+/**
+ * Runtime counters kept by capture and playback.
+ */
+enum audio_counter {
+  /* Frames handed to the capture callback. */
+  COUNTER_FRAMES_CAPTURED = 0,
+  /* Captured frames not sent because the gate was closed. */
+  COUNTER_FRAMES_GATED,
+  /* Captured frames lost because the capture ring buffer was full. */
+  COUNTER_FRAMES_DROPPED_OVERFLOW,
+  /* Frames queued into the playback jitter buffers. */
+  COUNTER_FRAMES_QUEUED,
+  /* Frames lost because a jitter buffer was full or no stream slot was
+   * free. */
+  COUNTER_FRAMES_DROPPED_QUEUE,
+  /* Playback periods where a playing stream ran out of data. */
+  COUNTER_UNDERRUN_PERIODS,
+  /* Callbacks that took longer than their period. */
+  COUNTER_CALLBACK_OVERRUNS,
+  /* Received packets rejected because their frames did not fit their
+   * payload or their format was unknown. */
+  COUNTER_PACKETS_MALFORMED,
+  COUNTER_COUNT,
+};
+
+/**
+ * Plain snapshot of the counters, safe to copy around and read from Zig.
+ */
+struct audio_counters_t {
+  ma_uint64 frames_captured;
+  ma_uint64 frames_gated;
+  ma_uint64 frames_dropped_overflow;
+  ma_uint64 frames_queued;
+  ma_uint64 frames_dropped_queue;
+  ma_uint64 underrun_periods;
+  ma_uint64 callback_overruns;
+  ma_uint64 packets_malformed;
+};
+
+/**
+ * Opaque live counters type.
+ * Every counter is a relaxed atomic, safe to bump from the audio callbacks.
+ */
+struct counters_t;
+
+/**
+ * Create a Counters structure with every counter at zero.
+ *
+ * @return Newly created counters structure, null on error.
+ */
+struct counters_t *counters_create(void);
+
+/**
+ * Destroy Counters structure.
+ *
+ * @param c Counters structure.
+ *  This function nulls out the parameter on success.
+ */
+void counters_destroy(struct counters_t **c);
+
+/**
+ * Add to a counter. Does nothing when c is NULL.
+ *
+ * @param c Counters structure.
+ * @param counter The counter to bump.
+ * @param value The amount to add.
+ */
+void counters_add(struct counters_t *c, enum audio_counter counter,
+                  ma_uint64 value);
+
+/**
+ * Read every counter.
+ *
+ * @param c Counters structure.
+ * @param out The snapshot to populate.
+ */
+void counters_snapshot(const struct counters_t *c,
+                       struct audio_counters_t *out);
+
+#endif
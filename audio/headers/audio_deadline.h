@@ -0,0 +1,111 @@
+#ifndef TINY_VC_AUDIO_DEADLINE_H
+#define TINY_VC_AUDIO_DEADLINE_H
+
+#include "miniaudio.h"
+#include <stdbool.h>
+#include <stdio.h>
+
+/**
+ * Audio callbacks watched by the deadline monitor.
+ */
+enum deadline_callback {
+  DEADLINE_CAPTURE = 0,
+  DEADLINE_PLAYBACK,
+  DEADLINE_CALLBACK_COUNT,
+};
+
+/**
+ * Number of worst callbacks kept for each callback.
+ */
+#define DEADLINE_WORST_COUNT 8
+
+/**
+ * One slow callback.
+ */
+struct deadline_offender {
+  /* When the callback started, see trace_now_ns. */
+  ma_uint64 start_ns;
+  /* How long the callback ran. */
+  ma_uint64 duration_ns;
+  /* The period the callback had to finish in. */
+  ma_uint64 deadline_ns;
+  ma_uint32 frames;
+};
+
+/**
+ * Turn the monitor on or off. It is off by default, when off
+ * deadline_record returns straight away.
+ *
+ * @param enabled If callbacks should be recorded.
+ */
+void deadline_set_enabled(bool enabled);
+
+/**
+ * If the monitor is on.
+ */
+bool deadline_enabled(void);
+
+/**
+ * Record one callback. Lock free, safe to call from the audio callbacks.
+ * The deadline is frames / sampleRate, the length of the period.
+ *
+ * @param callback The callback that ran.
+ * @param start_ns When the callback started, see trace_now_ns.
+ * @param end_ns When the callback returned.
+ * @param frames Frames the callback processed.
+ * @param sampleRate Sample rate of the device.
+ */
+void deadline_record(enum deadline_callback callback, ma_uint64 start_ns,
+                     ma_uint64 end_ns, ma_uint32 frames, ma_uint32 sampleRate);
+
+/**
+ * Get the callback duration at the given percentile, as a fraction of the
+ * deadline. 1.0 means the callback used its whole period.
+ *
+ * @param callback The callback.
+ * @param percentile The percentile, 0 to 100.
+ * @return The fraction, 0 if nothing was recorded. Fractions above 2 are
+ *  reported as 2.
+ */
+double deadline_percentile(enum deadline_callback callback,
+                           double percentile);
+
+/**
+ * Get the number of callbacks recorded.
+ */
+ma_uint64 deadline_count(enum deadline_callback callback);
+
+/**
+ * Get the number of callbacks that went over their deadline.
+ */
+ma_uint64 deadline_misses(enum deadline_callback callback);
+
+/**
+ * Get the slowest callbacks relative to their deadline, worst first.
+ *
+ * @param callback The callback.
+ * @param out Array of at least DEADLINE_WORST_COUNT entries to populate.
+ * @return The number of entries written.
+ */
+ma_uint32 deadline_worst(enum deadline_callback callback,
+                         struct deadline_offender *out);
+
+/**
+ * Name of a callback, for printing.
+ */
+const char *deadline_callback_name(enum deadline_callback callback);
+
+/**
+ * Print the load percentiles and worst offenders of every callback.
+ *
+ * @param out The stream to print to, stdout when NULL.
+ */
+void deadline_print(FILE *out);
+
+/**
+ * Clear every histogram and the worst offenders.
+ * Callbacks recorded while clearing may be lost.
+ */
+void deadline_reset(void);
+
+#endif
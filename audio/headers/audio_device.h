@@ -0,0 +1,81 @@
+#ifndef TINY_VC_AUDIO_DEVICE_H
+#define TINY_VC_AUDIO_DEVICE_H
+
+#include "miniaudio.h"
+#include <stdbool.h>
+
+/**
+ * Default length of the capture ring buffer and of each playback stream's
+ * buffer, in milliseconds.
+ */
+#define AUDIO_DEVICE_DEFAULT_BUFFER_MS 2000
+/**
+ * Period the low latency profile asks for when none is given, in
+ * microseconds.
+ */
+#define AUDIO_DEVICE_LOW_LATENCY_PERIOD_US 5000
+/**
+ * Number of periods the low latency profile asks for.
+ */
+#define AUDIO_DEVICE_LOW_LATENCY_PERIODS 2
+
+/**
+ * What to ask the backend for when opening a capture or playback device.
+ * The backend is free to round or ignore any of it, see
+ * audio_device_info_t for what it settled on.
+ */
+struct audio_device_profile_t {
+  /* Length of one device period in microseconds, 0 for the backend default. */
+  ma_uint32 period_us;
+  /* Number of periods in the device buffer, 0 for the backend default. */
+  ma_uint32 periods;
+  /* Ask for ma_performance_profile_low_latency. false keeps miniaudio's
+   * default, which is that same profile. */
+  bool low_latency;
+  /* Try exclusive mode first, falls back to shared if it is refused. */
+  bool exclusive;
+  /* Length of the capture ring buffer or of each playback stream's buffer,
+   * in milliseconds. */
+  ma_uint32 buffer_ms;
+};
+
+/**
+ * What the backend actually opened a device with.
+ */
+struct audio_device_info_t {
+  /* Sample rate of the device itself. */
+  ma_uint32 sample_rate;
+  ma_uint32 channels;
+  /* Length of one device period in frames of sample_rate. */
+  ma_uint32 period_frames;
+  /* Length of one device period in microseconds. */
+  ma_uint32 period_us;
+  /* Number of periods in the device buffer. */
+  ma_uint32 periods;
+  /* If the device was opened in exclusive mode. */
+  bool exclusive;
+  /* Length of the capture ring buffer or of each playback stream's buffer,
+   * in frames. */
+  ma_uint32 buffer_frames;
+};
+
+/**
+ * Profile with miniaudio's defaults: its low latency performance profile
+ * (10 ms periods unless the backend picks otherwise), shared mode.
+ *
+ * @return The profile.
+ */
+struct audio_device_profile_t audio_device_profile_default(void);
+
+/**
+ * Profile for the lowest latency the backend will give: small periods, the
+ * low latency performance profile and exclusive mode where possible.
+ *
+ * @param period_us Period to ask for, 0 for
+ *  AUDIO_DEVICE_LOW_LATENCY_PERIOD_US.
+ * @return The profile.
+ */
+struct audio_device_profile_t audio_device_profile_low_latency(
+    ma_uint32 period_us);
+
+#endif
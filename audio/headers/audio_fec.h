@@ -0,0 +1,75 @@
+#ifndef TINY_VC_AUDIO_FEC_H
+#define TINY_VC_AUDIO_FEC_H
+
+#include "miniaudio.h"
+#include <stddef.h>
+
+/**
+ * Maximum number of data or parity shards in one FEC group.
+ */
+#define FEC_MAX_SHARDS 64
+
+/**
+ * Multiply two elements of GF(2^8).
+ */
+ma_uint8 fec_gf_mul(ma_uint8 a, ma_uint8 b);
+
+/**
+ * Multiplicative inverse of an element of GF(2^8).
+ * The inverse of 0 is returned as 0.
+ */
+ma_uint8 fec_gf_inv(ma_uint8 a);
+
+/**
+ * Multiply a region by a constant and add it into the destination.
+ * dst[i] ^= c * src[i] over GF(2^8). Uses AVX2 or SSSE3 when the CPU has
+ * them, checked at runtime.
+ *
+ * @param[out] dst The destination region.
+ * @param[in] src The source region.
+ * @param[in] c The constant.
+ * @param[in] len The length of both regions in bytes.
+ */
+void fec_gf_mul_add(ma_uint8 *dst, const ma_uint8 *src, ma_uint8 c,
+                    size_t len);
+
+/**
+ * Coefficient of a data shard in a parity shard.
+ * Coefficients form a Cauchy matrix so any square sub matrix is invertible.
+ *
+ * @param[in] parity_index The parity shard index.
+ * @param[in] data_index The data shard index.
+ * @return The coefficient.
+ */
+ma_uint8 fec_coefficient(ma_uint32 parity_index, ma_uint32 data_index);
+
+/**
+ * Reed-Solomon encode a group of data shards.
+ * With one parity shard this is a plain XOR of the data.
+ *
+ * @param[in] data The k data shards, each len bytes.
+ * @param[in] k The number of data shards.
+ * @param[out] parity The m parity shards to populate, each len bytes.
+ * @param[in] m The number of parity shards.
+ * @param[in] len The length of every shard.
+ * @return ma_result enum.
+ */
+ma_result fec_encode(const ma_uint8 *const *data, ma_uint32 k,
+                     ma_uint8 *const *parity, ma_uint32 m, size_t len);
+
+/**
+ * Rebuild missing data shards of a group.
+ *
+ * @param[in,out] shards The k data shards followed by the m parity shards,
+ *  each len bytes. Missing data shards must point at writable buffers that
+ *  receive the rebuilt data.
+ * @param[in] present Flags for which of the k + m shards were received.
+ * @param[in] k The number of data shards.
+ * @param[in] m The number of parity shards.
+ * @param[in] len The length of every shard.
+ * @return ma_result enum. MA_INVALID_DATA if too few shards were received.
+ */
+ma_result fec_decode(ma_uint8 *const *shards, const ma_bool8 *present,
+                     ma_uint32 k, ma_uint32 m, size_t len);
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef TINY_VC_AUDIO_MEMORY_H
+#define TINY_VC_AUDIO_MEMORY_H
+
+#include "miniaudio.h"
+
+/**
+ * Blocks at least this large are put on huge pages with
+ * AUDIO_MEMORY_HUGE_PAGES, smaller ones would waste most of a page.
+ */
+#define AUDIO_MEMORY_HUGE_PAGE_THRESHOLD (256 * 1024)
+/**
+ * Size of the huge pages asked for.
+ */
+#define AUDIO_MEMORY_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/**
+ * How audio memory is backed. No flags means the regular heap.
+ */
+enum audio_memory_flags {
+  /* Lock every block into RAM so it is never swapped out. */
+  AUDIO_MEMORY_LOCKED = 1 << 0,
+  /* Put large blocks on huge pages, fewer TLB misses on the rings. */
+  AUDIO_MEMORY_HUGE_PAGES = 1 << 1,
+};
+
+/**
+ * Where audio memory ended up, in bytes unless noted.
+ */
+struct audio_memory_stats_t {
+  /* Currently mapped, headers and page rounding included. */
+  ma_uint64 mapped_bytes;
+  /* Currently locked into RAM. */
+  ma_uint64 locked_bytes;
+  /* Currently on huge pages. */
+  ma_uint64 huge_page_bytes;
+  /* Blocks that could not be locked (count), see RLIMIT_MEMLOCK. */
+  ma_uint64 lock_failures;
+};
+
+/**
+ * Opaque audio memory type.
+ * Allocation callbacks that give every block its own anonymous mapping,
+ * faulted in up front and optionally locked and on huge pages. Memory the
+ * audio callbacks touch then never page faults or gets swapped out in the
+ * middle of a call. Locking or huge pages failing is not an error, the
+ * block is still handed out prefaulted and counted in the stats.
+ * Thread safe.
+ */
+struct audio_memory_t;
+
+/**
+ * Create an audio memory allocator.
+ *
+ * @param flags Bitwise or of audio_memory_flags.
+ * @return Newly created allocator, null on error.
+ */
+struct audio_memory_t *audio_memory_create(ma_uint32 flags);
+
+/**
+ * Destroy an audio memory allocator. Free every block first.
+ *
+ * @param m Audio memory structure.
+ *  This function nulls out the parameter on success.
+ */
+void audio_memory_destroy(struct audio_memory_t **m);
+
+/**
+ * Get the callbacks to hand to miniaudio. They stay valid until the
+ * allocator is destroyed.
+ *
+ * @param m Audio memory structure.
+ * @return The allocation callbacks.
+ */
+const ma_allocation_callbacks *
+audio_memory_callbacks(const struct audio_memory_t *m);
+
+/**
+ * Read where the allocator's memory ended up.
+ *
+ * @param m Audio memory structure.
+ * @param out The snapshot to populate.
+ */
+void audio_memory_get_stats(const struct audio_memory_t *m,
+                            struct audio_memory_stats_t *out);
+
+#endif
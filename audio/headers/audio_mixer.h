@@ -0,0 +1,110 @@
+#ifndef TINY_VC_AUDIO_MIXER_H
+#define TINY_VC_AUDIO_MIXER_H
+
+#include "audio_counters.h"
+#include "audio_types.h"
+#include <stdbool.h>
+
+/**
+ * Maximum number of senders the mixer will track at once.
+ */
+#define MIXER_MAX_STREAMS 16
+
+/**
+ * Opaque audio mixer type.
+ *
+ * The mixer keeps a separate jitter buffer for every sender (keyed by the
+ * capture data stream_id) and sums them together into one period.
+ * It is single producer (mixer_queue) and single consumer (mixer_read).
+ */
+struct mixer_t;
+
+/**
+ * Create an Audio Mixer structure.
+ * Mixed output is always in ma_format_f32.
+ *
+ * @param channels The number of channels to mix.
+ * @param sampleRate The sample rate of the output.
+ * @param sizeInFrames The size of each per stream jitter buffer in frames.
+ * @param prebufferFrames How many frames a stream must have buffered before
+ *  it starts (or restarts after running dry) playing.
+ * @param counters Counters to bump on queued and dropped frames and
+ *  underruns, may be NULL. Must outlive the mixer.
+ * @param alloc Allocation callbacks for the mixer and its jitter buffers,
+ *  NULL for the heap. Must outlive the mixer.
+ * @return Newly created mixer structure, null on error.
+ */
+struct mixer_t *mixer_create(ma_uint32 channels, ma_uint32 sampleRate,
+                             ma_uint32 sizeInFrames,
+                             ma_uint32 prebufferFrames,
+                             struct counters_t *counters,
+                             const ma_allocation_callbacks *alloc);
+
+/**
+ * Destroy Audio Mixer structure and free internals.
+ *
+ * @param m Audio Mixer structure.
+ *  This function nulls out the parameter on success.
+ */
+void mixer_destroy(struct mixer_t **m);
+
+/**
+ * Queue up capture data into the jitter buffer of its stream.
+ * A new stream is allocated the first time a stream_id is seen.
+ * Comfort noise descriptors update the noise played while the stream is
+ * silent. Audio in other formats or sample rates is converted.
+ *
+ * @param m Audio Mixer structure.
+ * @param cd The capture data to queue.
+ * @return ma_result enum. MA_NO_SPACE if all stream slots are in use.
+ */
+ma_result mixer_queue(struct mixer_t *m, const struct capture_data_t *cd);
+
+/**
+ * Turn clock drift compensation on or off, it is on by default.
+ * Each stream's jitter buffer settles at some fill level once it starts
+ * playing. The sender's clock running faster or slower than the playback
+ * device's moves it away from there over time. With compensation every
+ * stream is resampled by up to 0.1% to hold its fill level, and with it
+ * the latency, where it settled.
+ *
+ * @param m Audio Mixer structure.
+ * @param enabled If streams follow their sender's clock.
+ */
+void mixer_set_drift_compensation(struct mixer_t *m, bool enabled);
+
+/**
+ * Set the linear gain of the given stream.
+ *
+ * @param m Audio Mixer structure.
+ * @param stream_id The stream to adjust.
+ * @param gain The linear gain, 1.0 is unity.
+ * @return ma_result enum. MA_DOES_NOT_EXIST if the stream is not active.
+ */
+ma_result mixer_set_gain(struct mixer_t *m, ma_uint32 stream_id, float gain);
+
+/**
+ * Get how many frames are waiting in the jitter buffer of the given stream.
+ * Only call this from the same thread as mixer_queue.
+ *
+ * @param m Audio Mixer structure.
+ * @param stream_id The stream to check.
+ * @param frames Populated with the number of buffered frames.
+ * @return ma_result enum. MA_DOES_NOT_EXIST if the stream is not active.
+ */
+ma_result mixer_buffered_frames(struct mixer_t *m, ma_uint32 stream_id,
+                                ma_uint32 *frames);
+
+/**
+ * Mix the next period of all active streams into the output buffer.
+ * The output is always fully written, gaps are filled with the stream's
+ * comfort noise or silence if it has not sent any.
+ *
+ * @param m Audio Mixer structure.
+ * @param out The output buffer, must hold frameCount * channels samples.
+ * @param frameCount The number of frames to mix.
+ * @return The number of streams that contributed to the output.
+ */
+ma_uint32 mixer_read(struct mixer_t *m, float *out, ma_uint32 frameCount);
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef TINY_VC_AUDIO_PACER_H
+#define TINY_VC_AUDIO_PACER_H
+
+#include "miniaudio.h"
+
+/**
+ * Opaque pacer type.
+ * Releases packets at the cadence of the audio they carry instead of
+ * whenever the sending thread happens to wake up. Each packet gets an
+ * absolute deadline on the trace clock, so oversleeping one packet is not
+ * added to the next and bursts come out evenly spaced.
+ * Not thread safe, use one pacer per sending thread.
+ */
+struct pacer_t;
+
+/**
+ * Create a pacer.
+ *
+ * @param speedup_percent How much faster than real time packets go out, so
+ *  a backlog drains instead of adding latency for good.
+ * @param max_lag_ns How far the pacer may fall behind its schedule. Packets
+ *  late by less go out back to back to catch up, beyond that the schedule
+ *  restarts from now rather than sending a burst.
+ * @return Newly created pacer, null on error.
+ */
+struct pacer_t *pacer_create(ma_uint32 speedup_percent, ma_uint64 max_lag_ns);
+
+/**
+ * Destroy a pacer.
+ *
+ * @param p Pacer structure.
+ *  This function nulls out the parameter on success.
+ */
+void pacer_destroy(struct pacer_t **p);
+
+/**
+ * Sleep until the next packet is due and book its slot.
+ *
+ * @param p Pacer structure.
+ * @param duration_ns Audio the packet carries, the next packet is due this
+ *  much later (less the speedup).
+ * @return Nanoseconds slept.
+ */
+ma_uint64 pacer_wait(struct pacer_t *p, ma_uint64 duration_ns);
+
+#endif
@@ -1,6 +1,9 @@
 #ifndef TINY_VC_AUDIO_PLAYBACK_H
 #define TINY_VC_AUDIO_PLAYBACK_H
 
+#include "audio_context.h"
+#include "audio_counters.h"
+#include "audio_device.h"
 #include "audio_types.h"
 
 /**
@@ -11,10 +14,30 @@ struct playback_t;
 /**
  * Create Audio Playback structure.
  *
- * @param periodSize Allocate how many periods to be buffered.
- * @return ma_result enum.
+ * @param ctx The audio context the device is opened on.
+ * @param profile Period, share mode and buffer length to ask for, NULL
+ *  for audio_device_profile_default.
+ * @return Newly created playback structure, null on error.
+ */
+struct playback_t *
+playback_create(struct audio_context_t *ctx,
+                const struct audio_device_profile_t *profile);
+
+/**
+ * Create Audio Playback structure that does not need sound hardware.
+ * A null backend device supplies the clock and the mixed output is written
+ * to a WAV file or only counted, see playback_frames_played.
+ *
+ * @param ctx The audio context, must be created headless.
+ * @param profile Period, share mode and buffer length to ask for, NULL
+ *  for audio_device_profile_default.
+ * @param path The WAV file to write, NULL to discard the audio.
+ * @return Newly created playback structure, null on error.
  */
-struct playback_t* playback_create(ma_uint32 periodSize);
+struct playback_t *
+playback_create_headless(struct audio_context_t *ctx,
+                         const struct audio_device_profile_t *profile,
+                         const char *path);
 
 /**
  * Destroy Audio playback structure and free internals.
@@ -34,6 +57,7 @@ ma_result playback_start(struct playback_t *s);
 
 /**
  * Queue up the next capture data to play.
+ * Data is buffered per sender (cd->stream_id) and mixed together on playback.
  *
  * @param s Audio Playback structure.
  * @param cd The structure to use for playback data.
@@ -41,4 +65,63 @@ ma_result playback_start(struct playback_t *s);
  */
 ma_result playback_queue(struct playback_t *s, const struct capture_data_t *cd);
 
+/**
+ * Set the playback gain of a single sender.
+ *
+ * @param s Audio Playback structure.
+ * @param stream_id The stream to adjust.
+ * @param gain The linear gain, 1.0 is unity.
+ * @return ma_result enum. MA_DOES_NOT_EXIST if the stream is not playing.
+ */
+ma_result playback_set_stream_gain(struct playback_t *s, ma_uint32 stream_id,
+                                   float gain);
+
+/**
+ * Turn clock drift compensation on or off, it is on by default.
+ * See mixer_set_drift_compensation.
+ *
+ * @param s Audio Playback structure.
+ * @param enabled If senders are resampled to follow their clock.
+ */
+void playback_set_drift_compensation(struct playback_t *s, bool enabled);
+
+/**
+ * Get the playout delay of a single sender.
+ * Only call this from the same thread as playback_queue.
+ *
+ * @param s Audio Playback structure.
+ * @param stream_id The stream to check.
+ * @param delayMs Populated with the buffered audio in milliseconds.
+ * @return ma_result enum. MA_DOES_NOT_EXIST if the stream is not playing.
+ */
+ma_result playback_stream_delay(struct playback_t *s, ma_uint32 stream_id,
+                                ma_uint32 *delayMs);
+
+/**
+ * Get the number of frames the playback device consumed so far.
+ *
+ * @param s Audio Playback structure.
+ * @return The number of frames.
+ */
+ma_uint64 playback_frames_played(struct playback_t *s);
+
+/**
+ * Get what the backend opened the playback device with, which may differ
+ * from what the profile asked for.
+ *
+ * @param s Audio Playback structure.
+ * @param out The device info to populate.
+ */
+void playback_get_device_info(struct playback_t *s,
+                              struct audio_device_info_t *out);
+
+/**
+ * Read the runtime counters of the audio playback.
+ * Frames queued and dropped on queue, underruns and callback overruns.
+ *
+ * @param s Audio Playback structure.
+ * @param out The snapshot to populate.
+ */
+void playback_get_counters(struct playback_t *s, struct audio_counters_t *out);
+
 #endif
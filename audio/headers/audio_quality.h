@@ -0,0 +1,62 @@
+#ifndef TINY_VC_AUDIO_QUALITY_H
+#define TINY_VC_AUDIO_QUALITY_H
+
+#include "miniaudio.h"
+
+/**
+ * Objective quality of a degraded recording against its reference.
+ * Both are compared as mono at the reference sample rate, after the
+ * degraded signal is time aligned and gain matched to the reference.
+ */
+struct quality_result_t {
+  /* Frames the degraded signal lags the reference by, negative if it leads. */
+  ma_int64 offset_frames;
+  /* Normalized cross correlation at the offset, 1 is identical shape. */
+  double correlation;
+  /* Gain applied to the degraded signal to match the reference. */
+  double gain;
+  /* Signal to noise ratio over the whole overlap, in dB. */
+  double snr_db;
+  /* Mean of the per frame SNR over active frames, each clamped to
+   * [-10, 35] dB. */
+  double segmental_snr_db;
+  /* Mean log spectral distance over active frames, in dB, 0 is identical. */
+  double log_spectral_distance_db;
+  /* Runs of active frames that were dropped or badly broken. */
+  ma_uint32 glitches;
+  /* Frames compared after alignment. */
+  ma_uint64 frames_compared;
+  ma_uint32 sampleRate;
+};
+
+/**
+ * Compare two mono f32 signals at the same sample rate.
+ *
+ * @param reference The reference signal.
+ * @param reference_frames Length of the reference.
+ * @param degraded The signal to score.
+ * @param degraded_frames Length of the degraded signal.
+ * @param sampleRate The sample rate of both.
+ * @param out The result to populate.
+ * @return MA_SUCCESS on success, MA_INVALID_ARGS if either signal is empty
+ *  or they do not overlap, MA_OUT_OF_MEMORY on allocation failure.
+ */
+ma_result quality_compare(const float *reference, ma_uint64 reference_frames,
+                          const float *degraded, ma_uint64 degraded_frames,
+                          ma_uint32 sampleRate, struct quality_result_t *out);
+
+/**
+ * Compare two audio files, see quality_compare.
+ * The degraded file is decoded to mono at the reference's sample rate.
+ *
+ * @param reference_path The reference file.
+ * @param degraded_path The file to score.
+ * @param out The result to populate.
+ * @return MA_SUCCESS on success, the decoder's error if a file could not be
+ *  read.
+ */
+ma_result quality_compare_files(const char *reference_path,
+                                const char *degraded_path,
+                                struct quality_result_t *out);
+
+#endif
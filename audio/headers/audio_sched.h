@@ -0,0 +1,43 @@
+#ifndef TINY_VC_AUDIO_SCHED_H
+#define TINY_VC_AUDIO_SCHED_H
+
+#include "miniaudio.h"
+#include <stddef.h>
+
+/**
+ * Highest CPU index a thread can be pinned to, exclusive.
+ */
+#define THREAD_SCHED_MAX_CPUS 1024
+
+/**
+ * Scheduling policy of a thread.
+ */
+enum thread_sched_policy {
+  /* The default time sharing scheduler. */
+  THREAD_SCHED_OTHER = 0,
+  /* Real time, runs until it blocks or a higher priority thread wakes. */
+  THREAD_SCHED_FIFO,
+  /* Real time, like FIFO but shares a time slice with equal priorities. */
+  THREAD_SCHED_RR,
+};
+
+/**
+ * Set the scheduling policy and CPU affinity of the calling thread.
+ * Real time policies need CAP_SYS_NICE or an RLIMIT_RTPRIO at least as high
+ * as the priority. A real time thread that spins can starve its CPU, so
+ * pinned threads should get cores kept free of other work (isolcpus,
+ * cpusets).
+ *
+ * @param policy The scheduling policy.
+ * @param priority 1 to 99 for the real time policies, ignored for
+ *  THREAD_SCHED_OTHER.
+ * @param cpus CPUs the thread may run on, NULL leaves the affinity as is.
+ * @param cpu_count Number of CPUs in cpus.
+ * @return MA_SUCCESS on success, MA_INVALID_ARGS on a bad priority or CPU,
+ *  MA_ACCESS_DENIED if the process may not use the policy, MA_ERROR
+ *  otherwise. On error neither is changed.
+ */
+ma_result thread_sched_apply(enum thread_sched_policy policy, int priority,
+                             const ma_uint32 *cpus, size_t cpu_count);
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef TINY_VC_AUDIO_SHM_H
+#define TINY_VC_AUDIO_SHM_H
+
+#include "miniaudio.h"
+#include <stddef.h>
+
+/**
+ * Packet ring in POSIX shared memory, for processes on the same host.
+ * Many processes may write, one process reads. Slots are written and read
+ * in place so packets are never copied through a socket, and the reader
+ * sleeps on a futex in the shared mapping while the ring is empty.
+ */
+struct shm_ring_t;
+
+/**
+ * One slot of the ring, handed out by the acquire functions.
+ */
+struct shm_packet_t {
+  /* Start of the slot in the mapping. */
+  void *data;
+  /* Bytes available when writing, bytes written when reading. */
+  size_t len;
+  /* Position of the slot, used by the commit and release functions. */
+  ma_uint64 position;
+};
+
+/**
+ * Create the ring as its reader. An existing ring of the same name is
+ * reset, so the reader should start before the writers.
+ *
+ * @param name The shared memory name, e.g. "/tiny_vc_test".
+ * @param slot_count Number of slots, rounded up to a power of two.
+ * @param slot_size Largest packet that fits in a slot.
+ * @return Newly created ring, null on error.
+ */
+struct shm_ring_t *shm_ring_create(const char *name, ma_uint32 slot_count,
+                                   ma_uint32 slot_size);
+
+/**
+ * Open an existing ring as a writer.
+ *
+ * @param name The shared memory name given to shm_ring_create.
+ * @return The ring, null if it does not exist yet or could not be mapped.
+ */
+struct shm_ring_t *shm_ring_open(const char *name);
+
+/**
+ * Unmap the ring. The reader also removes the name.
+ *
+ * @param r Ring structure.
+ *  This function nulls out the parameter on success.
+ */
+void shm_ring_destroy(struct shm_ring_t **r);
+
+/**
+ * Claim the next free slot for writing.
+ * Every acquired slot must be committed, even if nothing was written.
+ *
+ * @param r Ring structure.
+ * @param out The slot, len is its size.
+ * @return MA_SUCCESS on success, MA_NO_SPACE if the ring is full.
+ */
+ma_result shm_ring_acquire_write(struct shm_ring_t *r,
+                                 struct shm_packet_t *out);
+
+/**
+ * Publish a written slot and wake the reader.
+ *
+ * @param r Ring structure.
+ * @param packet The slot from shm_ring_acquire_write, len set to the bytes
+ *  written. A len of 0 publishes nothing, the reader skips the slot.
+ * @return MA_SUCCESS on success, MA_INVALID_ARGS if len is over the slot size.
+ */
+ma_result shm_ring_commit_write(struct shm_ring_t *r,
+                                struct shm_packet_t *packet);
+
+/**
+ * Wait for the next packet.
+ *
+ * @param r Ring structure.
+ * @param out The packet, valid until shm_ring_release_read.
+ * @param timeout_ms How long to wait, 0 does not wait.
+ * @return MA_SUCCESS on success, MA_TIMEOUT if nothing arrived in time.
+ */
+ma_result shm_ring_acquire_read(struct shm_ring_t *r, struct shm_packet_t *out,
+                                ma_uint32 timeout_ms);
+
+/**
+ * Hand a read slot back to the writers.
+ *
+ * @param r Ring structure.
+ * @param packet The packet from shm_ring_acquire_read.
+ */
+void shm_ring_release_read(struct shm_ring_t *r, struct shm_packet_t *packet);
+
+#endif
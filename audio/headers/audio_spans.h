@@ -0,0 +1,66 @@
+#ifndef TINY_VC_AUDIO_SPANS_H
+#define TINY_VC_AUDIO_SPANS_H
+
+#include "miniaudio.h"
+#include <stdbool.h>
+
+/**
+ * Span tracing of pipeline activity, written as a Chrome trace event file
+ * that chrome://tracing and ui.perfetto.dev both open.
+ *
+ * Only compiled in when TINY_VC_TRACE_EVENTS is defined, otherwise the
+ * SPAN_* macros are empty and the functions do nothing.
+ * Every thread records into its own fixed buffer, nothing is allocated and
+ * nothing is locked, so spans are safe in the audio callbacks. A thread
+ * stops recording once its buffer is full.
+ * Span names must outlive the trace, use string literals.
+ */
+
+#ifdef TINY_VC_TRACE_EVENTS
+#define SPAN_THREAD(name) spans_thread_name(name)
+#define SPAN_BEGIN(name) spans_begin(name)
+#define SPAN_END(name) spans_end(name)
+#else
+#define SPAN_THREAD(name) ((void)0)
+#define SPAN_BEGIN(name) ((void)0)
+#define SPAN_END(name) ((void)0)
+#endif
+
+/**
+ * If span tracing was compiled in.
+ */
+bool spans_enabled(void);
+
+/**
+ * Name the calling thread in the trace. Only the first name sticks, so this
+ * is cheap to call on every audio callback.
+ *
+ * @param name The thread name.
+ */
+void spans_thread_name(const char *name);
+
+/**
+ * Begin a span on the calling thread.
+ *
+ * @param name The span name.
+ */
+void spans_begin(const char *name);
+
+/**
+ * End the span most recently begun on the calling thread.
+ *
+ * @param name The span name, same as the one given to spans_begin.
+ */
+void spans_end(const char *name);
+
+/**
+ * Write everything recorded so far as Chrome trace event JSON.
+ * Safe to call while other threads keep recording.
+ *
+ * @param path The file to write.
+ * @return MA_SUCCESS on success, MA_NOT_IMPLEMENTED when span tracing was not
+ *  compiled in, MA_ERROR if the file could not be written.
+ */
+ma_result spans_write_chrome(const char *path);
+
+#endif
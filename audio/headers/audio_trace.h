@@ -0,0 +1,87 @@
+#ifndef TINY_VC_AUDIO_TRACE_H
+#define TINY_VC_AUDIO_TRACE_H
+
+#include "miniaudio.h"
+#include <stdio.h>
+
+/**
+ * Stages of the capture to playback path a packet is traced through.
+ * Each stage records the time since the previous one.
+ */
+enum trace_stage {
+  /* Capture callback commit to capture_next_available. */
+  TRACE_CAPTURE_READ = 0,
+  /* capture_next_available to the broadcast ring write. */
+  TRACE_RING_WRITE,
+  /* Ring write to the pacer releasing the packet, includes batching. */
+  TRACE_PACE,
+  /* Pacer release to marshal. */
+  TRACE_MARSHAL,
+  /* Marshal to write_msg returning. */
+  TRACE_SEND,
+  /* Marshal on the sender to next_msg on the receiver, one way. */
+  TRACE_NETWORK,
+  /* next_msg to playback_queue, includes FEC reordering. */
+  TRACE_QUEUE,
+  /* playback_queue to the playback callback reading the last frame. */
+  TRACE_PLAYOUT,
+  /* Capture callback commit to the playback callback, mouth to ear. */
+  TRACE_TOTAL,
+  TRACE_STAGE_COUNT,
+};
+
+/**
+ * Monotonic clock used for every trace timestamp, in nanoseconds.
+ */
+ma_uint64 trace_now_ns(void);
+
+/**
+ * Record the time between a stage and the one before it.
+ * Lock free, safe to call from the audio callbacks.
+ *
+ * @param stage The stage that was reached.
+ * @param start_ns When the previous stage was reached, 0 skips the sample.
+ * @param end_ns When this stage was reached. Samples going back in time are
+ *  recorded as 0.
+ */
+void trace_record(enum trace_stage stage, ma_uint64 start_ns,
+                  ma_uint64 end_ns);
+
+/**
+ * Get the value at the given percentile of a stage.
+ *
+ * @param stage The stage.
+ * @param percentile The percentile, 0 to 100.
+ * @return The value in microseconds, 0 if nothing was recorded.
+ */
+ma_uint64 trace_percentile_us(enum trace_stage stage, double percentile);
+
+/**
+ * Get the number of samples recorded for a stage.
+ */
+ma_uint64 trace_count(enum trace_stage stage);
+
+/**
+ * Get the sum of every sample recorded for a stage, in microseconds.
+ */
+ma_uint64 trace_sum_us(enum trace_stage stage);
+
+/**
+ * Name of a stage, for printing.
+ */
+const char *trace_stage_name(enum trace_stage stage);
+
+/**
+ * Print a percentile table of every stage.
+ *
+ * @param out The stream to print to, stdout when NULL.
+ */
+void trace_print(FILE *out);
+
+/**
+ * Clear every histogram.
+ * Samples recorded while clearing may be lost.
+ */
+void trace_reset(void);
+
+#endif
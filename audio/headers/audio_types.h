@@ -4,16 +4,41 @@
 #include "miniaudio.h"
 #include <stddef.h>
 
+/**
+ * The kind of data a capture data structure holds.
+ */
+enum capture_data_kind {
+  /* PCM frames. */
+  CAPTURE_DATA_AUDIO = 0,
+  /* A comfort noise descriptor, sent while the sender is silent. */
+  CAPTURE_DATA_COMFORT_NOISE = 1,
+};
+
 /**
  * Captured data in frames.
  */
 struct capture_data_t {
+  /* Kind of data in the buffer, see capture_data_kind. */
+  ma_uint8 kind;
   /* Size in Frames. */
   ma_uint32 sizeInFrames;
   /* Format of the data. */
   ma_format format;
   /* Number of channels in the data. */
   ma_uint32 channels;
+  /* Sample rate of the data. */
+  ma_uint32 sampleRate;
+  /* ID of the sender this data came from. */
+  ma_uint32 stream_id;
+  /* Quantized level of the data, see audio_level_quantize. */
+  ma_uint8 level;
+  /* If voice activity was detected in the data. */
+  ma_bool8 voice_active;
+  /* Monotonic time the capture callback committed the data, 0 if unknown.
+   * See trace_now_ns. */
+  ma_uint64 capture_ns;
+  /* Monotonic time the data reached its last traced stage, 0 if unknown. */
+  ma_uint64 stage_ns;
   /* Size of the buffer. */
   size_t buffer_len;
   /* Buffer of PCM frame data. */
@@ -35,4 +60,13 @@ struct capture_data_t* capture_data_create(size_t len);
  */
 void capture_data_destroy(struct capture_data_t **cd);
 
+/**
+ * Check that the PCM frames of audio capture data fit in its buffer.
+ * Data that came off the wire must pass this before its frames are read.
+ *
+ * @param cd The capture data.
+ * @return If the format is known and buffer_len holds sizeInFrames frames.
+ */
+ma_bool32 capture_data_frames_fit(const struct capture_data_t *cd);
+
 #endif
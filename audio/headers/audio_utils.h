@@ -3,6 +3,7 @@
 
 #include "miniaudio.h"
 #include <stdbool.h>
+#include <stddef.h>
 
 /**
  * Structure to hold the DB range values.
@@ -50,4 +51,49 @@ double calculate_rms(const void *input, const size_t len, const ma_format format
 double audio_get_decibels(const void *input, ma_uint32 frameCount,
                           ma_format format, ma_uint32 channels);
 
+/**
+ * The quantized level used for silence, -127 dBFS or lower.
+ */
+#define AUDIO_LEVEL_SILENCE 127
+
+/**
+ * Quantize a dBFS value into a level byte.
+ * The level is the attenuation from full scale in whole decibels, so 0 is the
+ * loudest and AUDIO_LEVEL_SILENCE (127) is silence.
+ *
+ * @param[in] dBFS The decibel value, see audio_get_decibels.
+ * @return The level in the range [0, 127].
+ */
+ma_uint8 audio_level_quantize(double dBFS);
+
+/**
+ * Convert a quantized level byte back to dBFS.
+ *
+ * @param[in] level The level from audio_level_quantize.
+ * @return The dBFS value, in the range [-127, 0].
+ */
+double audio_level_to_decibels(ma_uint8 level);
+
+/**
+ * Mix the source samples into the destination with the given gain.
+ * dst[i] += src[i] * gain. Uses SIMD when available.
+ *
+ * @param[out] dst The destination samples to accumulate into.
+ * @param[in] src The source samples.
+ * @param[in] gain The linear gain to apply to the source.
+ * @param[in] len The number of samples (frames * channels).
+ */
+void audio_mix_f32(float *dst, const float *src, float gain, size_t len);
+
+/**
+ * Apply a soft limiter to the given samples in place.
+ * Samples under the threshold pass through untouched, anything over it is
+ * smoothly compressed so the output never exceeds full scale.
+ *
+ * @param[in,out] buffer The samples to limit.
+ * @param[in] len The number of samples (frames * channels).
+ * @param[in] threshold The knee of the limiter, between 0 and 1.
+ */
+void audio_soft_limit_f32(float *buffer, size_t len, float threshold);
+
 #endif
@@ -3,36 +3,335 @@
 #include <string.h>
 #define MINIAUDIO_IMPLEMENTATION 1
 #include "audio_capture.h"
+#include "audio_cng.h"
+#include "audio_context.h"
+#include "audio_counters.h"
+#include "audio_deadline.h"
+#include "audio_device.h"
+#include "audio_memory.h"
+#include "audio_mixer.h"
 #include "audio_playback.h"
+#include "audio_spans.h"
+#include "audio_trace.h"
 #include "audio_types.h"
 #include "audio_utils.h"
 #include "miniaudio.h"
 
 #include <float.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+/**
+ * Bit set in capture_period.level_info when voice activity was detected.
+ */
+#define CAPTURE_LEVEL_VAD_BIT 0x80u
+
+/**
+ * Level of a run of frames committed to the capture ring buffer in one go.
+ * Queued alongside the frames so every packet is stamped with the level of
+ * the audio it carries, not of whatever the device heard last.
+ */
+struct capture_period {
+  /* Frames of the ring buffer this entry covers. */
+  ma_uint32 frames;
+  /* Quantized level, with CAPTURE_LEVEL_VAD_BIT. */
+  ma_uint32 level_info;
+};
+
+struct audio_context_t {
+  ma_context context;
+  bool headless;
+  /* Backs the rings and the device buffers, NULL uses the heap. */
+  struct audio_memory_t *memory;
+  /* Callbacks of memory, NULL for miniaudio's default. */
+  const ma_allocation_callbacks *alloc;
+  /* ma_device_init and ma_device_uninit must not run concurrently. */
+  ma_mutex lock;
+};
+
 struct capture_t {
-  ma_uint32 periodSize;
   ma_uint32 sizeInFrames;
+  /* Capacity of the ring buffer (playback: of each stream), in frames. */
+  ma_uint32 buffer_frames;
+  struct audio_context_t *ctx;
   ma_device_config d_config;
   ma_device device;
+  struct counters_t *counters;
+  /* Headless only: the WAV file or sine wave fed in place of the device. */
+  ma_decoder decoder;
+  ma_waveform waveform;
+  ma_data_source *source;
+  void *source_buffer;
+  ma_uint32 source_frames;
   ma_pcm_rb ring_buffer;
+  /* Trace time of the last ring buffer commit, see trace_now_ns. */
+  _Atomic ma_uint64 commit_ns;
+  /* One capture_period per commit to ring_buffer, in the same order. */
+  ma_rb periods;
+  /* Reader only: the period the next frames of ring_buffer belong to. */
+  struct capture_period period;
+  /* Callback only: background noise estimate of the gated periods. */
+  struct cn_analyzer cn_analyzer;
+  /* Callback only: frames gated since the last comfort noise descriptor. */
+  ma_uint32 cn_frames;
+  /* Callback only: if the last period was sent. */
+  bool was_active;
+  /* Callback only: gate threshold in dBFS, see CAPTURE_CALIBRATION_PERIODS. */
+  double threshold;
+  /* Callback only: periods taken into the threshold so far. */
+  ma_uint32 calibration_periods;
+  /* Comfort noise descriptor waiting for capture_next_available. */
+  struct cn_descriptor cn_pending;
+  /* Set by the callback when cn_pending is ready, cleared by the reader. */
+  _Atomic int cn_ready;
 };
 
 struct playback_t {
-  ma_uint32 periodSize;
   ma_uint32 sizeInFrames;
+  /* Capacity of the ring buffer (playback: of each stream), in frames. */
+  ma_uint32 buffer_frames;
+  struct audio_context_t *ctx;
   ma_device_config d_config;
   ma_device device;
-  ma_pcm_rb ring_buffer;
+  struct counters_t *counters;
+  struct mixer_t *mixer;
+  /* Headless only: WAV file the mixed output is written to. */
+  ma_encoder encoder;
+  bool has_encoder;
+  _Atomic ma_uint64 frames_played;
 };
 
 const ma_format STD_FORMAT = ma_format_f32;
-static double CAP_THRESHOLD = -13.0;
-static double cap_sample_counter = 0;
+/* How many device periods each stream buffers before it starts playing. */
+static const ma_uint32 PLAYBACK_PREBUFFER_PERIODS = 2;
+/* Gate threshold the calibration starts from, in dBFS. */
+static const double CAPTURE_THRESHOLD_INITIAL = -13.0;
+/* The first periods are gated and averaged into the threshold. */
+static const ma_uint32 CAPTURE_CALIBRATION_PERIODS = 10;
+/* How often a comfort noise descriptor is sent while the gate is closed. */
+static const ma_uint32 CAPTURE_CN_INTERVAL_MS = 200;
+/* Sine played by headless capture when no file is given. */
+static const double HEADLESS_SINE_FREQUENCY = 440.0;
+static const double HEADLESS_SINE_AMPLITUDE = 0.5;
+
+/**
+ * Create a context that only has the null backend.
+ * Its devices run on a timer at the requested rate without any hardware.
+ */
+static ma_result audio_null_context_init(const ma_context_config *config,
+                                         ma_context *context) {
+  ma_backend backends[] = {ma_backend_null};
+  return ma_context_init(backends, 1, config, context);
+}
+
+struct audio_context_t *audio_context_create(bool headless,
+                                             ma_uint32 memory_flags) {
+  struct audio_context_t *c = malloc(sizeof(struct audio_context_t));
+  if (c == NULL) {
+    return NULL;
+  }
+  c->headless = headless;
+  c->memory = NULL;
+  c->alloc = NULL;
+  ma_context_config config = ma_context_config_init();
+  if (memory_flags != 0) {
+    c->memory = audio_memory_create(memory_flags);
+    if (c->memory == NULL) {
+      free(c);
+      return NULL;
+    }
+    c->alloc = audio_memory_callbacks(c->memory);
+    // device buffers come out of the context's callbacks too.
+    config.allocationCallbacks = *c->alloc;
+  }
+  ma_result result = headless
+                         ? audio_null_context_init(&config, &c->context)
+                         : ma_context_init(NULL, 0, &config, &c->context);
+  if (result != MA_SUCCESS) {
+    fprintf(stderr, "audio context: miniaudio context init error code(%d)\n",
+            result);
+    audio_memory_destroy(&c->memory);
+    free(c);
+    return NULL;
+  }
+  result = ma_mutex_init(&c->lock);
+  if (result != MA_SUCCESS) {
+    ma_context_uninit(&c->context);
+    audio_memory_destroy(&c->memory);
+    free(c);
+    return NULL;
+  }
+  return c;
+}
+
+void audio_context_destroy(struct audio_context_t **c) {
+  if (c == NULL) {
+    return;
+  }
+  if ((*c) == NULL) {
+    return;
+  }
+  ma_mutex_uninit(&(*c)->lock);
+  ma_context_uninit(&(*c)->context);
+  audio_memory_destroy(&(*c)->memory);
+  free(*c);
+  *c = NULL;
+}
+
+bool audio_context_is_headless(const struct audio_context_t *c) {
+  return c != NULL && c->headless;
+}
+
+void audio_context_get_memory_stats(const struct audio_context_t *c,
+                                    struct audio_memory_stats_t *out) {
+  if (c->memory == NULL) {
+    memset(out, 0, sizeof(struct audio_memory_stats_t));
+    return;
+  }
+  audio_memory_get_stats(c->memory, out);
+}
+
+struct audio_device_profile_t audio_device_profile_default(void) {
+  struct audio_device_profile_t profile = {
+      .period_us = 0,
+      .periods = 0,
+      .low_latency = false,
+      .exclusive = false,
+      .buffer_ms = AUDIO_DEVICE_DEFAULT_BUFFER_MS,
+  };
+  return profile;
+}
+
+struct audio_device_profile_t audio_device_profile_low_latency(
+    ma_uint32 period_us) {
+  struct audio_device_profile_t profile = {
+      .period_us =
+          period_us != 0 ? period_us : AUDIO_DEVICE_LOW_LATENCY_PERIOD_US,
+      .periods = AUDIO_DEVICE_LOW_LATENCY_PERIODS,
+      .low_latency = true,
+      .exclusive = true,
+      .buffer_ms = AUDIO_DEVICE_DEFAULT_BUFFER_MS,
+  };
+  return profile;
+}
+
+/**
+ * Convert a duration to frames, at least one.
+ */
+static ma_uint32 audio_us_to_frames(ma_uint64 us, ma_uint32 sample_rate) {
+  const ma_uint64 frames = us * sample_rate / 1000000;
+  return frames > 0 ? (ma_uint32)frames : 1;
+}
+
+/**
+ * Fill the period, performance profile and share mode of a device config
+ * from a profile. The sample rate must already be set.
+ */
+static void audio_device_config_apply(
+    ma_device_config *config, const struct audio_device_profile_t *profile) {
+  if (profile->period_us != 0) {
+    config->periodSizeInFrames =
+        audio_us_to_frames(profile->period_us, config->sampleRate);
+  }
+  config->periods = profile->periods;
+  // ma_device_config_init already picks the low latency profile, 10 ms
+  // periods by default. Only ever ask for it, never for conservative.
+  if (profile->low_latency) {
+    config->performanceProfile = ma_performance_profile_low_latency;
+  }
+  const ma_share_mode share_mode =
+      profile->exclusive ? ma_share_mode_exclusive : ma_share_mode_shared;
+  config->capture.shareMode = share_mode;
+  config->playback.shareMode = share_mode;
+}
+
+/**
+ * Describe what the backend opened a device with.
+ */
+static void audio_device_describe(const ma_device *device,
+                                  ma_uint32 buffer_frames,
+                                  struct audio_device_info_t *out) {
+  const bool capture = device->type == ma_device_type_capture;
+  out->sample_rate = capture ? device->capture.internalSampleRate
+                             : device->playback.internalSampleRate;
+  out->channels = capture ? device->capture.internalChannels
+                          : device->playback.internalChannels;
+  out->period_frames = capture ? device->capture.internalPeriodSizeInFrames
+                               : device->playback.internalPeriodSizeInFrames;
+  out->periods = capture ? device->capture.internalPeriods
+                         : device->playback.internalPeriods;
+  out->period_us =
+      out->sample_rate != 0
+          ? (ma_uint32)((ma_uint64)out->period_frames * 1000000 /
+                        out->sample_rate)
+          : 0;
+  out->exclusive = (capture ? device->capture.shareMode
+                            : device->playback.shareMode) ==
+                   ma_share_mode_exclusive;
+  out->buffer_frames = buffer_frames;
+}
+
+/**
+ * Initialize a device on the shared context.
+ * Some backends touch global state while opening a device, so device init
+ * and uninit are serialized per context.
+ */
+static ma_result audio_device_init(struct audio_context_t *c,
+                                   const ma_device_config *config,
+                                   ma_device *device) {
+  ma_mutex_lock(&c->lock);
+  ma_result result = ma_device_init(&c->context, config, device);
+  ma_mutex_unlock(&c->lock);
+  return result;
+}
+
+static void audio_device_uninit(struct audio_context_t *c, ma_device *device) {
+  ma_mutex_lock(&c->lock);
+  ma_device_uninit(device);
+  ma_mutex_unlock(&c->lock);
+}
+
+/**
+ * Open a device as the profile asks. Exclusive mode is often refused (the
+ * device is in use, the backend has no such mode), the device is then
+ * opened shared instead.
+ */
+static ma_result audio_device_open(struct audio_context_t *c,
+                                   ma_device_config *config,
+                                   const struct audio_device_profile_t *profile,
+                                   ma_device *device) {
+  audio_device_config_apply(config, profile);
+  ma_result result = audio_device_init(c, config, device);
+  if (result != MA_SUCCESS && profile->exclusive) {
+    config->capture.shareMode = ma_share_mode_shared;
+    config->playback.shareMode = ma_share_mode_shared;
+    result = audio_device_init(c, config, device);
+  }
+  return result;
+}
+
+/**
+ * Count the callback as an overrun if it took longer than its period and
+ * hand it to the deadline monitor.
+ */
+static void audio_callback_deadline(struct counters_t *counters,
+                                    enum deadline_callback callback,
+                                    ma_uint64 start_ns, ma_uint32 frameCount,
+                                    ma_uint32 sampleRate) {
+  if (sampleRate == 0) {
+    return;
+  }
+  const ma_uint64 end_ns = trace_now_ns();
+  const ma_uint64 deadline_ns =
+      ((ma_uint64)frameCount * 1000000000ull) / sampleRate;
+  if (end_ns - start_ns > deadline_ns) {
+    counters_add(counters, COUNTER_CALLBACK_OVERRUNS, 1);
+  }
+  deadline_record(callback, start_ns, end_ns, frameCount, sampleRate);
+}
 
 /***********************************************************************************
  *
@@ -45,32 +344,138 @@ static double cap_sample_counter = 0;
  * *********************************************************************************
  */
 
-static void data_callback(ma_device *pDevice, void *pOutput, const void *pInput,
-                          ma_uint32 frameCount) {
-  (void)pOutput;
-  struct capture_t *s = (struct capture_t *)pDevice->pUserData;
+/**
+ * Update the background noise estimate with a gated period and hand out a
+ * comfort noise descriptor when the gate just closed or the interval is up.
+ */
+static void capture_comfort_noise(struct capture_t *s, const void *pInput,
+                                  ma_uint32 frameCount) {
+  cn_analyzer_update(&s->cn_analyzer, (const float *)pInput, frameCount,
+                     s->device.capture.channels);
+  s->cn_frames += frameCount;
+  const ma_uint32 interval =
+      (s->device.sampleRate * CAPTURE_CN_INTERVAL_MS) / 1000;
+  if (!s->was_active && s->cn_frames < interval) {
+    return;
+  }
+  // reader has not picked up the last one, try again next period.
+  if (atomic_load_explicit(&s->cn_ready, memory_order_acquire) != 0) {
+    return;
+  }
+  cn_analyzer_descriptor(&s->cn_analyzer, &s->cn_pending);
+  atomic_store_explicit(&s->cn_ready, 1, memory_order_release);
+  s->cn_frames = 0;
+  s->was_active = false;
+}
+
+/**
+ * Queue the level of frames about to be committed to the ring buffer.
+ * Callback only.
+ *
+ * @return MA_SUCCESS, MA_OUT_OF_MEMORY when the queue is full.
+ */
+static ma_result capture_push_period(struct capture_t *s, ma_uint32 frames,
+                                     ma_uint32 level_info) {
+  size_t size = sizeof(struct capture_period);
+  void *buffer = NULL;
+  ma_result result = ma_rb_acquire_write(&s->periods, &size, &buffer);
+  if (result != MA_SUCCESS || size < sizeof(struct capture_period)) {
+    return MA_OUT_OF_MEMORY;
+  }
+  struct capture_period *period = buffer;
+  period->frames = frames;
+  period->level_info = level_info;
+  return ma_rb_commit_write(&s->periods, size);
+}
+
+/**
+ * Take the level of the next frames of the ring buffer, loudest of all
+ * periods they span, voiced if any of them was.
+ * Reader only.
+ *
+ * @return The quantized level, with CAPTURE_LEVEL_VAD_BIT.
+ */
+static ma_uint32 capture_pop_periods(struct capture_t *s, ma_uint32 frames) {
+  ma_uint32 level = AUDIO_LEVEL_SILENCE;
+  ma_uint32 vad = 0;
+  while (frames > 0) {
+    if (s->period.frames == 0) {
+      size_t size = sizeof(struct capture_period);
+      void *buffer = NULL;
+      if (ma_rb_acquire_read(&s->periods, &size, &buffer) != MA_SUCCESS ||
+          size < sizeof(struct capture_period)) {
+        // every commit queues its period first, this does not happen.
+        break;
+      }
+      s->period = *(const struct capture_period *)buffer;
+      (void)ma_rb_commit_read(&s->periods, size);
+      if (s->period.frames == 0) {
+        continue;
+      }
+    }
+    const ma_uint32 take = frames < s->period.frames ? frames : s->period.frames;
+    const ma_uint32 period_level = s->period.level_info & ~CAPTURE_LEVEL_VAD_BIT;
+    // 0 is the loudest level.
+    if (period_level < level) {
+      level = period_level;
+    }
+    vad |= s->period.level_info & CAPTURE_LEVEL_VAD_BIT;
+    s->period.frames -= take;
+    frames -= take;
+  }
+  return level | vad;
+}
+
+static void capture_process(struct capture_t *s, ma_device *pDevice,
+                            const void *pInput, ma_uint32 frameCount) {
+  if (s->source != NULL) {
+    // headless, the null device only gives the clock.
+    if (frameCount > s->source_frames) {
+      frameCount = s->source_frames;
+    }
+    ma_uint64 framesRead = 0;
+    ma_data_source_read_pcm_frames(s->source, s->source_buffer, frameCount,
+                                   &framesRead);
+    if (framesRead < frameCount) {
+      ma_silence_pcm_frames(
+          ma_offset_pcm_frames_ptr(s->source_buffer, framesRead,
+                                   pDevice->capture.format,
+                                   pDevice->capture.channels),
+          frameCount - framesRead, pDevice->capture.format,
+          pDevice->capture.channels);
+    }
+    pInput = s->source_buffer;
+  }
   const size_t data_len =
       frameCount * ma_get_bytes_per_frame(pDevice->capture.format,
                                           pDevice->capture.channels);
   if (data_len == 0) {
     return;
   }
+  counters_add(s->counters, COUNTER_FRAMES_CAPTURED, frameCount);
   // convert to decimals
   // https://en.wikipedia.org/wiki/DBFS
   const double dBFS = audio_get_decibels(
       pInput, frameCount, pDevice->capture.format, pDevice->capture.channels);
   // decibels must be certain level before we process it
-  printf("dBFS = %f, threshold = %f\n", dBFS, CAP_THRESHOLD);
-  if (cap_sample_counter < 10) {
-    cap_sample_counter++;
-    CAP_THRESHOLD += dBFS;
-    if (cap_sample_counter == 10) {
-      CAP_THRESHOLD = CAP_THRESHOLD / 10.0;
+  printf("dBFS = %f, threshold = %f\n", dBFS, s->threshold);
+  if (s->calibration_periods < CAPTURE_CALIBRATION_PERIODS) {
+    s->calibration_periods++;
+    s->threshold += dBFS;
+    if (s->calibration_periods == CAPTURE_CALIBRATION_PERIODS) {
+      s->threshold = s->threshold / (double)CAPTURE_CALIBRATION_PERIODS;
     }
+    counters_add(s->counters, COUNTER_FRAMES_GATED, frameCount);
+    capture_comfort_noise(s, pInput, frameCount);
     return;
-  } else if (dBFS < CAP_THRESHOLD) {
+  } else if (dBFS < s->threshold) {
+    counters_add(s->counters, COUNTER_FRAMES_GATED, frameCount);
+    capture_comfort_noise(s, pInput, frameCount);
     return;
   }
+  const ma_uint32 level_info =
+      audio_level_quantize(dBFS) | CAPTURE_LEVEL_VAD_BIT;
+  s->was_active = true;
   ma_uint32 local_frame_count = frameCount;
   ma_uint32 framesWritten = 0;
   while (framesWritten < frameCount) {
@@ -81,9 +486,20 @@ static void data_callback(ma_device *pDevice, void *pOutput, const void *pInput,
       fprintf(stderr,
               "failed to acquire write for ring buffer -- error code(%d).\n",
               result);
+      counters_add(s->counters, COUNTER_FRAMES_DROPPED_OVERFLOW,
+                   frameCount - framesWritten);
       return;
     }
     if (local_frame_count == 0) {
+      // ring buffer is full, the reader is falling behind.
+      counters_add(s->counters, COUNTER_FRAMES_DROPPED_OVERFLOW,
+                   frameCount - framesWritten);
+      return;
+    }
+    // queue the level first, the reader must find it once it sees the frames.
+    if (capture_push_period(s, local_frame_count, level_info) != MA_SUCCESS) {
+      counters_add(s->counters, COUNTER_FRAMES_DROPPED_OVERFLOW,
+                   frameCount - framesWritten);
       return;
     }
     const float *data_offset = ma_offset_pcm_frames_const_ptr_f32(
@@ -95,15 +511,45 @@ static void data_callback(ma_device *pDevice, void *pOutput, const void *pInput,
       fprintf(stderr,
               "failed to commit write to ring buffer -- error code(%d).\n",
               result);
+      counters_add(s->counters, COUNTER_FRAMES_DROPPED_OVERFLOW,
+                   frameCount - framesWritten);
       return;
     }
     framesWritten += local_frame_count;
   }
+  atomic_store_explicit(&s->commit_ns, trace_now_ns(), memory_order_relaxed);
+}
+
+static void data_callback(ma_device *pDevice, void *pOutput, const void *pInput,
+                          ma_uint32 frameCount) {
+  (void)pOutput;
+  struct capture_t *s = (struct capture_t *)pDevice->pUserData;
+  SPAN_THREAD("capture callback");
+  SPAN_BEGIN("data_callback");
+  const ma_uint64 start_ns = trace_now_ns();
+  capture_process(s, pDevice, pInput, frameCount);
+  SPAN_END("data_callback");
+  audio_callback_deadline(s->counters, DEADLINE_CAPTURE, start_ns,
+                          frameCount, pDevice->sampleRate);
 }
 
-struct capture_t *capture_create(ma_uint32 periodSize) {
-  struct capture_t *s = malloc(sizeof(struct capture_t));
-  s->periodSize = periodSize;
+/**
+ * Shared setup of capture_create and capture_create_headless.
+ * On error everything this function set up is torn down again.
+ */
+static ma_result capture_init(struct capture_t *s,
+                              struct audio_context_t *ctx,
+                              const struct audio_device_profile_t *profile) {
+  s->ctx = ctx;
+  s->period.frames = 0;
+  s->period.level_info = AUDIO_LEVEL_SILENCE;
+  atomic_init(&s->commit_ns, 0);
+  cn_analyzer_init(&s->cn_analyzer);
+  s->cn_frames = 0;
+  s->was_active = false;
+  s->threshold = CAPTURE_THRESHOLD_INITIAL;
+  s->calibration_periods = 0;
+  atomic_init(&s->cn_ready, 0);
   s->d_config = ma_device_config_init(ma_device_type_capture);
   s->d_config.capture.pDeviceID = NULL;
   s->d_config.capture.format = STD_FORMAT;
@@ -111,29 +557,134 @@ struct capture_t *capture_create(ma_uint32 periodSize) {
   s->d_config.sampleRate = 44100;
   s->d_config.dataCallback = data_callback;
   s->d_config.pUserData = s;
-  ma_result result = ma_device_init(NULL, &s->d_config, &s->device);
+  s->counters = counters_create();
+  if (s->counters == NULL) {
+    return MA_OUT_OF_MEMORY;
+  }
+  ma_result result =
+      audio_device_open(ctx, &s->d_config, profile, &s->device);
   if (result != MA_SUCCESS) {
     fprintf(stderr, "capture: miniaudio device init error code(%d)\n", result);
-    free(s);
-    return NULL;
+    counters_destroy(&s->counters);
+    return result;
   }
   s->sizeInFrames = s->device.capture.internalPeriodSizeInFrames;
   printf("sizeInFrames = %d\n", s->sizeInFrames);
-  result = ma_pcm_rb_init(STD_FORMAT,                   // format
-                          1,                            // channels
-                          s->sizeInFrames * periodSize, // size in Frames
-                          NULL,                         // data to prepopulate
-                          NULL,                         // allocation callback
-                          &s->ring_buffer               // the ring buffer
+  s->buffer_frames = audio_us_to_frames((ma_uint64)profile->buffer_ms * 1000,
+                                        s->d_config.sampleRate);
+  if (s->buffer_frames < s->sizeInFrames) {
+    s->buffer_frames = s->sizeInFrames;
+  }
+  result = ma_pcm_rb_init(STD_FORMAT,       // format
+                          1,                // channels
+                          s->buffer_frames, // size in Frames
+                          NULL,             // data to prepopulate
+                          ctx->alloc,       // allocation callback
+                          &s->ring_buffer   // the ring buffer
   );
   if (result != MA_SUCCESS) {
     fprintf(stderr, "capture: miniaudio ring buffer init error code(%d)\n",
             result);
-    ma_device_uninit(&s->device);
-    free(s);
-    return NULL;
+    audio_device_uninit(ctx, &s->device);
+    counters_destroy(&s->counters);
+    return result;
   }
   ma_pcm_rb_set_sample_rate(&s->ring_buffer, s->d_config.sampleRate);
+  // a period can be committed in two pieces where the ring wraps around.
+  const size_t periods =
+      2 * ((size_t)s->buffer_frames / s->sizeInFrames + 1);
+  result = ma_rb_init(periods * sizeof(struct capture_period), NULL,
+                      ctx->alloc, &s->periods);
+  if (result != MA_SUCCESS) {
+    fprintf(stderr, "capture: period queue init error code(%d)\n", result);
+    ma_pcm_rb_uninit(&s->ring_buffer);
+    audio_device_uninit(ctx, &s->device);
+    counters_destroy(&s->counters);
+    return result;
+  }
+  return MA_SUCCESS;
+}
+
+struct capture_t *capture_create(struct audio_context_t *ctx,
+                                 const struct audio_device_profile_t *profile) {
+  if (ctx == NULL) {
+    return NULL;
+  }
+  const struct audio_device_profile_t fallback = audio_device_profile_default();
+  if (profile == NULL) {
+    profile = &fallback;
+  }
+  struct capture_t *s = ma_malloc(sizeof(struct capture_t), ctx->alloc);
+  if (s == NULL) {
+    return NULL;
+  }
+  s->source = NULL;
+  s->source_buffer = NULL;
+  s->source_frames = 0;
+  if (capture_init(s, ctx, profile) != MA_SUCCESS) {
+    ma_free(s, ctx->alloc);
+    return NULL;
+  }
+  return s;
+}
+
+struct capture_t *
+capture_create_headless(struct audio_context_t *ctx,
+                        const struct audio_device_profile_t *profile,
+                        const char *path) {
+  if (!audio_context_is_headless(ctx)) {
+    fprintf(stderr, "capture: headless capture needs a headless context\n");
+    return NULL;
+  }
+  const struct audio_device_profile_t fallback = audio_device_profile_default();
+  if (profile == NULL) {
+    profile = &fallback;
+  }
+  struct capture_t *s = ma_malloc(sizeof(struct capture_t), ctx->alloc);
+  if (s == NULL) {
+    return NULL;
+  }
+  s->source = NULL;
+  s->source_buffer = NULL;
+  s->source_frames = 0;
+  ma_result result = MA_SUCCESS;
+  if (path != NULL) {
+    ma_decoder_config config = ma_decoder_config_init(STD_FORMAT, 1, 44100);
+    result = ma_decoder_init_file(path, &config, &s->decoder);
+    if (result != MA_SUCCESS) {
+      fprintf(stderr, "capture: failed to open %s error code(%d)\n", path,
+              result);
+      ma_free(s, ctx->alloc);
+      return NULL;
+    }
+    ma_data_source_set_looping(&s->decoder, MA_TRUE);
+    s->source = &s->decoder;
+  } else {
+    ma_waveform_config config =
+        ma_waveform_config_init(STD_FORMAT, 1, 44100, ma_waveform_type_sine,
+                                HEADLESS_SINE_AMPLITUDE,
+                                HEADLESS_SINE_FREQUENCY);
+    result = ma_waveform_init(&config, &s->waveform);
+    if (result != MA_SUCCESS) {
+      fprintf(stderr, "capture: waveform init error code(%d)\n", result);
+      ma_free(s, ctx->alloc);
+      return NULL;
+    }
+    s->source = &s->waveform;
+  }
+  result = capture_init(s, ctx, profile);
+  if (result != MA_SUCCESS) {
+    ma_data_source_uninit(s->source);
+    ma_free(s, ctx->alloc);
+    return NULL;
+  }
+  s->source_frames = s->sizeInFrames;
+  s->source_buffer = ma_malloc(
+      s->source_frames * ma_get_bytes_per_frame(STD_FORMAT, 1), ctx->alloc);
+  if (s->source_buffer == NULL) {
+    capture_destroy(&s);
+    return NULL;
+  }
   return s;
 }
 
@@ -144,9 +695,16 @@ void capture_destroy(struct capture_t **s) {
   if ((*s) == NULL) {
     return;
   }
-  ma_device_uninit(&(*s)->device);
+  audio_device_uninit((*s)->ctx, &(*s)->device);
   ma_pcm_rb_uninit(&(*s)->ring_buffer);
-  free(*s);
+  ma_rb_uninit(&(*s)->periods);
+  counters_destroy(&(*s)->counters);
+  if ((*s)->source != NULL) {
+    ma_data_source_uninit((*s)->source);
+  }
+  const ma_allocation_callbacks *alloc = (*s)->ctx->alloc;
+  ma_free((*s)->source_buffer, alloc);
+  ma_free(*s, alloc);
   *s = NULL;
 }
 
@@ -157,6 +715,31 @@ ma_result capture_start(struct capture_t *s) {
   return ma_device_start(&s->device);
 }
 
+/**
+ * Hand out the pending comfort noise descriptor, if there is one.
+ */
+static ma_result capture_next_comfort_noise(struct capture_t *s,
+                                            struct capture_data_t **cd) {
+  if (atomic_load_explicit(&s->cn_ready, memory_order_acquire) == 0) {
+    return MA_NO_DATA_AVAILABLE;
+  }
+  struct capture_data_t *local_cd = capture_data_create(CN_DESCRIPTOR_SIZE);
+  if (local_cd == NULL) {
+    return MA_NO_ADDRESS;
+  }
+  cn_descriptor_marshal(&s->cn_pending, local_cd->buffer);
+  local_cd->kind = CAPTURE_DATA_COMFORT_NOISE;
+  local_cd->channels = s->device.capture.channels;
+  local_cd->format = s->device.capture.format;
+  local_cd->sampleRate = s->device.sampleRate;
+  local_cd->buffer_len = CN_DESCRIPTOR_SIZE;
+  local_cd->level = s->cn_pending.level;
+  local_cd->voice_active = MA_FALSE;
+  atomic_store_explicit(&s->cn_ready, 0, memory_order_release);
+  *cd = local_cd;
+  return MA_SUCCESS;
+}
+
 ma_result capture_next_available(struct capture_t *s,
                                  struct capture_data_t **cd) {
   ma_uint32 sizeInFrames = s->sizeInFrames;
@@ -168,27 +751,55 @@ ma_result capture_next_available(struct capture_t *s,
   }
   if (sizeInFrames == 0) {
     (void)ma_pcm_rb_commit_read(&s->ring_buffer, 0);
-    return MA_NO_DATA_AVAILABLE;
+    return capture_next_comfort_noise(s, cd);
   }
+  const ma_uint64 now_ns = trace_now_ns();
+  const ma_uint64 commit_ns =
+      atomic_load_explicit(&s->commit_ns, memory_order_relaxed);
+  // frames committed after these ones were captured that much later.
+  const ma_uint32 newer_frames =
+      ma_pcm_rb_available_read(&s->ring_buffer) - sizeInFrames;
+  const ma_uint64 newer_ns =
+      ((ma_uint64)newer_frames * 1000000000ull) / s->device.sampleRate;
   size_t len =
       (sizeInFrames * ma_get_bytes_per_frame(s->device.capture.format,
                                              s->device.capture.channels));
   struct capture_data_t *local_cd = capture_data_create(len);
-  local_cd->sizeInFrames = sizeInFrames;
-  if (local_cd->buffer == NULL) {
+  if (local_cd == NULL || local_cd->buffer == NULL) {
     capture_data_destroy(&local_cd);
-    (void)ma_pcm_rb_commit_read(&s->ring_buffer, local_cd->sizeInFrames);
+    // the frames are dropped, so is their level.
+    (void)capture_pop_periods(s, sizeInFrames);
+    (void)ma_pcm_rb_commit_read(&s->ring_buffer, sizeInFrames);
     return MA_NO_ADDRESS;
   }
+  local_cd->sizeInFrames = sizeInFrames;
   ma_copy_pcm_frames(local_cd->buffer, out_buffer, sizeInFrames,
                      s->device.capture.format, s->device.capture.channels);
   local_cd->channels = s->device.capture.channels;
   local_cd->format = s->device.capture.format;
+  local_cd->sampleRate = s->device.sampleRate;
   local_cd->buffer_len = len;
+  const ma_uint32 level_info = capture_pop_periods(s, sizeInFrames);
+  local_cd->level = (ma_uint8)(level_info & ~CAPTURE_LEVEL_VAD_BIT);
+  local_cd->voice_active = (level_info & CAPTURE_LEVEL_VAD_BIT) != 0;
+  if (commit_ns > newer_ns) {
+    local_cd->capture_ns = commit_ns - newer_ns;
+    local_cd->stage_ns = now_ns;
+    trace_record(TRACE_CAPTURE_READ, local_cd->capture_ns, now_ns);
+  }
   *cd = local_cd;
   return ma_pcm_rb_commit_read(&s->ring_buffer, local_cd->sizeInFrames);
 }
 
+void capture_get_device_info(struct capture_t *s,
+                             struct audio_device_info_t *out) {
+  audio_device_describe(&s->device, s->buffer_frames, out);
+}
+
+void capture_get_counters(struct capture_t *s, struct audio_counters_t *out) {
+  counters_snapshot(s->counters, out);
+}
+
 /***********************************************************************************
  *
  *
@@ -200,57 +811,48 @@ ma_result capture_next_available(struct capture_t *s,
  * *********************************************************************************
  */
 
-static void playback_data_callback(ma_device *pDevice, void *pOutput,
-                                   const void *pInput, ma_uint32 frameCount) {
-  (void)pInput;
-  (void)frameCount;
-  struct playback_t *p = (struct playback_t *)pDevice->pUserData;
+static void playback_process(struct playback_t *p, ma_device *pDevice,
+                             void *pOutput, ma_uint32 frameCount) {
   // important to only use framecount of playback as our cap
   // other values resulted in segmentation faults
-  ma_uint32 frames = frameCount;
-  void *buffer = NULL;
-  ma_result result = ma_pcm_rb_acquire_read(&p->ring_buffer, &frames, &buffer);
-  if (result != MA_SUCCESS || buffer == NULL) {
-    fprintf(stderr,
-            "failed to acquire read for ring buffer -- error code(%d).\n",
-            result);
-    return;
-  }
-  const size_t data_len =
-      frames * ma_get_bytes_per_frame(pDevice->playback.format,
-                                      pDevice->playback.channels);
-  if (data_len == 0) {
-    (void)ma_pcm_rb_commit_read(&p->ring_buffer, frames);
-    return;
-  }
-  void *raw_data = malloc(data_len);
-  if (raw_data == NULL) {
-    fprintf(stderr, "ran out of memory.\n");
-    return;
+  const ma_uint32 streams = mixer_read(p->mixer, (float *)pOutput, frameCount);
+  atomic_fetch_add_explicit(&p->frames_played, frameCount,
+                            memory_order_relaxed);
+  if (p->has_encoder) {
+    ma_encoder_write_pcm_frames(&p->encoder, pOutput, frameCount, NULL);
   }
-  memcpy(raw_data, buffer, data_len);
-  result = ma_pcm_rb_commit_read(&p->ring_buffer, frames);
-  if (result != MA_SUCCESS) {
-    fprintf(stderr,
-            "failed to commit read for ring buffer -- error code(%d).\n",
-            result);
-    free(raw_data);
+  if (streams == 0) {
     return;
   }
   // convert to decimals
   // https://en.wikipedia.org/wiki/DBFS
   const double dBFS = audio_get_decibels(
-      raw_data, frames, pDevice->playback.format, pDevice->playback.channels);
-  // decibels must be certain level before we process it
-  printf("dBFS = %f\n", dBFS);
-  ma_copy_pcm_frames(pOutput, raw_data, frames, pDevice->playback.format,
-                     pDevice->playback.channels);
-  free(raw_data);
+      pOutput, frameCount, pDevice->playback.format, pDevice->playback.channels);
+  printf("dBFS = %f, streams = %u\n", dBFS, streams);
+}
+
+static void playback_data_callback(ma_device *pDevice, void *pOutput,
+                                   const void *pInput, ma_uint32 frameCount) {
+  (void)pInput;
+  struct playback_t *p = (struct playback_t *)pDevice->pUserData;
+  SPAN_THREAD("playback callback");
+  SPAN_BEGIN("playback_data_callback");
+  const ma_uint64 start_ns = trace_now_ns();
+  playback_process(p, pDevice, pOutput, frameCount);
+  SPAN_END("playback_data_callback");
+  audio_callback_deadline(p->counters, DEADLINE_PLAYBACK, start_ns,
+                          frameCount, pDevice->sampleRate);
 }
 
-struct playback_t *playback_create(ma_uint32 periodSize) {
-  struct playback_t *p = malloc(sizeof(struct playback_t));
-  p->periodSize = periodSize;
+/**
+ * Shared setup of playback_create and playback_create_headless.
+ * On error everything this function set up is torn down again.
+ */
+static ma_result playback_init(struct playback_t *p,
+                               struct audio_context_t *ctx,
+                               const struct audio_device_profile_t *profile) {
+  p->ctx = ctx;
+  atomic_init(&p->frames_played, 0);
   p->d_config = ma_device_config_init(ma_device_type_playback);
   p->d_config.playback.pDeviceID = NULL;
   p->d_config.playback.format = STD_FORMAT;
@@ -258,29 +860,96 @@ struct playback_t *playback_create(ma_uint32 periodSize) {
   p->d_config.sampleRate = 44100;
   p->d_config.dataCallback = playback_data_callback;
   p->d_config.pUserData = p;
-  ma_result result = ma_device_init(NULL, &p->d_config, &p->device);
+  p->counters = counters_create();
+  if (p->counters == NULL) {
+    return MA_OUT_OF_MEMORY;
+  }
+  ma_result result =
+      audio_device_open(ctx, &p->d_config, profile, &p->device);
   if (result != MA_SUCCESS) {
     fprintf(stderr, "playback: miniaudio device init error code(%d)\n", result);
-    free(p);
-    return NULL;
+    counters_destroy(&p->counters);
+    return result;
   }
   p->sizeInFrames = p->device.playback.internalPeriodSizeInFrames;
   printf("sizeInFrames = %d\n", p->sizeInFrames);
-  result = ma_pcm_rb_init(STD_FORMAT,                   // format
-                          1,                            // channels
-                          p->sizeInFrames * periodSize, // size in Frames
-                          NULL,                         // data to prepopulate
-                          NULL,                         // allocation callback
-                          &p->ring_buffer               // the ring buffer
-  );
+  p->buffer_frames = audio_us_to_frames((ma_uint64)profile->buffer_ms * 1000,
+                                        p->device.sampleRate);
+  if (p->buffer_frames < p->sizeInFrames * PLAYBACK_PREBUFFER_PERIODS) {
+    p->buffer_frames = p->sizeInFrames * PLAYBACK_PREBUFFER_PERIODS;
+  }
+  p->mixer = mixer_create(p->device.playback.channels,
+                          p->device.sampleRate,
+                          p->buffer_frames,
+                          p->sizeInFrames * PLAYBACK_PREBUFFER_PERIODS,
+                          p->counters, ctx->alloc);
+  if (p->mixer == NULL) {
+    fprintf(stderr, "playback: mixer init failed\n");
+    audio_device_uninit(ctx, &p->device);
+    counters_destroy(&p->counters);
+    return MA_OUT_OF_MEMORY;
+  }
+  return MA_SUCCESS;
+}
+
+struct playback_t *
+playback_create(struct audio_context_t *ctx,
+                const struct audio_device_profile_t *profile) {
+  if (ctx == NULL) {
+    return NULL;
+  }
+  const struct audio_device_profile_t fallback = audio_device_profile_default();
+  if (profile == NULL) {
+    profile = &fallback;
+  }
+  struct playback_t *p = ma_malloc(sizeof(struct playback_t), ctx->alloc);
+  if (p == NULL) {
+    return NULL;
+  }
+  p->has_encoder = false;
+  if (playback_init(p, ctx, profile) != MA_SUCCESS) {
+    ma_free(p, ctx->alloc);
+    return NULL;
+  }
+  return p;
+}
+
+struct playback_t *
+playback_create_headless(struct audio_context_t *ctx,
+                         const struct audio_device_profile_t *profile,
+                         const char *path) {
+  if (!audio_context_is_headless(ctx)) {
+    fprintf(stderr, "playback: headless playback needs a headless context\n");
+    return NULL;
+  }
+  const struct audio_device_profile_t fallback = audio_device_profile_default();
+  if (profile == NULL) {
+    profile = &fallback;
+  }
+  struct playback_t *p = ma_malloc(sizeof(struct playback_t), ctx->alloc);
+  if (p == NULL) {
+    return NULL;
+  }
+  p->has_encoder = false;
+  ma_result result = playback_init(p, ctx, profile);
   if (result != MA_SUCCESS) {
-    fprintf(stderr, "playback: miniaudio ring buffer init error code(%d)\n",
-            result);
-    ma_device_uninit(&p->device);
-    free(p);
+    ma_free(p, ctx->alloc);
     return NULL;
   }
-  ma_pcm_rb_set_sample_rate(&p->ring_buffer, p->d_config.sampleRate);
+  if (path != NULL) {
+    ma_encoder_config config =
+        ma_encoder_config_init(ma_encoding_format_wav, STD_FORMAT,
+                               p->device.playback.channels,
+                               p->device.sampleRate);
+    result = ma_encoder_init_file(path, &config, &p->encoder);
+    if (result != MA_SUCCESS) {
+      fprintf(stderr, "playback: failed to open %s error code(%d)\n", path,
+              result);
+      playback_destroy(&p);
+      return NULL;
+    }
+    p->has_encoder = true;
+  }
   return p;
 }
 
@@ -297,9 +966,13 @@ void playback_destroy(struct playback_t **s) {
   if ((*s) == NULL) {
     return;
   }
-  ma_device_uninit(&(*s)->device);
-  ma_pcm_rb_uninit(&(*s)->ring_buffer);
-  free(*s);
+  audio_device_uninit((*s)->ctx, &(*s)->device);
+  mixer_destroy(&(*s)->mixer);
+  counters_destroy(&(*s)->counters);
+  if ((*s)->has_encoder) {
+    ma_encoder_uninit(&(*s)->encoder);
+  }
+  ma_free(*s, (*s)->ctx->alloc);
   *s = NULL;
 }
 
@@ -322,32 +995,84 @@ ma_result playback_start(struct playback_t *s) {
  */
 ma_result playback_queue(struct playback_t *s,
                          const struct capture_data_t *cd) {
-  ma_uint32 frames = cd->sizeInFrames;
-  ma_uint32 framesWritten = 0;
-  while (framesWritten < cd->sizeInFrames) {
-    void *buffer = NULL;
-    ma_result result =
-        ma_pcm_rb_acquire_write(&s->ring_buffer, &frames, &buffer);
-    if (result != MA_SUCCESS) {
-      fprintf(stderr,
-              "failed to acquire write for ring buffer -- error code(%d).\n",
-              result);
-      return result;
-    }
-    if (frames == 0) {
-      break;
-    }
-    const float *data_offset = ma_offset_pcm_frames_const_ptr_f32(
-        (const float *)cd->buffer, framesWritten, s->device.playback.channels);
-    ma_copy_pcm_frames(buffer, data_offset, frames, cd->format, cd->channels);
-    result = ma_pcm_rb_commit_write(&s->ring_buffer, frames);
-    if (result != MA_SUCCESS) {
-      fprintf(stderr,
-              "failed to commit write for ring buffer -- error code(%d).\n",
-              result);
-      return result;
-    }
-    framesWritten += frames;
+  ma_result result = mixer_queue(s->mixer, cd);
+  if (result != MA_SUCCESS) {
+    fprintf(stderr, "failed to queue stream(%u) -- error code(%d).\n",
+            cd->stream_id, result);
+  }
+  return result;
+}
+
+/**
+ * Set the playback gain of a single sender.
+ *
+ * @param s Audio Playback structure.
+ * @param stream_id The stream to adjust.
+ * @param gain The linear gain, 1.0 is unity.
+ * @return ma_result enum.
+ */
+ma_result playback_set_stream_gain(struct playback_t *s, ma_uint32 stream_id,
+                                   float gain) {
+  return mixer_set_gain(s->mixer, stream_id, gain);
+}
+
+/**
+ * Turn clock drift compensation on or off.
+ *
+ * @param s Audio Playback structure.
+ * @param enabled If senders are resampled to follow their clock.
+ */
+void playback_set_drift_compensation(struct playback_t *s, bool enabled) {
+  mixer_set_drift_compensation(s->mixer, enabled);
+}
+
+/**
+ * Get the playout delay of a single sender.
+ *
+ * @param s Audio Playback structure.
+ * @param stream_id The stream to check.
+ * @param delayMs Populated with the buffered audio in milliseconds.
+ * @return ma_result enum.
+ */
+ma_result playback_stream_delay(struct playback_t *s, ma_uint32 stream_id,
+                                ma_uint32 *delayMs) {
+  ma_uint32 frames = 0;
+  ma_result result = mixer_buffered_frames(s->mixer, stream_id, &frames);
+  if (result != MA_SUCCESS) {
+    return result;
   }
+  *delayMs = (ma_uint32)(((ma_uint64)frames * 1000) / s->device.sampleRate);
   return MA_SUCCESS;
 }
+
+/**
+ * Get the number of frames the playback device consumed so far.
+ *
+ * @param s Audio Playback structure.
+ * @return The number of frames.
+ */
+ma_uint64 playback_frames_played(struct playback_t *s) {
+  return atomic_load_explicit(&s->frames_played, memory_order_relaxed);
+}
+
+/**
+ * Get what the backend opened the playback device with, which may differ
+ * from what the profile asked for.
+ *
+ * @param s Audio Playback structure.
+ * @param out The device info to populate.
+ */
+void playback_get_device_info(struct playback_t *s,
+                              struct audio_device_info_t *out) {
+  audio_device_describe(&s->device, s->buffer_frames, out);
+}
+
+/**
+ * Read the runtime counters of the audio playback.
+ *
+ * @param s Audio Playback structure.
+ * @param out The snapshot to populate.
+ */
+void playback_get_counters(struct playback_t *s, struct audio_counters_t *out) {
+  counters_snapshot(s->counters, out);
+}
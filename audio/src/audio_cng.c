@@ -0,0 +1,180 @@
+#include "audio_cng.h"
+#include "audio_utils.h"
+
+#include <math.h>
+#include <string.h>
+
+/**
+ * Weight of the newest period in the smoothed noise estimate.
+ */
+#define CN_SMOOTHING 0.25
+/**
+ * Scale used to quantize reflection coefficients into a signed byte.
+ * Quantized values are clamped under it so the synthesis filter stays stable.
+ */
+#define CN_REFLECTION_SCALE 127.0
+#define CN_REFLECTION_MAX 126
+
+void cn_analyzer_init(struct cn_analyzer *an) {
+  memset(an, 0, sizeof(struct cn_analyzer));
+}
+
+void cn_analyzer_update(struct cn_analyzer *an, const float *input,
+                        ma_uint32 frameCount, ma_uint32 channels) {
+  if (input == NULL || frameCount <= CN_ORDER || channels == 0) {
+    return;
+  }
+  double autocorr[CN_ORDER + 1];
+  for (size_t lag = 0; lag <= CN_ORDER; ++lag) {
+    double sum = 0;
+    for (size_t i = lag; i < frameCount; ++i) {
+      sum += (double)input[i * channels] * (double)input[(i - lag) * channels];
+    }
+    autocorr[lag] = sum / (double)frameCount;
+  }
+  if (!an->has_data) {
+    memcpy(an->autocorr, autocorr, sizeof(autocorr));
+    an->has_data = true;
+    return;
+  }
+  for (size_t lag = 0; lag <= CN_ORDER; ++lag) {
+    an->autocorr[lag] += CN_SMOOTHING * (autocorr[lag] - an->autocorr[lag]);
+  }
+}
+
+/**
+ * Levinson-Durbin recursion, turns autocorrelation into reflection
+ * coefficients.
+ */
+static void cn_levinson(const double *autocorr, double *reflection) {
+  double lpc[CN_ORDER + 1] = {1.0};
+  double prev[CN_ORDER + 1];
+  // slight white noise correction keeps the recursion well conditioned.
+  double error = autocorr[0] * 1.0001;
+  for (size_t i = 1; i <= CN_ORDER; ++i) {
+    reflection[i - 1] = 0.0;
+  }
+  for (size_t i = 1; i <= CN_ORDER; ++i) {
+    if (error <= 0.0) {
+      return;
+    }
+    double acc = autocorr[i];
+    for (size_t j = 1; j < i; ++j) {
+      acc += lpc[j] * autocorr[i - j];
+    }
+    const double k = -acc / error;
+    memcpy(prev, lpc, sizeof(lpc));
+    for (size_t j = 1; j < i; ++j) {
+      lpc[j] = prev[j] + k * prev[i - j];
+    }
+    lpc[i] = k;
+    error *= (1.0 - k * k);
+    reflection[i - 1] = k;
+  }
+}
+
+void cn_analyzer_descriptor(const struct cn_analyzer *an,
+                            struct cn_descriptor *out) {
+  memset(out, 0, sizeof(struct cn_descriptor));
+  out->level = AUDIO_LEVEL_SILENCE;
+  if (!an->has_data || an->autocorr[0] <= 1e-12) {
+    return;
+  }
+  // autocorr[0] is the mean power, so 10 * log10 gives dBFS.
+  out->level = audio_level_quantize(10.0 * log10(an->autocorr[0]));
+  double reflection[CN_ORDER];
+  cn_levinson(an->autocorr, reflection);
+  for (size_t i = 0; i < CN_ORDER; ++i) {
+    long q = lround(reflection[i] * CN_REFLECTION_SCALE);
+    if (q > CN_REFLECTION_MAX) {
+      q = CN_REFLECTION_MAX;
+    } else if (q < -CN_REFLECTION_MAX) {
+      q = -CN_REFLECTION_MAX;
+    }
+    out->reflection[i] = (ma_int8)q;
+  }
+}
+
+void cn_descriptor_marshal(const struct cn_descriptor *desc, void *buffer) {
+  ma_uint8 *raw = (ma_uint8 *)buffer;
+  raw[0] = desc->level;
+  for (size_t i = 0; i < CN_ORDER; ++i) {
+    raw[i + 1] = (ma_uint8)desc->reflection[i];
+  }
+}
+
+ma_result cn_descriptor_unmarshal(const void *buffer, size_t len,
+                                  struct cn_descriptor *desc) {
+  if (buffer == NULL || len < CN_DESCRIPTOR_SIZE) {
+    return MA_INVALID_ARGS;
+  }
+  const ma_uint8 *raw = (const ma_uint8 *)buffer;
+  desc->level = raw[0];
+  for (size_t i = 0; i < CN_ORDER; ++i) {
+    desc->reflection[i] = (ma_int8)raw[i + 1];
+  }
+  return MA_SUCCESS;
+}
+
+void cn_generator_init(struct cn_generator *gen, ma_uint32 seed) {
+  memset(gen, 0, sizeof(struct cn_generator));
+  gen->seed = seed == 0 ? 0x9E3779B9u : seed;
+}
+
+void cn_generator_update(struct cn_generator *gen,
+                         const struct cn_descriptor *desc) {
+  if (desc->level >= AUDIO_LEVEL_SILENCE) {
+    gen->excitation = 0.0f;
+    return;
+  }
+  // step-up recursion, turns reflection coefficients into the direct form.
+  double lpc[CN_ORDER + 1] = {1.0};
+  double prev[CN_ORDER + 1];
+  const double power = pow(10.0, audio_level_to_decibels(desc->level) / 10.0);
+  double residual = power;
+  for (size_t i = 1; i <= CN_ORDER; ++i) {
+    const double k = (double)desc->reflection[i - 1] / CN_REFLECTION_SCALE;
+    memcpy(prev, lpc, sizeof(lpc));
+    for (size_t j = 1; j < i; ++j) {
+      lpc[j] = prev[j] + k * prev[i - j];
+    }
+    lpc[i] = k;
+    residual *= (1.0 - k * k);
+  }
+  for (size_t i = 0; i < CN_ORDER; ++i) {
+    gen->lpc[i] = (float)lpc[i + 1];
+  }
+  // uniform noise in [-1, 1] has a variance of 1/3.
+  gen->excitation = (float)sqrt(3.0 * residual);
+}
+
+/**
+ * xorshift32, uniform noise in [-1, 1].
+ */
+static inline float cn_noise(ma_uint32 *seed) {
+  ma_uint32 x = *seed;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *seed = x;
+  return ((float)x / 4294967295.0f) * 2.0f - 1.0f;
+}
+
+void cn_generator_mix(struct cn_generator *gen, float *out,
+                      ma_uint32 frameCount, ma_uint32 channels, float gain) {
+  if (gen->excitation == 0.0f) {
+    return;
+  }
+  for (ma_uint32 frame = 0; frame < frameCount; ++frame) {
+    float sample = gen->excitation * cn_noise(&gen->seed);
+    for (size_t j = 0; j < CN_ORDER; ++j) {
+      sample -= gen->lpc[j] * gen->history[j];
+    }
+    memmove(&gen->history[1], &gen->history[0],
+            sizeof(float) * (CN_ORDER - 1));
+    gen->history[0] = sample;
+    for (ma_uint32 channel = 0; channel < channels; ++channel) {
+      out[(size_t)frame * channels + channel] += sample * gain;
+    }
+  }
+}
@@ -0,0 +1,114 @@
+#include "audio_convert.h"
+#include "audio_types.h"
+#include "miniaudio.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+struct converter_t {
+  ma_format formatIn;
+  ma_format formatOut;
+  ma_uint32 channels;
+  ma_uint32 sampleRateIn;
+  ma_uint32 sampleRateOut;
+  ma_data_converter converter;
+};
+
+struct converter_t *converter_create(ma_format formatIn, ma_format formatOut,
+                                     ma_uint32 channels,
+                                     ma_uint32 sampleRateIn,
+                                     ma_uint32 sampleRateOut) {
+  struct converter_t *c = malloc(sizeof(struct converter_t));
+  if (c == NULL) {
+    return NULL;
+  }
+  c->formatIn = formatIn;
+  c->formatOut = formatOut;
+  c->channels = channels;
+  c->sampleRateIn = sampleRateIn;
+  c->sampleRateOut = sampleRateOut;
+  ma_data_converter_config config = ma_data_converter_config_init(
+      formatIn, formatOut, channels, channels, sampleRateIn, sampleRateOut);
+  ma_result result = ma_data_converter_init(&config, NULL, &c->converter);
+  if (result != MA_SUCCESS) {
+    fprintf(stderr, "converter: miniaudio init error code(%d)\n", result);
+    free(c);
+    return NULL;
+  }
+  return c;
+}
+
+void converter_destroy(struct converter_t **c) {
+  if (c == NULL) {
+    return;
+  }
+  if ((*c) == NULL) {
+    return;
+  }
+  ma_data_converter_uninit(&(*c)->converter, NULL);
+  free(*c);
+  *c = NULL;
+}
+
+bool converter_matches(const struct converter_t *c, ma_format formatIn,
+                       ma_format formatOut, ma_uint32 channels,
+                       ma_uint32 sampleRateIn, ma_uint32 sampleRateOut) {
+  if (c == NULL) {
+    return false;
+  }
+  return c->formatIn == formatIn && c->formatOut == formatOut &&
+         c->channels == channels && c->sampleRateIn == sampleRateIn &&
+         c->sampleRateOut == sampleRateOut;
+}
+
+ma_result converter_process(struct converter_t *c,
+                            const struct capture_data_t *in,
+                            struct capture_data_t **out) {
+  if (c == NULL || in == NULL || out == NULL || in->buffer == NULL) {
+    return MA_INVALID_ARGS;
+  }
+  if (in->kind != CAPTURE_DATA_AUDIO || in->format != c->formatIn ||
+      in->channels != c->channels) {
+    return MA_INVALID_ARGS;
+  }
+  if (!capture_data_frames_fit(in)) {
+    return MA_INVALID_ARGS;
+  }
+  ma_uint64 frameCountOut = 0;
+  ma_result result = ma_data_converter_get_expected_output_frame_count(
+      &c->converter, in->sizeInFrames, &frameCountOut);
+  if (result != MA_SUCCESS) {
+    return result;
+  }
+  // the resampler can carry a frame over between calls.
+  frameCountOut += 1;
+  const size_t len =
+      frameCountOut * ma_get_bytes_per_frame(c->formatOut, c->channels);
+  struct capture_data_t *local_cd = capture_data_create(len);
+  if (local_cd == NULL) {
+    return MA_OUT_OF_MEMORY;
+  }
+  ma_uint64 frameCountIn = in->sizeInFrames;
+  result = ma_data_converter_process_pcm_frames(
+      &c->converter, in->buffer, &frameCountIn, local_cd->buffer,
+      &frameCountOut);
+  if (result != MA_SUCCESS) {
+    capture_data_destroy(&local_cd);
+    return result;
+  }
+  local_cd->kind = in->kind;
+  local_cd->sizeInFrames = (ma_uint32)frameCountOut;
+  local_cd->format = c->formatOut;
+  local_cd->channels = c->channels;
+  local_cd->sampleRate = c->sampleRateOut;
+  local_cd->stream_id = in->stream_id;
+  local_cd->level = in->level;
+  local_cd->voice_active = in->voice_active;
+  local_cd->capture_ns = in->capture_ns;
+  local_cd->stage_ns = in->stage_ns;
+  local_cd->buffer_len =
+      frameCountOut * ma_get_bytes_per_frame(c->formatOut, c->channels);
+  *out = local_cd;
+  return MA_SUCCESS;
+}
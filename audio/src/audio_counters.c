@@ -0,0 +1,62 @@
+#include "audio_counters.h"
+#include "miniaudio.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct counters_t {
+  _Atomic ma_uint64 values[COUNTER_COUNT];
+};
+
+struct counters_t *counters_create(void) {
+  struct counters_t *c = malloc(sizeof(struct counters_t));
+  if (c == NULL) {
+    return NULL;
+  }
+  for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+    atomic_init(&c->values[i], 0);
+  }
+  return c;
+}
+
+void counters_destroy(struct counters_t **c) {
+  if (c == NULL) {
+    return;
+  }
+  if ((*c) == NULL) {
+    return;
+  }
+  free(*c);
+  *c = NULL;
+}
+
+void counters_add(struct counters_t *c, enum audio_counter counter,
+                  ma_uint64 value) {
+  if (c == NULL || counter >= COUNTER_COUNT || value == 0) {
+    return;
+  }
+  atomic_fetch_add_explicit(&c->values[counter], value, memory_order_relaxed);
+}
+
+static ma_uint64 counters_load(const struct counters_t *c,
+                               enum audio_counter counter) {
+  return atomic_load_explicit(&c->values[counter], memory_order_relaxed);
+}
+
+void counters_snapshot(const struct counters_t *c,
+                       struct audio_counters_t *out) {
+  memset(out, 0, sizeof(struct audio_counters_t));
+  if (c == NULL) {
+    return;
+  }
+  out->frames_captured = counters_load(c, COUNTER_FRAMES_CAPTURED);
+  out->frames_gated = counters_load(c, COUNTER_FRAMES_GATED);
+  out->frames_dropped_overflow =
+      counters_load(c, COUNTER_FRAMES_DROPPED_OVERFLOW);
+  out->frames_queued = counters_load(c, COUNTER_FRAMES_QUEUED);
+  out->frames_dropped_queue = counters_load(c, COUNTER_FRAMES_DROPPED_QUEUE);
+  out->underrun_periods = counters_load(c, COUNTER_UNDERRUN_PERIODS);
+  out->callback_overruns = counters_load(c, COUNTER_CALLBACK_OVERRUNS);
+  out->packets_malformed = counters_load(c, COUNTER_PACKETS_MALFORMED);
+}
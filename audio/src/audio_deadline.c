@@ -0,0 +1,225 @@
+#include "audio_deadline.h"
+
+#include <stdatomic.h>
+#include <string.h>
+
+/**
+ * Load is recorded in 1% buckets of the deadline up to 200%, everything
+ * slower lands in the last bucket.
+ */
+#define DEADLINE_MAX_PERCENT 200
+#define DEADLINE_BUCKETS (DEADLINE_MAX_PERCENT + 1)
+/* Load is kept in parts per million of the deadline when ranking. */
+#define DEADLINE_PPM 1000000ull
+
+struct deadline_histogram {
+  _Atomic ma_uint64 count;
+  _Atomic ma_uint64 misses;
+  _Atomic ma_uint64 buckets[DEADLINE_BUCKETS];
+  /* Guards worst, the callback only tries it and skips when busy. */
+  atomic_flag lock;
+  /* Load of the least bad entry in worst once it is full, in ppm.
+   * Lets the callback skip the lock for ordinary periods. */
+  _Atomic ma_uint64 floor_ppm;
+  ma_uint32 worst_count;
+  struct deadline_offender worst[DEADLINE_WORST_COUNT];
+};
+
+static _Atomic bool deadline_on = false;
+static struct deadline_histogram deadline_histograms[DEADLINE_CALLBACK_COUNT] =
+    {
+        {.lock = ATOMIC_FLAG_INIT},
+        {.lock = ATOMIC_FLAG_INIT},
+};
+
+static const char *deadline_callback_names[DEADLINE_CALLBACK_COUNT] = {
+    "capture",
+    "playback",
+};
+
+void deadline_set_enabled(bool enabled) {
+  atomic_store_explicit(&deadline_on, enabled, memory_order_relaxed);
+}
+
+bool deadline_enabled(void) {
+  return atomic_load_explicit(&deadline_on, memory_order_relaxed);
+}
+
+static ma_uint64 deadline_load_ppm(const struct deadline_offender *o) {
+  if (o->deadline_ns == 0) {
+    return 0;
+  }
+  return (o->duration_ns * DEADLINE_PPM) / o->deadline_ns;
+}
+
+/**
+ * Insert into the worst offenders, keeping them sorted worst first.
+ * Called with the lock held.
+ */
+static void deadline_insert_worst(struct deadline_histogram *h,
+                                  const struct deadline_offender *o,
+                                  ma_uint64 load_ppm) {
+  ma_uint32 i = h->worst_count;
+  if (i == DEADLINE_WORST_COUNT) {
+    if (load_ppm <= deadline_load_ppm(&h->worst[i - 1])) {
+      return;
+    }
+    --i;
+  } else {
+    ++h->worst_count;
+  }
+  while (i > 0 && deadline_load_ppm(&h->worst[i - 1]) < load_ppm) {
+    h->worst[i] = h->worst[i - 1];
+    --i;
+  }
+  h->worst[i] = *o;
+  if (h->worst_count == DEADLINE_WORST_COUNT) {
+    atomic_store_explicit(
+        &h->floor_ppm, deadline_load_ppm(&h->worst[DEADLINE_WORST_COUNT - 1]),
+        memory_order_relaxed);
+  }
+}
+
+void deadline_record(enum deadline_callback callback, ma_uint64 start_ns,
+                     ma_uint64 end_ns, ma_uint32 frames, ma_uint32 sampleRate) {
+  if (!deadline_enabled() || callback >= DEADLINE_CALLBACK_COUNT ||
+      sampleRate == 0 || frames == 0) {
+    return;
+  }
+  const struct deadline_offender o = {
+      .start_ns = start_ns,
+      .duration_ns = end_ns > start_ns ? end_ns - start_ns : 0,
+      .deadline_ns = ((ma_uint64)frames * 1000000000ull) / sampleRate,
+      .frames = frames,
+  };
+  const ma_uint64 load_ppm = deadline_load_ppm(&o);
+  ma_uint64 bucket = load_ppm / (DEADLINE_PPM / 100);
+  if (bucket > DEADLINE_MAX_PERCENT) {
+    bucket = DEADLINE_MAX_PERCENT;
+  }
+  struct deadline_histogram *h = &deadline_histograms[callback];
+  atomic_fetch_add_explicit(&h->buckets[bucket], 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+  if (o.duration_ns > o.deadline_ns) {
+    atomic_fetch_add_explicit(&h->misses, 1, memory_order_relaxed);
+  }
+  if (load_ppm <= atomic_load_explicit(&h->floor_ppm, memory_order_relaxed)) {
+    return;
+  }
+  // never wait in the callback, a reader holding the lock costs one sample.
+  if (atomic_flag_test_and_set_explicit(&h->lock, memory_order_acquire)) {
+    return;
+  }
+  deadline_insert_worst(h, &o, load_ppm);
+  atomic_flag_clear_explicit(&h->lock, memory_order_release);
+}
+
+double deadline_percentile(enum deadline_callback callback,
+                           double percentile) {
+  if (callback >= DEADLINE_CALLBACK_COUNT) {
+    return 0;
+  }
+  struct deadline_histogram *h = &deadline_histograms[callback];
+  const ma_uint64 count = atomic_load_explicit(&h->count, memory_order_relaxed);
+  if (count == 0) {
+    return 0;
+  }
+  ma_uint64 target = (ma_uint64)((percentile / 100.0) * (double)count);
+  if (target == 0) {
+    target = 1;
+  }
+  ma_uint64 seen = 0;
+  for (size_t i = 0; i < DEADLINE_BUCKETS; ++i) {
+    seen += atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+    if (seen >= target) {
+      // upper edge of the bucket, so a full bucket never under reports.
+      const size_t percent = i < DEADLINE_MAX_PERCENT ? i + 1 : i;
+      return (double)percent / 100.0;
+    }
+  }
+  return (double)DEADLINE_MAX_PERCENT / 100.0;
+}
+
+ma_uint64 deadline_count(enum deadline_callback callback) {
+  if (callback >= DEADLINE_CALLBACK_COUNT) {
+    return 0;
+  }
+  return atomic_load_explicit(&deadline_histograms[callback].count,
+                              memory_order_relaxed);
+}
+
+ma_uint64 deadline_misses(enum deadline_callback callback) {
+  if (callback >= DEADLINE_CALLBACK_COUNT) {
+    return 0;
+  }
+  return atomic_load_explicit(&deadline_histograms[callback].misses,
+                              memory_order_relaxed);
+}
+
+ma_uint32 deadline_worst(enum deadline_callback callback,
+                         struct deadline_offender *out) {
+  if (callback >= DEADLINE_CALLBACK_COUNT || out == NULL) {
+    return 0;
+  }
+  struct deadline_histogram *h = &deadline_histograms[callback];
+  while (atomic_flag_test_and_set_explicit(&h->lock, memory_order_acquire)) {
+  }
+  const ma_uint32 count = h->worst_count;
+  memcpy(out, h->worst, count * sizeof(struct deadline_offender));
+  atomic_flag_clear_explicit(&h->lock, memory_order_release);
+  return count;
+}
+
+const char *deadline_callback_name(enum deadline_callback callback) {
+  if (callback >= DEADLINE_CALLBACK_COUNT) {
+    return "unknown";
+  }
+  return deadline_callback_names[callback];
+}
+
+void deadline_print(FILE *out) {
+  if (out == NULL) {
+    out = stdout;
+  }
+  fprintf(out, "%-13s %10s %10s %7s %7s %7s %7s\n", "callback (%)", "count",
+          "misses", "p50", "p99", "p99.9", "max");
+  for (int callback = 0; callback < DEADLINE_CALLBACK_COUNT; ++callback) {
+    fprintf(out, "%-13s %10llu %10llu %7.0f %7.0f %7.0f %7.0f\n",
+            deadline_callback_name(callback),
+            (unsigned long long)deadline_count(callback),
+            (unsigned long long)deadline_misses(callback),
+            deadline_percentile(callback, 50.0) * 100.0,
+            deadline_percentile(callback, 99.0) * 100.0,
+            deadline_percentile(callback, 99.9) * 100.0,
+            deadline_percentile(callback, 100.0) * 100.0);
+  }
+  for (int callback = 0; callback < DEADLINE_CALLBACK_COUNT; ++callback) {
+    struct deadline_offender worst[DEADLINE_WORST_COUNT];
+    const ma_uint32 count = deadline_worst(callback, worst);
+    for (ma_uint32 i = 0; i < count; ++i) {
+      fprintf(out, "worst %-8s at %llu ns: %llu us of %llu us (%u frames)\n",
+              deadline_callback_name(callback),
+              (unsigned long long)worst[i].start_ns,
+              (unsigned long long)(worst[i].duration_ns / 1000),
+              (unsigned long long)(worst[i].deadline_ns / 1000),
+              worst[i].frames);
+    }
+  }
+  fflush(out);
+}
+
+void deadline_reset(void) {
+  for (int callback = 0; callback < DEADLINE_CALLBACK_COUNT; ++callback) {
+    struct deadline_histogram *h = &deadline_histograms[callback];
+    atomic_store_explicit(&h->count, 0, memory_order_relaxed);
+    atomic_store_explicit(&h->misses, 0, memory_order_relaxed);
+    for (size_t i = 0; i < DEADLINE_BUCKETS; ++i) {
+      atomic_store_explicit(&h->buckets[i], 0, memory_order_relaxed);
+    }
+    while (atomic_flag_test_and_set_explicit(&h->lock, memory_order_acquire)) {
+    }
+    h->worst_count = 0;
+    atomic_store_explicit(&h->floor_ppm, 0, memory_order_relaxed);
+    atomic_flag_clear_explicit(&h->lock, memory_order_release);
+  }
+}
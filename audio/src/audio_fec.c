@@ -0,0 +1,370 @@
+#include "audio_fec.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define FEC_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+/*
+ * GF(2^8) with the polynomial x^8 + x^4 + x^3 + x^2 + 1 (0x11d).
+ * The exp table is doubled so a sum of two logs never needs a modulo.
+ */
+static const ma_uint8 GF_EXP[512] = {
+    0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1d, 0x3a, 0x74, 0xe8,
+    0xcd, 0x87, 0x13, 0x26, 0x4c, 0x98, 0x2d, 0x5a, 0xb4, 0x75, 0xea, 0xc9,
+    0x8f, 0x03, 0x06, 0x0c, 0x18, 0x30, 0x60, 0xc0, 0x9d, 0x27, 0x4e, 0x9c,
+    0x25, 0x4a, 0x94, 0x35, 0x6a, 0xd4, 0xb5, 0x77, 0xee, 0xc1, 0x9f, 0x23,
+    0x46, 0x8c, 0x05, 0x0a, 0x14, 0x28, 0x50, 0xa0, 0x5d, 0xba, 0x69, 0xd2,
+    0xb9, 0x6f, 0xde, 0xa1, 0x5f, 0xbe, 0x61, 0xc2, 0x99, 0x2f, 0x5e, 0xbc,
+    0x65, 0xca, 0x89, 0x0f, 0x1e, 0x3c, 0x78, 0xf0, 0xfd, 0xe7, 0xd3, 0xbb,
+    0x6b, 0xd6, 0xb1, 0x7f, 0xfe, 0xe1, 0xdf, 0xa3, 0x5b, 0xb6, 0x71, 0xe2,
+    0xd9, 0xaf, 0x43, 0x86, 0x11, 0x22, 0x44, 0x88, 0x0d, 0x1a, 0x34, 0x68,
+    0xd0, 0xbd, 0x67, 0xce, 0x81, 0x1f, 0x3e, 0x7c, 0xf8, 0xed, 0xc7, 0x93,
+    0x3b, 0x76, 0xec, 0xc5, 0x97, 0x33, 0x66, 0xcc, 0x85, 0x17, 0x2e, 0x5c,
+    0xb8, 0x6d, 0xda, 0xa9, 0x4f, 0x9e, 0x21, 0x42, 0x84, 0x15, 0x2a, 0x54,
+    0xa8, 0x4d, 0x9a, 0x29, 0x52, 0xa4, 0x55, 0xaa, 0x49, 0x92, 0x39, 0x72,
+    0xe4, 0xd5, 0xb7, 0x73, 0xe6, 0xd1, 0xbf, 0x63, 0xc6, 0x91, 0x3f, 0x7e,
+    0xfc, 0xe5, 0xd7, 0xb3, 0x7b, 0xf6, 0xf1, 0xff, 0xe3, 0xdb, 0xab, 0x4b,
+    0x96, 0x31, 0x62, 0xc4, 0x95, 0x37, 0x6e, 0xdc, 0xa5, 0x57, 0xae, 0x41,
+    0x82, 0x19, 0x32, 0x64, 0xc8, 0x8d, 0x07, 0x0e, 0x1c, 0x38, 0x70, 0xe0,
+    0xdd, 0xa7, 0x53, 0xa6, 0x51, 0xa2, 0x59, 0xb2, 0x79, 0xf2, 0xf9, 0xef,
+    0xc3, 0x9b, 0x2b, 0x56, 0xac, 0x45, 0x8a, 0x09, 0x12, 0x24, 0x48, 0x90,
+    0x3d, 0x7a, 0xf4, 0xf5, 0xf7, 0xf3, 0xfb, 0xeb, 0xcb, 0x8b, 0x0b, 0x16,
+    0x2c, 0x58, 0xb0, 0x7d, 0xfa, 0xe9, 0xcf, 0x83, 0x1b, 0x36, 0x6c, 0xd8,
+    0xad, 0x47, 0x8e, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1d,
+    0x3a, 0x74, 0xe8, 0xcd, 0x87, 0x13, 0x26, 0x4c, 0x98, 0x2d, 0x5a, 0xb4,
+    0x75, 0xea, 0xc9, 0x8f, 0x03, 0x06, 0x0c, 0x18, 0x30, 0x60, 0xc0, 0x9d,
+    0x27, 0x4e, 0x9c, 0x25, 0x4a, 0x94, 0x35, 0x6a, 0xd4, 0xb5, 0x77, 0xee,
+    0xc1, 0x9f, 0x23, 0x46, 0x8c, 0x05, 0x0a, 0x14, 0x28, 0x50, 0xa0, 0x5d,
+    0xba, 0x69, 0xd2, 0xb9, 0x6f, 0xde, 0xa1, 0x5f, 0xbe, 0x61, 0xc2, 0x99,
+    0x2f, 0x5e, 0xbc, 0x65, 0xca, 0x89, 0x0f, 0x1e, 0x3c, 0x78, 0xf0, 0xfd,
+    0xe7, 0xd3, 0xbb, 0x6b, 0xd6, 0xb1, 0x7f, 0xfe, 0xe1, 0xdf, 0xa3, 0x5b,
+    0xb6, 0x71, 0xe2, 0xd9, 0xaf, 0x43, 0x86, 0x11, 0x22, 0x44, 0x88, 0x0d,
+    0x1a, 0x34, 0x68, 0xd0, 0xbd, 0x67, 0xce, 0x81, 0x1f, 0x3e, 0x7c, 0xf8,
+    0xed, 0xc7, 0x93, 0x3b, 0x76, 0xec, 0xc5, 0x97, 0x33, 0x66, 0xcc, 0x85,
+    0x17, 0x2e, 0x5c, 0xb8, 0x6d, 0xda, 0xa9, 0x4f, 0x9e, 0x21, 0x42, 0x84,
+    0x15, 0x2a, 0x54, 0xa8, 0x4d, 0x9a, 0x29, 0x52, 0xa4, 0x55, 0xaa, 0x49,
+    0x92, 0x39, 0x72, 0xe4, 0xd5, 0xb7, 0x73, 0xe6, 0xd1, 0xbf, 0x63, 0xc6,
+    0x91, 0x3f, 0x7e, 0xfc, 0xe5, 0xd7, 0xb3, 0x7b, 0xf6, 0xf1, 0xff, 0xe3,
+    0xdb, 0xab, 0x4b, 0x96, 0x31, 0x62, 0xc4, 0x95, 0x37, 0x6e, 0xdc, 0xa5,
+    0x57, 0xae, 0x41, 0x82, 0x19, 0x32, 0x64, 0xc8, 0x8d, 0x07, 0x0e, 0x1c,
+    0x38, 0x70, 0xe0, 0xdd, 0xa7, 0x53, 0xa6, 0x51, 0xa2, 0x59, 0xb2, 0x79,
+    0xf2, 0xf9, 0xef, 0xc3, 0x9b, 0x2b, 0x56, 0xac, 0x45, 0x8a, 0x09, 0x12,
+    0x24, 0x48, 0x90, 0x3d, 0x7a, 0xf4, 0xf5, 0xf7, 0xf3, 0xfb, 0xeb, 0xcb,
+    0x8b, 0x0b, 0x16, 0x2c, 0x58, 0xb0, 0x7d, 0xfa, 0xe9, 0xcf, 0x83, 0x1b,
+    0x36, 0x6c, 0xd8, 0xad, 0x47, 0x8e, 0x01, 0x02,
+};
+
+static const ma_uint8 GF_LOG[256] = {
+    0x00, 0x00, 0x01, 0x19, 0x02, 0x32, 0x1a, 0xc6, 0x03, 0xdf, 0x33, 0xee,
+    0x1b, 0x68, 0xc7, 0x4b, 0x04, 0x64, 0xe0, 0x0e, 0x34, 0x8d, 0xef, 0x81,
+    0x1c, 0xc1, 0x69, 0xf8, 0xc8, 0x08, 0x4c, 0x71, 0x05, 0x8a, 0x65, 0x2f,
+    0xe1, 0x24, 0x0f, 0x21, 0x35, 0x93, 0x8e, 0xda, 0xf0, 0x12, 0x82, 0x45,
+    0x1d, 0xb5, 0xc2, 0x7d, 0x6a, 0x27, 0xf9, 0xb9, 0xc9, 0x9a, 0x09, 0x78,
+    0x4d, 0xe4, 0x72, 0xa6, 0x06, 0xbf, 0x8b, 0x62, 0x66, 0xdd, 0x30, 0xfd,
+    0xe2, 0x98, 0x25, 0xb3, 0x10, 0x91, 0x22, 0x88, 0x36, 0xd0, 0x94, 0xce,
+    0x8f, 0x96, 0xdb, 0xbd, 0xf1, 0xd2, 0x13, 0x5c, 0x83, 0x38, 0x46, 0x40,
+    0x1e, 0x42, 0xb6, 0xa3, 0xc3, 0x48, 0x7e, 0x6e, 0x6b, 0x3a, 0x28, 0x54,
+    0xfa, 0x85, 0xba, 0x3d, 0xca, 0x5e, 0x9b, 0x9f, 0x0a, 0x15, 0x79, 0x2b,
+    0x4e, 0xd4, 0xe5, 0xac, 0x73, 0xf3, 0xa7, 0x57, 0x07, 0x70, 0xc0, 0xf7,
+    0x8c, 0x80, 0x63, 0x0d, 0x67, 0x4a, 0xde, 0xed, 0x31, 0xc5, 0xfe, 0x18,
+    0xe3, 0xa5, 0x99, 0x77, 0x26, 0xb8, 0xb4, 0x7c, 0x11, 0x44, 0x92, 0xd9,
+    0x23, 0x20, 0x89, 0x2e, 0x37, 0x3f, 0xd1, 0x5b, 0x95, 0xbc, 0xcf, 0xcd,
+    0x90, 0x87, 0x97, 0xb2, 0xdc, 0xfc, 0xbe, 0x61, 0xf2, 0x56, 0xd3, 0xab,
+    0x14, 0x2a, 0x5d, 0x9e, 0x84, 0x3c, 0x39, 0x53, 0x47, 0x6d, 0x41, 0xa2,
+    0x1f, 0x2d, 0x43, 0xd8, 0xb7, 0x7b, 0xa4, 0x76, 0xc4, 0x17, 0x49, 0xec,
+    0x7f, 0x0c, 0x6f, 0xf6, 0x6c, 0xa1, 0x3b, 0x52, 0x29, 0x9d, 0x55, 0xaa,
+    0xfb, 0x60, 0x86, 0xb1, 0xbb, 0xcc, 0x3e, 0x5a, 0xcb, 0x59, 0x5f, 0xb0,
+    0x9c, 0xa9, 0xa0, 0x51, 0x0b, 0xf5, 0x16, 0xeb, 0x7a, 0x75, 0x2c, 0xd7,
+    0x4f, 0xae, 0xd5, 0xe9, 0xe6, 0xe7, 0xad, 0xe8, 0x74, 0xd6, 0xf4, 0xea,
+    0xa8, 0x50, 0x58, 0xaf,
+};
+
+ma_uint8 fec_gf_mul(ma_uint8 a, ma_uint8 b) {
+  if (a == 0 || b == 0) {
+    return 0;
+  }
+  return GF_EXP[GF_LOG[a] + GF_LOG[b]];
+}
+
+ma_uint8 fec_gf_inv(ma_uint8 a) {
+  if (a == 0) {
+    return 0;
+  }
+  return GF_EXP[255 - GF_LOG[a]];
+}
+
+/**
+ * Build the nibble product tables of a constant.
+ * c * x == low[x & 0x0f] ^ high[x >> 4].
+ */
+static inline void fec_nibble_tables(ma_uint8 c, ma_uint8 *low,
+                                     ma_uint8 *high) {
+  for (ma_uint8 i = 0; i < 16; ++i) {
+    low[i] = fec_gf_mul(c, i);
+    high[i] = fec_gf_mul(c, (ma_uint8)(i << 4));
+  }
+}
+
+#if defined(FEC_X86)
+/**
+ * SIMD support of the CPU the library runs on, built without -mavx2 or
+ * -mssse3 the compiler only emits scalar code outside of the functions
+ * below.
+ */
+enum fec_simd {
+  FEC_SIMD_UNKNOWN = -1,
+  FEC_SIMD_NONE = 0,
+  FEC_SIMD_SSSE3 = 1,
+  FEC_SIMD_AVX2 = 2,
+};
+
+static _Atomic int g_fec_simd = FEC_SIMD_UNKNOWN;
+
+static enum fec_simd fec_detect_simd(void) {
+  unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSSE3)) {
+    return FEC_SIMD_NONE;
+  }
+  const unsigned int features = ecx;
+  // AVX2 also needs the OS to save the upper halves of the ymm registers.
+  if (!(features & bit_OSXSAVE) || !(features & bit_AVX)) {
+    return FEC_SIMD_SSSE3;
+  }
+  unsigned int xcr0 = 0, xcr0_high = 0;
+  __asm__ volatile("xgetbv" : "=a"(xcr0), "=d"(xcr0_high) : "c"(0));
+  if ((xcr0 & 0x6) != 0x6) {
+    return FEC_SIMD_SSSE3;
+  }
+  if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) || !(ebx & bit_AVX2)) {
+    return FEC_SIMD_SSSE3;
+  }
+  return FEC_SIMD_AVX2;
+}
+
+static enum fec_simd fec_simd_level(void) {
+  int simd = atomic_load_explicit(&g_fec_simd, memory_order_relaxed);
+  if (simd == FEC_SIMD_UNKNOWN) {
+    // racing threads all detect the same thing.
+    simd = fec_detect_simd();
+    atomic_store_explicit(&g_fec_simd, simd, memory_order_relaxed);
+  }
+  return (enum fec_simd)simd;
+}
+
+/**
+ * AVX2 part of fec_gf_mul_add, 32 bytes at a time.
+ *
+ * @return The number of bytes done.
+ */
+__attribute__((target("avx2"))) static size_t
+fec_gf_mul_add_avx2(ma_uint8 *dst, const ma_uint8 *src, const ma_uint8 *low,
+                    const ma_uint8 *high, size_t len) {
+  const __m256i low_table =
+      _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)low));
+  const __m256i high_table =
+      _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)high));
+  const __m256i mask = _mm256_set1_epi8(0x0f);
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    const __m256i in = _mm256_loadu_si256((const __m256i *)(src + i));
+    const __m256i lo = _mm256_and_si256(in, mask);
+    const __m256i hi = _mm256_and_si256(_mm256_srli_epi64(in, 4), mask);
+    const __m256i product = _mm256_xor_si256(_mm256_shuffle_epi8(low_table, lo),
+                                             _mm256_shuffle_epi8(high_table, hi));
+    const __m256i out = _mm256_loadu_si256((const __m256i *)(dst + i));
+    _mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(out, product));
+  }
+  return i;
+}
+
+/**
+ * SSSE3 part of fec_gf_mul_add, 16 bytes at a time.
+ *
+ * @return The number of bytes done.
+ */
+__attribute__((target("ssse3"))) static size_t
+fec_gf_mul_add_ssse3(ma_uint8 *dst, const ma_uint8 *src, const ma_uint8 *low,
+                     const ma_uint8 *high, size_t len) {
+  const __m128i low_table = _mm_loadu_si128((const __m128i *)low);
+  const __m128i high_table = _mm_loadu_si128((const __m128i *)high);
+  const __m128i mask = _mm_set1_epi8(0x0f);
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    const __m128i in = _mm_loadu_si128((const __m128i *)(src + i));
+    const __m128i lo = _mm_and_si128(in, mask);
+    const __m128i hi = _mm_and_si128(_mm_srli_epi64(in, 4), mask);
+    const __m128i product = _mm_xor_si128(_mm_shuffle_epi8(low_table, lo),
+                                          _mm_shuffle_epi8(high_table, hi));
+    const __m128i out = _mm_loadu_si128((const __m128i *)(dst + i));
+    _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(out, product));
+  }
+  return i;
+}
+#endif
+
+void fec_gf_mul_add(ma_uint8 *dst, const ma_uint8 *src, ma_uint8 c,
+                    size_t len) {
+  size_t i = 0;
+  if (c == 0) {
+    return;
+  }
+  if (c == 1) {
+    for (; i < len; ++i) {
+      dst[i] ^= src[i];
+    }
+    return;
+  }
+  ma_uint8 low[16];
+  ma_uint8 high[16];
+  fec_nibble_tables(c, low, high);
+#if defined(FEC_X86)
+  const enum fec_simd simd = fec_simd_level();
+  if (simd >= FEC_SIMD_AVX2) {
+    i += fec_gf_mul_add_avx2(dst, src, low, high, len);
+  }
+  if (simd >= FEC_SIMD_SSSE3) {
+    i += fec_gf_mul_add_ssse3(dst + i, src + i, low, high, len - i);
+  }
+#endif
+  for (; i < len; ++i) {
+    dst[i] ^= low[src[i] & 0x0f] ^ high[src[i] >> 4];
+  }
+}
+
+ma_uint8 fec_coefficient(ma_uint32 parity_index, ma_uint32 data_index) {
+  // Cauchy matrix 1 / (x_i + y_j) with x_i = i and y_j = MAX + j, with every
+  // column scaled by y_j so the first parity shard is a plain XOR.
+  const ma_uint8 y = (ma_uint8)(FEC_MAX_SHARDS + data_index);
+  const ma_uint8 x = (ma_uint8)parity_index;
+  return fec_gf_mul(fec_gf_inv(x ^ y), y);
+}
+
+ma_result fec_encode(const ma_uint8 *const *data, ma_uint32 k,
+                     ma_uint8 *const *parity, ma_uint32 m, size_t len) {
+  if (data == NULL || parity == NULL || k == 0 || k > FEC_MAX_SHARDS ||
+      m > FEC_MAX_SHARDS) {
+    return MA_INVALID_ARGS;
+  }
+  for (ma_uint32 p = 0; p < m; ++p) {
+    memset(parity[p], 0, len);
+    for (ma_uint32 d = 0; d < k; ++d) {
+      fec_gf_mul_add(parity[p], data[d], fec_coefficient(p, d), len);
+    }
+  }
+  return MA_SUCCESS;
+}
+
+/**
+ * Invert a square matrix in place with Gauss-Jordan elimination.
+ */
+static ma_result fec_invert(ma_uint8 *matrix, ma_uint32 n) {
+  ma_uint8 inverse[FEC_MAX_SHARDS * FEC_MAX_SHARDS];
+  memset(inverse, 0, (size_t)n * n);
+  for (ma_uint32 i = 0; i < n; ++i) {
+    inverse[i * n + i] = 1;
+  }
+  for (ma_uint32 col = 0; col < n; ++col) {
+    ma_uint32 pivot = col;
+    while (pivot < n && matrix[pivot * n + col] == 0) {
+      pivot++;
+    }
+    if (pivot == n) {
+      return MA_INVALID_DATA;
+    }
+    if (pivot != col) {
+      for (ma_uint32 j = 0; j < n; ++j) {
+        ma_uint8 tmp = matrix[col * n + j];
+        matrix[col * n + j] = matrix[pivot * n + j];
+        matrix[pivot * n + j] = tmp;
+        tmp = inverse[col * n + j];
+        inverse[col * n + j] = inverse[pivot * n + j];
+        inverse[pivot * n + j] = tmp;
+      }
+    }
+    const ma_uint8 scale = fec_gf_inv(matrix[col * n + col]);
+    for (ma_uint32 j = 0; j < n; ++j) {
+      matrix[col * n + j] = fec_gf_mul(matrix[col * n + j], scale);
+      inverse[col * n + j] = fec_gf_mul(inverse[col * n + j], scale);
+    }
+    for (ma_uint32 row = 0; row < n; ++row) {
+      const ma_uint8 factor = matrix[row * n + col];
+      if (row == col || factor == 0) {
+        continue;
+      }
+      for (ma_uint32 j = 0; j < n; ++j) {
+        matrix[row * n + j] ^= fec_gf_mul(factor, matrix[col * n + j]);
+        inverse[row * n + j] ^= fec_gf_mul(factor, inverse[col * n + j]);
+      }
+    }
+  }
+  memcpy(matrix, inverse, (size_t)n * n);
+  return MA_SUCCESS;
+}
+
+ma_result fec_decode(ma_uint8 *const *shards, const ma_bool8 *present,
+                     ma_uint32 k, ma_uint32 m, size_t len) {
+  if (shards == NULL || present == NULL || k == 0 || k > FEC_MAX_SHARDS ||
+      m > FEC_MAX_SHARDS) {
+    return MA_INVALID_ARGS;
+  }
+  ma_uint32 missing[FEC_MAX_SHARDS];
+  ma_uint32 missing_count = 0;
+  for (ma_uint32 d = 0; d < k; ++d) {
+    if (!present[d]) {
+      missing[missing_count++] = d;
+    }
+  }
+  if (missing_count == 0) {
+    return MA_SUCCESS;
+  }
+  ma_uint32 parities[FEC_MAX_SHARDS];
+  ma_uint32 parity_count = 0;
+  for (ma_uint32 p = 0; p < m && parity_count < missing_count; ++p) {
+    if (present[k + p]) {
+      parities[parity_count++] = p;
+    }
+  }
+  if (parity_count < missing_count) {
+    return MA_INVALID_DATA;
+  }
+  // strip the received data out of the parity, leaving only the missing data.
+  ma_uint8 *syndromes = malloc(len * missing_count);
+  if (syndromes == NULL) {
+    return MA_OUT_OF_MEMORY;
+  }
+  ma_uint8 matrix[FEC_MAX_SHARDS * FEC_MAX_SHARDS];
+  for (ma_uint32 r = 0; r < missing_count; ++r) {
+    ma_uint8 *syndrome = syndromes + (len * r);
+    memcpy(syndrome, shards[k + parities[r]], len);
+    for (ma_uint32 d = 0; d < k; ++d) {
+      if (present[d]) {
+        fec_gf_mul_add(syndrome, shards[d], fec_coefficient(parities[r], d),
+                       len);
+      }
+    }
+    for (ma_uint32 c = 0; c < missing_count; ++c) {
+      matrix[r * missing_count + c] = fec_coefficient(parities[r], missing[c]);
+    }
+  }
+  ma_result result = fec_invert(matrix, missing_count);
+  if (result != MA_SUCCESS) {
+    free(syndromes);
+    return result;
+  }
+  for (ma_uint32 r = 0; r < missing_count; ++r) {
+    ma_uint8 *out = shards[missing[r]];
+    memset(out, 0, len);
+    for (ma_uint32 c = 0; c < missing_count; ++c) {
+      fec_gf_mul_add(out, syndromes + (len * c),
+                     matrix[r * missing_count + c], len);
+    }
+  }
+  free(syndromes);
+  return MA_SUCCESS;
+}
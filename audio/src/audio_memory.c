@@ -0,0 +1,184 @@
+#define _GNU_SOURCE
+#include "audio_memory.h"
+#include "miniaudio.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/**
+ * Room in front of every block for its header, keeps blocks as aligned as
+ * the SIMD code in miniaudio wants them.
+ */
+#define AUDIO_MEMORY_HEADER_SIZE 64
+
+struct audio_memory_t {
+  ma_uint32 flags;
+  ma_allocation_callbacks callbacks;
+  _Atomic ma_uint64 mapped_bytes;
+  _Atomic ma_uint64 locked_bytes;
+  _Atomic ma_uint64 huge_page_bytes;
+  _Atomic ma_uint64 lock_failures;
+};
+
+/**
+ * Sits in front of every block.
+ */
+struct audio_memory_block {
+  /* Length of the whole mapping, header included. */
+  size_t map_len;
+  /* Size the block was asked for. */
+  size_t size;
+  bool locked;
+  bool huge;
+};
+
+_Static_assert(sizeof(struct audio_memory_block) <= AUDIO_MEMORY_HEADER_SIZE,
+               "audio memory block header does not fit");
+
+static size_t audio_memory_round_up(size_t value, size_t multiple) {
+  return (value + multiple - 1) / multiple * multiple;
+}
+
+static void *audio_memory_malloc(size_t sz, void *pUserData) {
+  struct audio_memory_t *m = pUserData;
+  const size_t needed = sz + AUDIO_MEMORY_HEADER_SIZE;
+  void *base = MAP_FAILED;
+  size_t map_len = 0;
+  bool huge = false;
+  if ((m->flags & AUDIO_MEMORY_HUGE_PAGES) &&
+      sz >= AUDIO_MEMORY_HUGE_PAGE_THRESHOLD) {
+    // reserved huge pages first, transparent huge pages if there are none.
+    map_len = audio_memory_round_up(needed, AUDIO_MEMORY_HUGE_PAGE_SIZE);
+    base = mmap(NULL, map_len, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1,
+                0);
+    huge = base != MAP_FAILED;
+    if (!huge) {
+      base = mmap(NULL, map_len, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      // the advice has to come before the pages are faulted in.
+      huge = base != MAP_FAILED && madvise(base, map_len, MADV_HUGEPAGE) == 0;
+      if (base != MAP_FAILED) {
+        (void)madvise(base, map_len, MADV_WILLNEED);
+        memset(base, 0, map_len);
+      }
+    }
+  }
+  if (base == MAP_FAILED) {
+    huge = false;
+    map_len = audio_memory_round_up(needed, (size_t)sysconf(_SC_PAGESIZE));
+    base = mmap(NULL, map_len, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (base == MAP_FAILED) {
+      return NULL;
+    }
+  }
+  struct audio_memory_block *block = base;
+  block->map_len = map_len;
+  block->size = sz;
+  block->huge = huge;
+  block->locked = false;
+  if (m->flags & AUDIO_MEMORY_LOCKED) {
+    block->locked = mlock(base, map_len) == 0;
+    if (!block->locked) {
+      atomic_fetch_add_explicit(&m->lock_failures, 1, memory_order_relaxed);
+    }
+  }
+  atomic_fetch_add_explicit(&m->mapped_bytes, map_len, memory_order_relaxed);
+  if (block->locked) {
+    atomic_fetch_add_explicit(&m->locked_bytes, map_len, memory_order_relaxed);
+  }
+  if (block->huge) {
+    atomic_fetch_add_explicit(&m->huge_page_bytes, map_len,
+                              memory_order_relaxed);
+  }
+  return (char *)base + AUDIO_MEMORY_HEADER_SIZE;
+}
+
+static void audio_memory_free(void *p, void *pUserData) {
+  if (p == NULL) {
+    return;
+  }
+  struct audio_memory_t *m = pUserData;
+  struct audio_memory_block *block =
+      (void *)((char *)p - AUDIO_MEMORY_HEADER_SIZE);
+  const size_t map_len = block->map_len;
+  atomic_fetch_sub_explicit(&m->mapped_bytes, map_len, memory_order_relaxed);
+  if (block->locked) {
+    atomic_fetch_sub_explicit(&m->locked_bytes, map_len, memory_order_relaxed);
+  }
+  if (block->huge) {
+    atomic_fetch_sub_explicit(&m->huge_page_bytes, map_len,
+                              memory_order_relaxed);
+  }
+  // unmapping unlocks as well.
+  munmap(block, map_len);
+}
+
+static void *audio_memory_realloc(void *p, size_t sz, void *pUserData) {
+  if (p == NULL) {
+    return audio_memory_malloc(sz, pUserData);
+  }
+  const struct audio_memory_block *block =
+      (const void *)((char *)p - AUDIO_MEMORY_HEADER_SIZE);
+  if (sz <= block->map_len - AUDIO_MEMORY_HEADER_SIZE) {
+    // still fits, the mapping is already faulted in and locked.
+    return p;
+  }
+  void *next = audio_memory_malloc(sz, pUserData);
+  if (next == NULL) {
+    return NULL;
+  }
+  memcpy(next, p, block->size);
+  audio_memory_free(p, pUserData);
+  return next;
+}
+
+struct audio_memory_t *audio_memory_create(ma_uint32 flags) {
+  struct audio_memory_t *m = malloc(sizeof(struct audio_memory_t));
+  if (m == NULL) {
+    return NULL;
+  }
+  m->flags = flags;
+  m->callbacks.pUserData = m;
+  m->callbacks.onMalloc = audio_memory_malloc;
+  m->callbacks.onRealloc = audio_memory_realloc;
+  m->callbacks.onFree = audio_memory_free;
+  atomic_init(&m->mapped_bytes, 0);
+  atomic_init(&m->locked_bytes, 0);
+  atomic_init(&m->huge_page_bytes, 0);
+  atomic_init(&m->lock_failures, 0);
+  return m;
+}
+
+void audio_memory_destroy(struct audio_memory_t **m) {
+  if (m == NULL) {
+    return;
+  }
+  if ((*m) == NULL) {
+    return;
+  }
+  free(*m);
+  *m = NULL;
+}
+
+const ma_allocation_callbacks *
+audio_memory_callbacks(const struct audio_memory_t *m) {
+  return &m->callbacks;
+}
+
+void audio_memory_get_stats(const struct audio_memory_t *m,
+                            struct audio_memory_stats_t *out) {
+  out->mapped_bytes =
+      atomic_load_explicit(&m->mapped_bytes, memory_order_relaxed);
+  out->locked_bytes =
+      atomic_load_explicit(&m->locked_bytes, memory_order_relaxed);
+  out->huge_page_bytes =
+      atomic_load_explicit(&m->huge_page_bytes, memory_order_relaxed);
+  out->lock_failures =
+      atomic_load_explicit(&m->lock_failures, memory_order_relaxed);
+}
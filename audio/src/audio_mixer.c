@@ -0,0 +1,707 @@
+#include "audio_cng.h"
+#include "audio_convert.h"
+#include "audio_mixer.h"
+#include "audio_trace.h"
+#include "audio_types.h"
+#include "audio_utils.h"
+#include "miniaudio.h"
+
+#include <math.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * The knee of the soft limiter applied to the mixed output.
+ */
+#define MIXER_LIMIT_THRESHOLD 0.8f
+/**
+ * How long a stream can go without data before its slot is released.
+ */
+#define MIXER_IDLE_TIMEOUT_SECONDS 5
+/**
+ * How many queued packets per stream are followed through to playout.
+ * Packets queued while the marks are full are not traced.
+ */
+#define MIXER_TRACE_MARKS 64
+/**
+ * Time constant of the jitter buffer fill average drift is measured on.
+ * Long enough to smooth out packet arrival and network jitter.
+ */
+#define MIXER_DRIFT_AVERAGE_SECONDS 2.0
+/**
+ * How long a stream plays before its fill level is taken as the target.
+ */
+#define MIXER_DRIFT_SETTLE_SECONDS 4
+/**
+ * A fill error is corrected over this long, the proportional gain.
+ */
+#define MIXER_DRIFT_CORRECTION_SECONDS 10.0
+/**
+ * Integral time of the correction. The integral learns the steady drift
+ * between the two clocks, so the fill level ends up back on its target
+ * instead of offset by how fast the clocks drift apart.
+ */
+#define MIXER_DRIFT_INTEGRAL_SECONDS (4.0 * MIXER_DRIFT_CORRECTION_SECONDS)
+/**
+ * Largest correction, in parts per million. Crystals are off by tens of
+ * ppm, a 1000 ppm change in speed is not heard.
+ */
+#define MIXER_DRIFT_MAX_PPM 1000.0
+/**
+ * Smallest change of the resampling ratio worth applying.
+ */
+#define MIXER_DRIFT_RATIO_STEP 1e-6
+/**
+ * Frames resampled at a time into the scratch buffer.
+ */
+#define MIXER_DRIFT_CHUNK_FRAMES 256
+
+/**
+ * Stream slot states.
+ * Only the writer moves a slot to active, only the reader moves a slot to
+ * stale. A stale slot is no longer touched by the reader so the writer is free
+ * to reuse it.
+ */
+enum mixer_stream_state {
+  MIXER_STREAM_FREE = 0,
+  MIXER_STREAM_ACTIVE,
+  MIXER_STREAM_STALE,
+};
+
+/**
+ * Trace timestamps of a queued packet, played out once the reader passes
+ * end_frame.
+ */
+struct mixer_trace_mark {
+  ma_uint64 end_frame;
+  ma_uint64 capture_ns;
+  ma_uint64 queue_ns;
+};
+
+struct mixer_stream {
+  /* Slot state, see mixer_stream_state. */
+  _Atomic int state;
+  /* Linear gain of the stream. */
+  _Atomic float gain;
+  /* The sender this slot belongs to. */
+  ma_uint32 stream_id;
+  /* Writer only: if the ring buffer has been allocated. */
+  bool initialized;
+  /* Writer only: converts data not already in the mix format and rate. */
+  struct converter_t *converter;
+  /* Reader only: if the jitter buffer has filled enough to play. */
+  bool primed;
+  /* Reader only: frames played without any data from this stream. */
+  ma_uint32 idle_frames;
+  /* Reader only: if comfort noise fills the gaps of this stream. */
+  bool cn_active;
+  /* Reader only: comfort noise synthesis for the gaps. */
+  struct cn_generator cn;
+  /* Comfort noise descriptor handed from the writer to the reader. */
+  struct cn_descriptor cn_pending;
+  /* Set by the writer when cn_pending is ready, cleared by the reader. */
+  _Atomic int cn_ready;
+  /* The jitter buffer. */
+  ma_pcm_rb ring_buffer;
+  /* Reader only: plays the jitter buffer slightly faster or slower so its
+   * fill level follows the sender's clock, see mixer_track_drift. */
+  ma_linear_resampler resampler;
+  /* Reader only: input over output frames the resampler runs at. */
+  double drift_ratio;
+  /* Reader only: smoothed fill level of the jitter buffer, in frames. */
+  double fill_average;
+  /* Reader only: fill level drift correction holds, negative until the
+   * stream has settled. */
+  double fill_target;
+  /* Reader only: fill error integrated over time, in frame seconds. */
+  double fill_integral;
+  /* Reader only: frames played since the stream (re)primed. */
+  ma_uint64 primed_frames;
+  /* Writer only: frames written into the jitter buffer. */
+  ma_uint64 frames_written;
+  /* Reader only: frames read out of the jitter buffer. */
+  ma_uint64 frames_read;
+  /* Trace marks of queued packets, single producer single consumer. */
+  struct mixer_trace_mark marks[MIXER_TRACE_MARKS];
+  _Atomic ma_uint32 marks_head;
+  _Atomic ma_uint32 marks_tail;
+};
+
+struct mixer_t {
+  ma_uint32 channels;
+  ma_uint32 sampleRate;
+  ma_uint32 sizeInFrames;
+  ma_uint32 prebufferFrames;
+  ma_uint32 idleTimeoutFrames;
+  struct counters_t *counters;
+  /* Where the mixer and its jitter buffers are allocated, NULL for the heap. */
+  const ma_allocation_callbacks *alloc;
+  /* If streams are resampled to follow their sender's clock. */
+  _Atomic bool drift_compensation;
+  /* Reader only: resampled frames before they are mixed. */
+  float *drift_scratch;
+  struct mixer_stream streams[MIXER_MAX_STREAMS];
+};
+
+struct mixer_t *mixer_create(ma_uint32 channels, ma_uint32 sampleRate,
+                             ma_uint32 sizeInFrames,
+                             ma_uint32 prebufferFrames,
+                             struct counters_t *counters,
+                             const ma_allocation_callbacks *alloc) {
+  if (channels == 0 || sizeInFrames == 0) {
+    return NULL;
+  }
+  struct mixer_t *m = ma_malloc(sizeof(struct mixer_t), alloc);
+  if (m == NULL) {
+    return NULL;
+  }
+  memset(m, 0, sizeof(struct mixer_t));
+  m->channels = channels;
+  m->sampleRate = sampleRate;
+  m->sizeInFrames = sizeInFrames;
+  m->prebufferFrames =
+      prebufferFrames > sizeInFrames ? sizeInFrames : prebufferFrames;
+  m->idleTimeoutFrames = sampleRate * MIXER_IDLE_TIMEOUT_SECONDS;
+  m->counters = counters;
+  m->alloc = alloc;
+  atomic_init(&m->drift_compensation, true);
+  m->drift_scratch = ma_malloc(
+      sizeof(float) * MIXER_DRIFT_CHUNK_FRAMES * channels, alloc);
+  if (m->drift_scratch == NULL) {
+    ma_free(m, alloc);
+    return NULL;
+  }
+  for (size_t i = 0; i < MIXER_MAX_STREAMS; ++i) {
+    atomic_init(&m->streams[i].state, MIXER_STREAM_FREE);
+    atomic_init(&m->streams[i].gain, 1.0f);
+    atomic_init(&m->streams[i].cn_ready, 0);
+    atomic_init(&m->streams[i].marks_head, 0);
+    atomic_init(&m->streams[i].marks_tail, 0);
+  }
+  return m;
+}
+
+void mixer_destroy(struct mixer_t **m) {
+  if (m == NULL) {
+    return;
+  }
+  if ((*m) == NULL) {
+    return;
+  }
+  for (size_t i = 0; i < MIXER_MAX_STREAMS; ++i) {
+    if ((*m)->streams[i].initialized) {
+      ma_pcm_rb_uninit(&(*m)->streams[i].ring_buffer);
+      ma_linear_resampler_uninit(&(*m)->streams[i].resampler, (*m)->alloc);
+    }
+    converter_destroy(&(*m)->streams[i].converter);
+  }
+  ma_free((*m)->drift_scratch, (*m)->alloc);
+  ma_free(*m, (*m)->alloc);
+  *m = NULL;
+}
+
+/**
+ * Forget the measured drift and play at the nominal rate again, the stream
+ * settles anew once it is primed.
+ */
+static void mixer_reset_drift(struct mixer_stream *stream) {
+  if (stream->drift_ratio != 1.0) {
+    (void)ma_linear_resampler_set_rate_ratio(&stream->resampler, 1.0f);
+  }
+  if (stream->primed_frames != 0) {
+    (void)ma_linear_resampler_reset(&stream->resampler);
+  }
+  stream->drift_ratio = 1.0;
+  stream->fill_average = 0.0;
+  stream->fill_target = -1.0;
+  stream->fill_integral = 0.0;
+  stream->primed_frames = 0;
+}
+
+/**
+ * Find the slot of the given stream, claiming a new one if needed.
+ * Writer side only.
+ */
+static struct mixer_stream *mixer_claim_stream(struct mixer_t *m,
+                                               ma_uint32 stream_id) {
+  struct mixer_stream *available = NULL;
+  for (size_t i = 0; i < MIXER_MAX_STREAMS; ++i) {
+    struct mixer_stream *stream = &m->streams[i];
+    const int state = atomic_load_explicit(&stream->state, memory_order_acquire);
+    if (state == MIXER_STREAM_FREE || state == MIXER_STREAM_STALE) {
+      if (available == NULL || stream->stream_id == stream_id) {
+        available = stream;
+      }
+      continue;
+    }
+    if (stream->stream_id == stream_id) {
+      return stream;
+    }
+  }
+  if (available == NULL) {
+    return NULL;
+  }
+  if (!available->initialized) {
+    ma_result result = ma_pcm_rb_init(ma_format_f32,          // format
+                                      m->channels,            // channels
+                                      m->sizeInFrames,        // size in Frames
+                                      NULL,                   // prepopulate
+                                      m->alloc,               // allocation
+                                      &available->ring_buffer // the ring
+    );
+    if (result != MA_SUCCESS) {
+      fprintf(stderr, "mixer: ring buffer init error code(%d)\n", result);
+      return NULL;
+    }
+    ma_pcm_rb_set_sample_rate(&available->ring_buffer, m->sampleRate);
+    ma_linear_resampler_config config = ma_linear_resampler_config_init(
+        ma_format_f32, m->channels, m->sampleRate, m->sampleRate);
+    // the ratio stays within a fraction of a percent of 1, nothing to filter.
+    config.lpfOrder = 0;
+    result = ma_linear_resampler_init(&config, m->alloc, &available->resampler);
+    if (result != MA_SUCCESS) {
+      fprintf(stderr, "mixer: resampler init error code(%d)\n", result);
+      ma_pcm_rb_uninit(&available->ring_buffer);
+      return NULL;
+    }
+    available->drift_ratio = 1.0;
+    available->initialized = true;
+  } else {
+    ma_pcm_rb_reset(&available->ring_buffer);
+    (void)ma_linear_resampler_reset(&available->resampler);
+  }
+  mixer_reset_drift(available);
+  converter_destroy(&available->converter);
+  if (available->stream_id != stream_id) {
+    atomic_store_explicit(&available->gain, 1.0f, memory_order_relaxed);
+  }
+  available->stream_id = stream_id;
+  available->primed = false;
+  available->idle_frames = 0;
+  available->cn_active = false;
+  available->frames_written = 0;
+  available->frames_read = 0;
+  atomic_store_explicit(&available->marks_head, 0, memory_order_relaxed);
+  atomic_store_explicit(&available->marks_tail, 0, memory_order_relaxed);
+  cn_generator_init(&available->cn, stream_id);
+  atomic_store_explicit(&available->cn_ready, 0, memory_order_relaxed);
+  atomic_store_explicit(&available->state, MIXER_STREAM_ACTIVE,
+                        memory_order_release);
+  return available;
+}
+
+/**
+ * Write f32 frames into the jitter buffer of the stream.
+ * Writer side only.
+ */
+static ma_result mixer_write_frames(struct mixer_t *m,
+                                    struct mixer_stream *stream,
+                                    const float *data, ma_uint32 frameCount,
+                                    ma_uint32 channels) {
+  ma_uint32 framesWritten = 0;
+  while (framesWritten < frameCount) {
+    ma_uint32 frames = frameCount - framesWritten;
+    void *buffer = NULL;
+    ma_result result =
+        ma_pcm_rb_acquire_write(&stream->ring_buffer, &frames, &buffer);
+    if (result != MA_SUCCESS) {
+      fprintf(stderr,
+              "failed to acquire write for ring buffer -- error code(%d).\n",
+              result);
+      return result;
+    }
+    if (frames == 0) {
+      // jitter buffer is full, the rest is lost.
+      break;
+    }
+    const float *data_offset =
+        ma_offset_pcm_frames_const_ptr_f32(data, framesWritten, channels);
+    ma_copy_pcm_frames(buffer, data_offset, frames, ma_format_f32, channels);
+    result = ma_pcm_rb_commit_write(&stream->ring_buffer, frames);
+    if (result != MA_SUCCESS) {
+      fprintf(stderr,
+              "failed to commit write for ring buffer -- error code(%d).\n",
+              result);
+      return result;
+    }
+    framesWritten += frames;
+  }
+  stream->frames_written += framesWritten;
+  counters_add(m->counters, COUNTER_FRAMES_QUEUED, framesWritten);
+  counters_add(m->counters, COUNTER_FRAMES_DROPPED_QUEUE,
+               frameCount - framesWritten);
+  return MA_SUCCESS;
+}
+
+/**
+ * Remember when a packet was queued so its playout can be traced.
+ * Writer side only.
+ */
+static void mixer_trace_queued(struct mixer_stream *stream,
+                               const struct capture_data_t *cd,
+                               ma_uint64 queue_ns) {
+  const ma_uint32 head =
+      atomic_load_explicit(&stream->marks_head, memory_order_relaxed);
+  const ma_uint32 tail =
+      atomic_load_explicit(&stream->marks_tail, memory_order_acquire);
+  if (head - tail >= MIXER_TRACE_MARKS) {
+    return;
+  }
+  struct mixer_trace_mark *mark = &stream->marks[head % MIXER_TRACE_MARKS];
+  mark->end_frame = stream->frames_written;
+  mark->capture_ns = cd->capture_ns;
+  mark->queue_ns = queue_ns;
+  atomic_store_explicit(&stream->marks_head, head + 1, memory_order_release);
+}
+
+/**
+ * Record the playout of every packet the reader has passed.
+ * Reader side only.
+ */
+static void mixer_trace_played(struct mixer_stream *stream) {
+  ma_uint32 tail =
+      atomic_load_explicit(&stream->marks_tail, memory_order_relaxed);
+  const ma_uint32 head =
+      atomic_load_explicit(&stream->marks_head, memory_order_acquire);
+  if (tail == head) {
+    return;
+  }
+  const ma_uint64 now_ns = trace_now_ns();
+  while (tail != head) {
+    const struct mixer_trace_mark *mark =
+        &stream->marks[tail % MIXER_TRACE_MARKS];
+    if (mark->end_frame > stream->frames_read) {
+      break;
+    }
+    trace_record(TRACE_PLAYOUT, mark->queue_ns, now_ns);
+    trace_record(TRACE_TOTAL, mark->capture_ns, now_ns);
+    ++tail;
+  }
+  atomic_store_explicit(&stream->marks_tail, tail, memory_order_release);
+}
+
+ma_result mixer_queue(struct mixer_t *m, const struct capture_data_t *cd) {
+  if (m == NULL || cd == NULL || cd->buffer == NULL) {
+    return MA_INVALID_ARGS;
+  }
+  if (cd->channels != m->channels) {
+    return MA_INVALID_ARGS;
+  }
+  struct mixer_stream *stream = mixer_claim_stream(m, cd->stream_id);
+  if (stream == NULL) {
+    if (cd->kind == CAPTURE_DATA_AUDIO) {
+      counters_add(m->counters, COUNTER_FRAMES_DROPPED_QUEUE,
+                   cd->sizeInFrames);
+    }
+    return MA_NO_SPACE;
+  }
+  if (cd->kind == CAPTURE_DATA_COMFORT_NOISE) {
+    // the reader has not picked up the last one yet, the next will follow.
+    if (atomic_load_explicit(&stream->cn_ready, memory_order_acquire) != 0) {
+      return MA_SUCCESS;
+    }
+    ma_result result =
+        cn_descriptor_unmarshal(cd->buffer, cd->buffer_len, &stream->cn_pending);
+    if (result != MA_SUCCESS) {
+      return result;
+    }
+    atomic_store_explicit(&stream->cn_ready, 1, memory_order_release);
+    return MA_SUCCESS;
+  }
+  if (!capture_data_frames_fit(cd)) {
+    counters_add(m->counters, COUNTER_PACKETS_MALFORMED, 1);
+    return MA_INVALID_ARGS;
+  }
+  // no sample rate means it is already at the mix rate.
+  const ma_uint32 sampleRate = cd->sampleRate == 0 ? m->sampleRate : cd->sampleRate;
+  const ma_uint64 queue_ns = trace_now_ns();
+  trace_record(TRACE_QUEUE, cd->stage_ns, queue_ns);
+  if (cd->format == ma_format_f32 && sampleRate == m->sampleRate) {
+    ma_result result =
+        mixer_write_frames(m, stream, (const float *)cd->buffer,
+                           cd->sizeInFrames, m->channels);
+    mixer_trace_queued(stream, cd, queue_ns);
+    return result;
+  }
+  if (!converter_matches(stream->converter, cd->format, ma_format_f32,
+                         m->channels, sampleRate, m->sampleRate)) {
+    converter_destroy(&stream->converter);
+    stream->converter = converter_create(cd->format, ma_format_f32,
+                                         m->channels, sampleRate,
+                                         m->sampleRate);
+    if (stream->converter == NULL) {
+      return MA_INVALID_ARGS;
+    }
+  }
+  struct capture_data_t local_in = *cd;
+  local_in.sampleRate = sampleRate;
+  struct capture_data_t *converted = NULL;
+  ma_result result = converter_process(stream->converter, &local_in, &converted);
+  if (result != MA_SUCCESS) {
+    return result;
+  }
+  result = mixer_write_frames(m, stream, (const float *)converted->buffer,
+                              converted->sizeInFrames, m->channels);
+  mixer_trace_queued(stream, cd, queue_ns);
+  capture_data_destroy(&converted);
+  return result;
+}
+
+void mixer_set_drift_compensation(struct mixer_t *m, bool enabled) {
+  atomic_store_explicit(&m->drift_compensation, enabled, memory_order_relaxed);
+}
+
+ma_result mixer_set_gain(struct mixer_t *m, ma_uint32 stream_id, float gain) {
+  if (m == NULL) {
+    return MA_INVALID_ARGS;
+  }
+  for (size_t i = 0; i < MIXER_MAX_STREAMS; ++i) {
+    struct mixer_stream *stream = &m->streams[i];
+    if (atomic_load_explicit(&stream->state, memory_order_acquire) !=
+        MIXER_STREAM_ACTIVE) {
+      continue;
+    }
+    if (stream->stream_id == stream_id) {
+      atomic_store_explicit(&stream->gain, gain, memory_order_relaxed);
+      return MA_SUCCESS;
+    }
+  }
+  return MA_DOES_NOT_EXIST;
+}
+
+ma_result mixer_buffered_frames(struct mixer_t *m, ma_uint32 stream_id,
+                                ma_uint32 *frames) {
+  if (m == NULL || frames == NULL) {
+    return MA_INVALID_ARGS;
+  }
+  for (size_t i = 0; i < MIXER_MAX_STREAMS; ++i) {
+    struct mixer_stream *stream = &m->streams[i];
+    if (atomic_load_explicit(&stream->state, memory_order_acquire) !=
+        MIXER_STREAM_ACTIVE) {
+      continue;
+    }
+    if (stream->stream_id == stream_id) {
+      *frames = ma_pcm_rb_available_read(&stream->ring_buffer);
+      return MA_SUCCESS;
+    }
+  }
+  return MA_DOES_NOT_EXIST;
+}
+
+/**
+ * Count a period the stream ran dry in, it waits for the jitter buffer to
+ * fill back up.
+ */
+static void mixer_underrun(struct mixer_t *m, struct mixer_stream *stream) {
+  stream->primed = false;
+  counters_add(m->counters, COUNTER_UNDERRUN_PERIODS, 1);
+}
+
+/**
+ * Mix the jitter buffer into the output as is.
+ * Reader side only.
+ *
+ * @return The number of frames mixed.
+ */
+static ma_uint32 mixer_read_direct(struct mixer_t *m,
+                                   struct mixer_stream *stream, float *out,
+                                   ma_uint32 frameCount, float gain) {
+  ma_uint32 framesRead = 0;
+  // the ring can hand back less than requested when it wraps around.
+  while (framesRead < frameCount) {
+    ma_uint32 frames = frameCount - framesRead;
+    void *buffer = NULL;
+    ma_result result =
+        ma_pcm_rb_acquire_read(&stream->ring_buffer, &frames, &buffer);
+    if (result != MA_SUCCESS || buffer == NULL || frames == 0) {
+      mixer_underrun(m, stream);
+      break;
+    }
+    audio_mix_f32(out + ((size_t)framesRead * m->channels),
+                  (const float *)buffer, gain, (size_t)frames * m->channels);
+    (void)ma_pcm_rb_commit_read(&stream->ring_buffer, frames);
+    framesRead += frames;
+  }
+  return framesRead;
+}
+
+/**
+ * Mix the jitter buffer into the output through the stream's resampler.
+ * Reader side only.
+ *
+ * @param consumed Populated with the frames taken from the jitter buffer.
+ * @return The number of frames mixed.
+ */
+static ma_uint32 mixer_read_resampled(struct mixer_t *m,
+                                      struct mixer_stream *stream, float *out,
+                                      ma_uint32 frameCount, float gain,
+                                      ma_uint32 *consumed) {
+  ma_uint32 framesRead = 0;
+  *consumed = 0;
+  while (framesRead < frameCount) {
+    ma_uint64 framesOut = frameCount - framesRead;
+    if (framesOut > MIXER_DRIFT_CHUNK_FRAMES) {
+      framesOut = MIXER_DRIFT_CHUNK_FRAMES;
+    }
+    ma_uint64 framesIn = 0;
+    (void)ma_linear_resampler_get_required_input_frame_count(
+        &stream->resampler, framesOut, &framesIn);
+    // the ring hands out at most up to where it wraps, the resampler keeps
+    // its position across calls so the rest follows on the next pass.
+    ma_uint32 frames = framesIn > 0 ? (ma_uint32)framesIn : 1;
+    void *buffer = NULL;
+    ma_result result =
+        ma_pcm_rb_acquire_read(&stream->ring_buffer, &frames, &buffer);
+    if (result != MA_SUCCESS || buffer == NULL || frames == 0) {
+      mixer_underrun(m, stream);
+      break;
+    }
+    framesIn = frames;
+    result = ma_linear_resampler_process_pcm_frames(
+        &stream->resampler, buffer, &framesIn, m->drift_scratch, &framesOut);
+    (void)ma_pcm_rb_commit_read(&stream->ring_buffer, (ma_uint32)framesIn);
+    if (result != MA_SUCCESS || (framesIn == 0 && framesOut == 0)) {
+      break;
+    }
+    audio_mix_f32(out + ((size_t)framesRead * m->channels), m->drift_scratch,
+                  gain, (size_t)framesOut * m->channels);
+    framesRead += (ma_uint32)framesOut;
+    *consumed += (ma_uint32)framesIn;
+  }
+  return framesRead;
+}
+
+/**
+ * Measure how far the jitter buffer has drifted from where it settled and
+ * set the resampling ratio to bring it back. The sender's device clock
+ * running fast fills the buffer up, running slow drains it. Left alone
+ * either one turns into latency creeping up or underruns over a long call.
+ * Reader side only.
+ */
+static void mixer_track_drift(struct mixer_t *m, struct mixer_stream *stream,
+                              ma_uint32 frameCount) {
+  const double fill = (double)ma_pcm_rb_available_read(&stream->ring_buffer);
+  if (stream->primed_frames == 0) {
+    stream->fill_average = fill;
+  }
+  double alpha = (double)frameCount /
+                 ((double)m->sampleRate * MIXER_DRIFT_AVERAGE_SECONDS);
+  if (alpha > 1.0) {
+    alpha = 1.0;
+  }
+  stream->fill_average += (fill - stream->fill_average) * alpha;
+  stream->primed_frames += frameCount;
+  if (stream->fill_target < 0.0) {
+    if (stream->primed_frames <
+        (ma_uint64)m->sampleRate * MIXER_DRIFT_SETTLE_SECONDS) {
+      return;
+    }
+    stream->fill_target = stream->fill_average;
+  }
+  // too full plays faster (more input per output frame), too empty slower.
+  const double error = stream->fill_average - stream->fill_target;
+  const double limit = MIXER_DRIFT_MAX_PPM / 1e6;
+  const double gain =
+      1.0 / ((double)m->sampleRate * MIXER_DRIFT_CORRECTION_SECONDS);
+  // the integral alone never asks for more than the limit, so it does not
+  // wind up while the correction is saturated.
+  const double integral_limit = limit * MIXER_DRIFT_INTEGRAL_SECONDS / gain;
+  stream->fill_integral += error * (double)frameCount / (double)m->sampleRate;
+  if (stream->fill_integral > integral_limit) {
+    stream->fill_integral = integral_limit;
+  } else if (stream->fill_integral < -integral_limit) {
+    stream->fill_integral = -integral_limit;
+  }
+  double correction =
+      gain * (error + stream->fill_integral / MIXER_DRIFT_INTEGRAL_SECONDS);
+  if (correction > limit) {
+    correction = limit;
+  } else if (correction < -limit) {
+    correction = -limit;
+  }
+  const double ratio = 1.0 + correction;
+  if (fabs(ratio - stream->drift_ratio) < MIXER_DRIFT_RATIO_STEP) {
+    return;
+  }
+  if (ma_linear_resampler_set_rate_ratio(&stream->resampler, (float)ratio) ==
+      MA_SUCCESS) {
+    stream->drift_ratio = ratio;
+  }
+}
+
+/**
+ * Mix as much of the stream as is available into the output.
+ * Any gap left is filled with the stream's comfort noise, if it has sent any.
+ * Reader side only.
+ *
+ * @return The number of frames of real audio mixed.
+ */
+static ma_uint32 mixer_mix_stream(struct mixer_t *m,
+                                  struct mixer_stream *stream, float *out,
+                                  ma_uint32 frameCount) {
+  if (atomic_load_explicit(&stream->cn_ready, memory_order_acquire) != 0) {
+    cn_generator_update(&stream->cn, &stream->cn_pending);
+    atomic_store_explicit(&stream->cn_ready, 0, memory_order_release);
+    stream->cn_active = true;
+    stream->idle_frames = 0;
+  }
+  const float gain = atomic_load_explicit(&stream->gain, memory_order_relaxed);
+  if (!stream->primed &&
+      ma_pcm_rb_available_read(&stream->ring_buffer) >= m->prebufferFrames) {
+    stream->primed = true;
+  }
+  ma_uint32 framesRead = 0;
+  ma_uint32 consumed = 0;
+  if (stream->primed &&
+      atomic_load_explicit(&m->drift_compensation, memory_order_relaxed)) {
+    mixer_track_drift(m, stream, frameCount);
+    framesRead =
+        mixer_read_resampled(m, stream, out, frameCount, gain, &consumed);
+  } else if (stream->primed) {
+    framesRead = mixer_read_direct(m, stream, out, frameCount, gain);
+    consumed = framesRead;
+  }
+  if (framesRead < frameCount && !stream->primed) {
+    mixer_reset_drift(stream);
+  }
+  stream->frames_read += consumed;
+  mixer_trace_played(stream);
+  if (framesRead < frameCount && stream->cn_active) {
+    cn_generator_mix(&stream->cn, out + ((size_t)framesRead * m->channels),
+                     frameCount - framesRead, m->channels, gain);
+  }
+  return framesRead;
+}
+
+ma_uint32 mixer_read(struct mixer_t *m, float *out, ma_uint32 frameCount) {
+  const size_t sample_count = (size_t)frameCount * m->channels;
+  memset(out, 0, sample_count * sizeof(float));
+  ma_uint32 contributors = 0;
+  for (size_t i = 0; i < MIXER_MAX_STREAMS; ++i) {
+    struct mixer_stream *stream = &m->streams[i];
+    if (atomic_load_explicit(&stream->state, memory_order_acquire) !=
+        MIXER_STREAM_ACTIVE) {
+      continue;
+    }
+    const ma_uint32 frames = mixer_mix_stream(m, stream, out, frameCount);
+    if (frames > 0 || stream->cn_active) {
+      contributors++;
+    }
+    if (frames > 0) {
+      stream->idle_frames = 0;
+      continue;
+    }
+    stream->idle_frames += frameCount;
+    if (stream->idle_frames >= m->idleTimeoutFrames) {
+      atomic_store_explicit(&stream->state, MIXER_STREAM_STALE,
+                            memory_order_release);
+    }
+  }
+  if (contributors > 0) {
+    audio_soft_limit_f32(out, sample_count, MIXER_LIMIT_THRESHOLD);
+  }
+  return contributors;
+}
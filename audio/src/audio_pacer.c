@@ -0,0 +1,67 @@
+#define _GNU_SOURCE
+#include "audio_pacer.h"
+#include "audio_trace.h"
+#include "miniaudio.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+
+struct pacer_t {
+  /* When the next packet is due on the trace clock, 0 before the first. */
+  ma_uint64 next_ns;
+  ma_uint32 speedup_percent;
+  ma_uint64 max_lag_ns;
+};
+
+struct pacer_t *pacer_create(ma_uint32 speedup_percent, ma_uint64 max_lag_ns) {
+  struct pacer_t *p = malloc(sizeof(struct pacer_t));
+  if (p == NULL) {
+    return NULL;
+  }
+  p->next_ns = 0;
+  p->speedup_percent = speedup_percent;
+  p->max_lag_ns = max_lag_ns;
+  return p;
+}
+
+void pacer_destroy(struct pacer_t **p) {
+  if (p == NULL) {
+    return;
+  }
+  if ((*p) == NULL) {
+    return;
+  }
+  free(*p);
+  *p = NULL;
+}
+
+/**
+ * Sleep until an absolute time on the trace clock.
+ */
+static void pacer_sleep_until(ma_uint64 deadline_ns) {
+  const struct timespec ts = {
+      .tv_sec = (time_t)(deadline_ns / 1000000000ull),
+      .tv_nsec = (long)(deadline_ns % 1000000000ull),
+  };
+  // absolute, so a signal just restarts the same wait.
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+  }
+}
+
+ma_uint64 pacer_wait(struct pacer_t *p, ma_uint64 duration_ns) {
+  if (p == NULL) {
+    return 0;
+  }
+  const ma_uint64 now_ns = trace_now_ns();
+  if (p->next_ns == 0 || p->next_ns + p->max_lag_ns < now_ns) {
+    p->next_ns = now_ns;
+  }
+  ma_uint64 slept_ns = 0;
+  if (p->next_ns > now_ns) {
+    pacer_sleep_until(p->next_ns);
+    slept_ns = trace_now_ns() - now_ns;
+  }
+  p->next_ns += duration_ns * 100 / (100 + p->speedup_percent);
+  return slept_ns;
+}
@@ -0,0 +1,343 @@
+#include "audio_quality.h"
+#include "miniaudio.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const double QUALITY_PI = 3.14159265358979323846;
+/* Only this much of each signal is used to find the offset. */
+static const ma_uint32 QUALITY_ALIGN_SECONDS = 20;
+/* Frame length of the segmental SNR and glitch detection. */
+static const ma_uint32 QUALITY_FRAME_MS = 20;
+/* Frames with a reference mean power under this (-60 dBFS) are silence. */
+static const double QUALITY_ACTIVE_POWER = 1e-6;
+static const double QUALITY_SEG_SNR_MIN = -10.0;
+static const double QUALITY_SEG_SNR_MAX = 35.0;
+/* Active frames under this SNR count towards a glitch. */
+static const double QUALITY_GLITCH_SNR = 3.0;
+/* Floor added to spectra so silent bins do not blow up the distance. */
+static const double QUALITY_SPECTRUM_FLOOR = 1e-10;
+
+static size_t quality_next_pow2(size_t n) {
+  size_t result = 1;
+  while (result < n) {
+    result <<= 1;
+  }
+  return result;
+}
+
+/**
+ * In place iterative radix 2 FFT, n must be a power of two.
+ * The inverse is scaled by 1/n.
+ */
+static void quality_fft(double *re, double *im, size_t n, bool inverse) {
+  for (size_t i = 1, j = 0; i < n; ++i) {
+    size_t bit = n >> 1;
+    for (; j & bit; bit >>= 1) {
+      j ^= bit;
+    }
+    j ^= bit;
+    if (i < j) {
+      double tmp = re[i];
+      re[i] = re[j];
+      re[j] = tmp;
+      tmp = im[i];
+      im[i] = im[j];
+      im[j] = tmp;
+    }
+  }
+  for (size_t len = 2; len <= n; len <<= 1) {
+    const double angle = 2.0 * QUALITY_PI / (double)len * (inverse ? 1 : -1);
+    const size_t half = len / 2;
+    for (size_t k = 0; k < half; ++k) {
+      const double wr = cos(angle * (double)k);
+      const double wi = sin(angle * (double)k);
+      for (size_t i = k; i < n; i += len) {
+        const size_t j = i + half;
+        const double tr = re[j] * wr - im[j] * wi;
+        const double ti = re[j] * wi + im[j] * wr;
+        re[j] = re[i] - tr;
+        im[j] = im[i] - ti;
+        re[i] += tr;
+        im[i] += ti;
+      }
+    }
+  }
+  if (inverse) {
+    for (size_t i = 0; i < n; ++i) {
+      re[i] /= (double)n;
+      im[i] /= (double)n;
+    }
+  }
+}
+
+/**
+ * Find how many frames the degraded signal lags the reference by, from the
+ * peak of their FFT based cross correlation.
+ */
+static ma_result quality_align(const float *reference, ma_uint64 reference_frames,
+                               const float *degraded, ma_uint64 degraded_frames,
+                               ma_uint32 sampleRate, ma_int64 *lag) {
+  const ma_uint64 window = (ma_uint64)QUALITY_ALIGN_SECONDS * sampleRate;
+  const size_t ref_len =
+      (size_t)(reference_frames < window ? reference_frames : window);
+  const size_t deg_len =
+      (size_t)(degraded_frames < window ? degraded_frames : window);
+  const size_t n = quality_next_pow2(ref_len + deg_len);
+  double *buffer = calloc(n * 4, sizeof(double));
+  if (buffer == NULL) {
+    return MA_OUT_OF_MEMORY;
+  }
+  double *deg_re = buffer;
+  double *deg_im = buffer + n;
+  double *ref_re = buffer + 2 * n;
+  double *ref_im = buffer + 3 * n;
+  for (size_t i = 0; i < deg_len; ++i) {
+    deg_re[i] = degraded[i];
+  }
+  for (size_t i = 0; i < ref_len; ++i) {
+    ref_re[i] = reference[i];
+  }
+  quality_fft(deg_re, deg_im, n, false);
+  quality_fft(ref_re, ref_im, n, false);
+  // deg * conj(ref), its inverse at k is sum of deg[i + k] * ref[i].
+  for (size_t i = 0; i < n; ++i) {
+    const double re = deg_re[i] * ref_re[i] + deg_im[i] * ref_im[i];
+    const double im = deg_im[i] * ref_re[i] - deg_re[i] * ref_im[i];
+    deg_re[i] = re;
+    deg_im[i] = im;
+  }
+  quality_fft(deg_re, deg_im, n, true);
+  size_t best = 0;
+  for (size_t i = 1; i < n; ++i) {
+    if (deg_re[i] > deg_re[best]) {
+      best = i;
+    }
+  }
+  *lag = best < n / 2 ? (ma_int64)best : (ma_int64)best - (ma_int64)n;
+  free(buffer);
+  return MA_SUCCESS;
+}
+
+static double quality_clamp(double value, double min, double max) {
+  if (value < min) {
+    return min;
+  }
+  if (value > max) {
+    return max;
+  }
+  return value;
+}
+
+/**
+ * Mean log spectral distance over active frames of the aligned signals.
+ */
+static ma_result quality_log_spectral_distance(const float *reference,
+                                               const float *degraded,
+                                               ma_uint64 frames, double gain,
+                                               ma_uint32 sampleRate,
+                                               double *out) {
+  const size_t n =
+      quality_next_pow2((size_t)sampleRate * QUALITY_FRAME_MS / 1000);
+  const size_t hop = n / 2;
+  double *buffer = malloc(n * 5 * sizeof(double));
+  if (buffer == NULL) {
+    return MA_OUT_OF_MEMORY;
+  }
+  double *window = buffer;
+  double *ref_re = buffer + n;
+  double *ref_im = buffer + 2 * n;
+  double *deg_re = buffer + 3 * n;
+  double *deg_im = buffer + 4 * n;
+  for (size_t i = 0; i < n; ++i) {
+    window[i] = 0.5 - 0.5 * cos(2.0 * QUALITY_PI * (double)i / (double)n);
+  }
+  double sum = 0;
+  ma_uint64 count = 0;
+  for (ma_uint64 start = 0; start + n <= frames; start += hop) {
+    double power = 0;
+    for (size_t i = 0; i < n; ++i) {
+      const double r = reference[start + i];
+      power += r * r;
+      ref_re[i] = r * window[i];
+      deg_re[i] = gain * degraded[start + i] * window[i];
+      ref_im[i] = 0;
+      deg_im[i] = 0;
+    }
+    if (power / (double)n < QUALITY_ACTIVE_POWER) {
+      continue;
+    }
+    quality_fft(ref_re, ref_im, n, false);
+    quality_fft(deg_re, deg_im, n, false);
+    double distance = 0;
+    for (size_t k = 0; k <= n / 2; ++k) {
+      const double pr =
+          ref_re[k] * ref_re[k] + ref_im[k] * ref_im[k] + QUALITY_SPECTRUM_FLOOR;
+      const double pd =
+          deg_re[k] * deg_re[k] + deg_im[k] * deg_im[k] + QUALITY_SPECTRUM_FLOOR;
+      const double db = 10.0 * log10(pr / pd);
+      distance += db * db;
+    }
+    sum += sqrt(distance / (double)(n / 2 + 1));
+    ++count;
+  }
+  *out = count > 0 ? sum / (double)count : 0;
+  free(buffer);
+  return MA_SUCCESS;
+}
+
+ma_result quality_compare(const float *reference, ma_uint64 reference_frames,
+                          const float *degraded, ma_uint64 degraded_frames,
+                          ma_uint32 sampleRate, struct quality_result_t *out) {
+  if (reference == NULL || degraded == NULL || out == NULL ||
+      reference_frames == 0 || degraded_frames == 0 || sampleRate == 0) {
+    return MA_INVALID_ARGS;
+  }
+  memset(out, 0, sizeof(struct quality_result_t));
+  out->sampleRate = sampleRate;
+  ma_int64 lag = 0;
+  ma_result result = quality_align(reference, reference_frames, degraded,
+                                   degraded_frames, sampleRate, &lag);
+  if (result != MA_SUCCESS) {
+    return result;
+  }
+  out->offset_frames = lag;
+  // overlap of the two once the degraded signal is shifted back by lag.
+  const ma_int64 ref_start = lag < 0 ? -lag : 0;
+  ma_int64 ref_end = (ma_int64)degraded_frames - lag;
+  if (ref_end > (ma_int64)reference_frames) {
+    ref_end = (ma_int64)reference_frames;
+  }
+  if (ref_end <= ref_start) {
+    return MA_INVALID_ARGS;
+  }
+  const float *ref = reference + ref_start;
+  const float *deg = degraded + ref_start + lag;
+  const ma_uint64 frames = (ma_uint64)(ref_end - ref_start);
+  out->frames_compared = frames;
+
+  double ref_energy = 0;
+  double deg_energy = 0;
+  double cross = 0;
+  for (ma_uint64 i = 0; i < frames; ++i) {
+    ref_energy += (double)ref[i] * ref[i];
+    deg_energy += (double)deg[i] * deg[i];
+    cross += (double)ref[i] * deg[i];
+  }
+  out->gain = deg_energy > 0 ? cross / deg_energy : 1.0;
+  if (ref_energy > 0 && deg_energy > 0) {
+    out->correlation = cross / sqrt(ref_energy * deg_energy);
+  }
+
+  const ma_uint64 frame_len = (ma_uint64)sampleRate * QUALITY_FRAME_MS / 1000;
+  double noise_energy = 0;
+  double seg_sum = 0;
+  ma_uint64 seg_count = 0;
+  bool in_glitch = false;
+  for (ma_uint64 start = 0; start + frame_len <= frames; start += frame_len) {
+    double signal = 0;
+    double noise = 0;
+    for (ma_uint64 i = start; i < start + frame_len; ++i) {
+      const double e = ref[i] - out->gain * deg[i];
+      signal += (double)ref[i] * ref[i];
+      noise += e * e;
+    }
+    noise_energy += noise;
+    if (signal / (double)frame_len < QUALITY_ACTIVE_POWER) {
+      in_glitch = false;
+      continue;
+    }
+    const double snr = noise > 0 ? 10.0 * log10(signal / noise)
+                                 : QUALITY_SEG_SNR_MAX;
+    seg_sum += quality_clamp(snr, QUALITY_SEG_SNR_MIN, QUALITY_SEG_SNR_MAX);
+    ++seg_count;
+    const bool bad = snr < QUALITY_GLITCH_SNR;
+    if (bad && !in_glitch) {
+      ++out->glitches;
+    }
+    in_glitch = bad;
+  }
+  out->snr_db = noise_energy > 0 ? 10.0 * log10(ref_energy / noise_energy)
+                                 : QUALITY_SEG_SNR_MAX;
+  out->segmental_snr_db = seg_count > 0 ? seg_sum / (double)seg_count : 0;
+  return quality_log_spectral_distance(ref, deg, frames, out->gain, sampleRate,
+                                       &out->log_spectral_distance_db);
+}
+
+/**
+ * Decode a whole file into a newly allocated mono f32 buffer.
+ *
+ * @param sampleRate Rate to decode at, 0 keeps the file's rate. Set to the
+ *  rate used on return.
+ */
+static ma_result quality_decode(const char *path, ma_uint32 *sampleRate,
+                                float **frames, ma_uint64 *frame_count) {
+  ma_decoder_config config = ma_decoder_config_init(ma_format_f32, 1, *sampleRate);
+  ma_decoder decoder;
+  ma_result result = ma_decoder_init_file(path, &config, &decoder);
+  if (result != MA_SUCCESS) {
+    return result;
+  }
+  *sampleRate = decoder.outputSampleRate;
+  ma_uint64 capacity = (ma_uint64)decoder.outputSampleRate * 10;
+  ma_uint64 count = 0;
+  float *buffer = malloc(capacity * sizeof(float));
+  while (buffer != NULL) {
+    if (count == capacity) {
+      capacity *= 2;
+      float *grown = realloc(buffer, capacity * sizeof(float));
+      if (grown == NULL) {
+        free(buffer);
+        buffer = NULL;
+        break;
+      }
+      buffer = grown;
+    }
+    ma_uint64 read = 0;
+    result = ma_decoder_read_pcm_frames(&decoder, buffer + count,
+                                        capacity - count, &read);
+    count += read;
+    if (result != MA_SUCCESS || read == 0) {
+      break;
+    }
+  }
+  ma_decoder_uninit(&decoder);
+  if (buffer == NULL) {
+    return MA_OUT_OF_MEMORY;
+  }
+  if (result != MA_SUCCESS && result != MA_AT_END) {
+    free(buffer);
+    return result;
+  }
+  *frames = buffer;
+  *frame_count = count;
+  return MA_SUCCESS;
+}
+
+ma_result quality_compare_files(const char *reference_path,
+                                const char *degraded_path,
+                                struct quality_result_t *out) {
+  ma_uint32 sampleRate = 0;
+  float *reference = NULL;
+  ma_uint64 reference_frames = 0;
+  ma_result result = quality_decode(reference_path, &sampleRate, &reference,
+                                    &reference_frames);
+  if (result != MA_SUCCESS) {
+    return result;
+  }
+  float *degraded = NULL;
+  ma_uint64 degraded_frames = 0;
+  result = quality_decode(degraded_path, &sampleRate, &degraded,
+                          &degraded_frames);
+  if (result != MA_SUCCESS) {
+    free(reference);
+    return result;
+  }
+  result = quality_compare(reference, reference_frames, degraded,
+                           degraded_frames, sampleRate, out);
+  free(reference);
+  free(degraded);
+  return result;
+}
@@ -0,0 +1,74 @@
+#define _GNU_SOURCE
+#include "audio_sched.h"
+#include "miniaudio.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+
+static int thread_sched_os_policy(enum thread_sched_policy policy) {
+  switch (policy) {
+  case THREAD_SCHED_FIFO:
+    return SCHED_FIFO;
+  case THREAD_SCHED_RR:
+    return SCHED_RR;
+  default:
+    return SCHED_OTHER;
+  }
+}
+
+static ma_result thread_sched_errno_result(int err) {
+  switch (err) {
+  case EPERM:
+    return MA_ACCESS_DENIED;
+  case EINVAL:
+    return MA_INVALID_ARGS;
+  default:
+    return MA_ERROR;
+  }
+}
+
+ma_result thread_sched_apply(enum thread_sched_policy policy, int priority,
+                             const ma_uint32 *cpus, size_t cpu_count) {
+  const int os_policy = thread_sched_os_policy(policy);
+  struct sched_param param = {0};
+  if (os_policy != SCHED_OTHER) {
+    if (priority < sched_get_priority_min(os_policy) ||
+        priority > sched_get_priority_max(os_policy)) {
+      return MA_INVALID_ARGS;
+    }
+    param.sched_priority = priority;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  const bool pin = cpus != NULL && cpu_count > 0;
+  for (size_t i = 0; pin && i < cpu_count; ++i) {
+    if (cpus[i] >= THREAD_SCHED_MAX_CPUS || cpus[i] >= CPU_SETSIZE) {
+      return MA_INVALID_ARGS;
+    }
+    CPU_SET(cpus[i], &set);
+  }
+  cpu_set_t previous;
+  if (pin) {
+    // pin first, so a real time thread never runs on a core it should not.
+    int err = pthread_getaffinity_np(pthread_self(), sizeof(previous),
+                                     &previous);
+    if (err != 0) {
+      return thread_sched_errno_result(err);
+    }
+    err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err != 0) {
+      return thread_sched_errno_result(err);
+    }
+  }
+  const int err = pthread_setschedparam(pthread_self(), os_policy, &param);
+  if (err != 0) {
+    if (pin) {
+      (void)pthread_setaffinity_np(pthread_self(), sizeof(previous),
+                                   &previous);
+    }
+    return thread_sched_errno_result(err);
+  }
+  return MA_SUCCESS;
+}
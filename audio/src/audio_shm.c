@@ -0,0 +1,323 @@
+#define _GNU_SOURCE
+#include "audio_shm.h"
+#include "miniaudio.h"
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SHM_RING_MAGIC 0x74767368u /* "tvsh" */
+#define SHM_RING_VERSION 1u
+#define SHM_CACHE_LINE 64u
+
+/**
+ * Start of the mapping. The positions live on their own cache lines so
+ * writers claiming slots do not bounce the line the reader updates.
+ */
+struct shm_ring_header {
+  _Atomic ma_uint32 magic;
+  ma_uint32 version;
+  ma_uint32 slot_count;
+  ma_uint32 slot_size;
+  ma_uint32 slot_stride;
+  _Alignas(SHM_CACHE_LINE) _Atomic ma_uint64 write_position;
+  _Alignas(SHM_CACHE_LINE) _Atomic ma_uint64 read_position;
+  /* Bumped on every commit, the reader sleeps on it. */
+  _Alignas(SHM_CACHE_LINE) _Atomic ma_uint32 futex_word;
+  _Atomic ma_uint32 waiters;
+};
+
+/**
+ * Bounded MPMC queue slot, the sequence says whose turn it is: position
+ * when free for the writer of that position, position + 1 once written.
+ */
+struct shm_ring_slot {
+  _Atomic ma_uint64 sequence;
+  ma_uint32 len;
+};
+
+struct shm_ring_t {
+  char *name;
+  bool owner;
+  size_t map_size;
+  struct shm_ring_header *header;
+  unsigned char *slots;
+};
+
+static size_t shm_round_up(size_t value, size_t align) {
+  return (value + align - 1) / align * align;
+}
+
+static size_t shm_header_size(void) {
+  return shm_round_up(sizeof(struct shm_ring_header), SHM_CACHE_LINE);
+}
+
+static struct shm_ring_slot *shm_slot(struct shm_ring_t *r,
+                                      ma_uint64 position) {
+  const ma_uint64 index = position & (r->header->slot_count - 1);
+  return (struct shm_ring_slot *)(r->slots +
+                                  index * r->header->slot_stride);
+}
+
+static void *shm_slot_data(struct shm_ring_slot *slot) {
+  return (unsigned char *)slot +
+         shm_round_up(sizeof(struct shm_ring_slot), SHM_CACHE_LINE);
+}
+
+static struct shm_ring_t *shm_ring_map(const char *name, int fd,
+                                       size_t map_size, bool owner) {
+  void *map =
+      mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    return NULL;
+  }
+  struct shm_ring_t *r = malloc(sizeof(struct shm_ring_t));
+  if (r == NULL) {
+    munmap(map, map_size);
+    return NULL;
+  }
+  r->name = strdup(name);
+  if (r->name == NULL) {
+    munmap(map, map_size);
+    free(r);
+    return NULL;
+  }
+  r->owner = owner;
+  r->map_size = map_size;
+  r->header = map;
+  r->slots = (unsigned char *)map + shm_header_size();
+  return r;
+}
+
+struct shm_ring_t *shm_ring_create(const char *name, ma_uint32 slot_count,
+                                   ma_uint32 slot_size) {
+  if (name == NULL || slot_count == 0 || slot_size == 0) {
+    return NULL;
+  }
+  ma_uint32 count = 1;
+  while (count < slot_count) {
+    count <<= 1;
+  }
+  const size_t stride =
+      shm_round_up(sizeof(struct shm_ring_slot), SHM_CACHE_LINE) +
+      shm_round_up(slot_size, SHM_CACHE_LINE);
+  const size_t map_size = shm_header_size() + stride * count;
+  const int fd = shm_open(name, O_RDWR | O_CREAT, 0600);
+  if (fd < 0) {
+    fprintf(stderr, "shm_open %s failed.\n", name);
+    return NULL;
+  }
+  if (ftruncate(fd, (off_t)map_size) != 0) {
+    fprintf(stderr, "ftruncate %s failed.\n", name);
+    close(fd);
+    return NULL;
+  }
+  struct shm_ring_t *r = shm_ring_map(name, fd, map_size, true);
+  close(fd);
+  if (r == NULL) {
+    return NULL;
+  }
+  struct shm_ring_header *h = r->header;
+  // writers check the magic, hide the ring from them while resetting it.
+  atomic_store_explicit(&h->magic, 0, memory_order_relaxed);
+  h->version = SHM_RING_VERSION;
+  h->slot_count = count;
+  h->slot_size = slot_size;
+  h->slot_stride = (ma_uint32)stride;
+  atomic_store_explicit(&h->write_position, 0, memory_order_relaxed);
+  atomic_store_explicit(&h->read_position, 0, memory_order_relaxed);
+  atomic_store_explicit(&h->futex_word, 0, memory_order_relaxed);
+  atomic_store_explicit(&h->waiters, 0, memory_order_relaxed);
+  for (ma_uint32 i = 0; i < count; ++i) {
+    struct shm_ring_slot *slot = shm_slot(r, i);
+    slot->len = 0;
+    atomic_store_explicit(&slot->sequence, i, memory_order_relaxed);
+  }
+  atomic_store_explicit(&h->magic, SHM_RING_MAGIC, memory_order_release);
+  return r;
+}
+
+struct shm_ring_t *shm_ring_open(const char *name) {
+  if (name == NULL) {
+    return NULL;
+  }
+  const int fd = shm_open(name, O_RDWR, 0600);
+  if (fd < 0) {
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < shm_header_size()) {
+    close(fd);
+    return NULL;
+  }
+  struct shm_ring_t *r = shm_ring_map(name, fd, (size_t)st.st_size, false);
+  close(fd);
+  if (r == NULL) {
+    return NULL;
+  }
+  struct shm_ring_header *h = r->header;
+  const size_t needed =
+      shm_header_size() + (size_t)h->slot_stride * h->slot_count;
+  if (atomic_load_explicit(&h->magic, memory_order_acquire) !=
+          SHM_RING_MAGIC ||
+      h->version != SHM_RING_VERSION || needed > r->map_size) {
+    shm_ring_destroy(&r);
+    return NULL;
+  }
+  return r;
+}
+
+void shm_ring_destroy(struct shm_ring_t **r) {
+  if (r == NULL) {
+    return;
+  }
+  if ((*r) == NULL) {
+    return;
+  }
+  munmap((*r)->header, (*r)->map_size);
+  if ((*r)->owner) {
+    shm_unlink((*r)->name);
+  }
+  free((*r)->name);
+  free(*r);
+  *r = NULL;
+}
+
+ma_result shm_ring_acquire_write(struct shm_ring_t *r,
+                                 struct shm_packet_t *out) {
+  if (r == NULL || out == NULL) {
+    return MA_INVALID_ARGS;
+  }
+  struct shm_ring_header *h = r->header;
+  ma_uint64 position =
+      atomic_load_explicit(&h->write_position, memory_order_relaxed);
+  for (;;) {
+    struct shm_ring_slot *slot = shm_slot(r, position);
+    const ma_uint64 sequence =
+        atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    const ma_int64 diff = (ma_int64)(sequence - position);
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(
+              &h->write_position, &position, position + 1,
+              memory_order_relaxed, memory_order_relaxed)) {
+        out->data = shm_slot_data(slot);
+        out->len = h->slot_size;
+        out->position = position;
+        return MA_SUCCESS;
+      }
+    } else if (diff < 0) {
+      // the reader has not released this slot yet.
+      return MA_NO_SPACE;
+    } else {
+      position =
+          atomic_load_explicit(&h->write_position, memory_order_relaxed);
+    }
+  }
+}
+
+static long shm_futex(_Atomic ma_uint32 *word, int op, ma_uint32 value,
+                      const struct timespec *timeout) {
+  // shared between processes, so not FUTEX_PRIVATE_FLAG.
+  return syscall(SYS_futex, (ma_uint32 *)word, op, value, timeout, NULL, 0);
+}
+
+ma_result shm_ring_commit_write(struct shm_ring_t *r,
+                                struct shm_packet_t *packet) {
+  if (r == NULL || packet == NULL) {
+    return MA_INVALID_ARGS;
+  }
+  struct shm_ring_header *h = r->header;
+  struct shm_ring_slot *slot = shm_slot(r, packet->position);
+  const bool valid = packet->len <= h->slot_size;
+  slot->len = valid ? (ma_uint32)packet->len : 0;
+  atomic_store_explicit(&slot->sequence, packet->position + 1,
+                        memory_order_release);
+  atomic_fetch_add_explicit(&h->futex_word, 1, memory_order_release);
+  if (atomic_load_explicit(&h->waiters, memory_order_seq_cst) > 0) {
+    shm_futex(&h->futex_word, FUTEX_WAKE, 1, NULL);
+  }
+  return valid ? MA_SUCCESS : MA_INVALID_ARGS;
+}
+
+/**
+ * Take the next written slot if there is one.
+ */
+static bool shm_ring_try_read(struct shm_ring_t *r, struct shm_packet_t *out) {
+  struct shm_ring_header *h = r->header;
+  const ma_uint64 position =
+      atomic_load_explicit(&h->read_position, memory_order_relaxed);
+  struct shm_ring_slot *slot = shm_slot(r, position);
+  const ma_uint64 sequence =
+      atomic_load_explicit(&slot->sequence, memory_order_acquire);
+  if (sequence != position + 1) {
+    return false;
+  }
+  out->data = shm_slot_data(slot);
+  out->len = slot->len;
+  out->position = position;
+  return true;
+}
+
+static ma_uint64 shm_now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ma_uint64)ts.tv_sec * 1000ull + (ma_uint64)ts.tv_nsec / 1000000ull;
+}
+
+ma_result shm_ring_acquire_read(struct shm_ring_t *r, struct shm_packet_t *out,
+                                ma_uint32 timeout_ms) {
+  if (r == NULL || out == NULL) {
+    return MA_INVALID_ARGS;
+  }
+  struct shm_ring_header *h = r->header;
+  const ma_uint64 deadline_ms = shm_now_ms() + timeout_ms;
+  for (;;) {
+    if (shm_ring_try_read(r, out)) {
+      if (out->len > 0) {
+        return MA_SUCCESS;
+      }
+      // a writer gave up on its slot.
+      shm_ring_release_read(r, out);
+      continue;
+    }
+    const ma_uint64 now_ms = shm_now_ms();
+    if (now_ms >= deadline_ms) {
+      return MA_TIMEOUT;
+    }
+    const ma_uint32 word =
+        atomic_load_explicit(&h->futex_word, memory_order_acquire);
+    atomic_fetch_add_explicit(&h->waiters, 1, memory_order_seq_cst);
+    // a commit between the first check and here changed the word, so the
+    // wait below returns straight away instead of missing it.
+    if (!shm_ring_try_read(r, out)) {
+      const ma_uint64 wait_ms = deadline_ms - now_ms;
+      const struct timespec timeout = {
+          .tv_sec = (time_t)(wait_ms / 1000),
+          .tv_nsec = (long)(wait_ms % 1000) * 1000000L,
+      };
+      shm_futex(&h->futex_word, FUTEX_WAIT, word, &timeout);
+    }
+    atomic_fetch_sub_explicit(&h->waiters, 1, memory_order_relaxed);
+  }
+}
+
+void shm_ring_release_read(struct shm_ring_t *r, struct shm_packet_t *packet) {
+  if (r == NULL || packet == NULL) {
+    return;
+  }
+  struct shm_ring_header *h = r->header;
+  struct shm_ring_slot *slot = shm_slot(r, packet->position);
+  atomic_store_explicit(&slot->sequence, packet->position + h->slot_count,
+                        memory_order_release);
+  atomic_store_explicit(&h->read_position, packet->position + 1,
+                        memory_order_relaxed);
+}
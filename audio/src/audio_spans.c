@@ -0,0 +1,151 @@
+#include "audio_spans.h"
+
+#ifdef TINY_VC_TRACE_EVENTS
+
+#include "audio_trace.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+
+/**
+ * Threads that can record, and events each of them keeps.
+ * The buffers live in bss, pages are only touched once a thread uses them.
+ */
+#define SPANS_MAX_THREADS 16
+#define SPANS_EVENTS_PER_THREAD (1u << 15)
+
+struct span_event {
+  ma_uint64 ts_ns;
+  const char *name;
+  char phase;
+};
+
+struct span_thread {
+  _Atomic(const char *) name;
+  /* Events published to spans_write_chrome, only the owner writes. */
+  _Atomic ma_uint32 count;
+  _Atomic ma_uint64 dropped;
+  struct span_event events[SPANS_EVENTS_PER_THREAD];
+};
+
+static struct span_thread span_threads[SPANS_MAX_THREADS];
+static _Atomic ma_uint32 span_thread_count = 0;
+static _Thread_local struct span_thread *span_self = NULL;
+/* Set once every slot is taken so later threads stop trying. */
+static _Thread_local bool span_no_slot = false;
+
+/**
+ * Buffer of the calling thread, claimed on first use.
+ */
+static struct span_thread *spans_self(void) {
+  if (span_self != NULL || span_no_slot) {
+    return span_self;
+  }
+  const ma_uint32 index =
+      atomic_fetch_add_explicit(&span_thread_count, 1, memory_order_relaxed);
+  if (index >= SPANS_MAX_THREADS) {
+    span_no_slot = true;
+    return NULL;
+  }
+  span_self = &span_threads[index];
+  return span_self;
+}
+
+static void spans_record(const char *name, char phase) {
+  struct span_thread *t = spans_self();
+  if (t == NULL) {
+    return;
+  }
+  const ma_uint32 count = atomic_load_explicit(&t->count, memory_order_relaxed);
+  if (count >= SPANS_EVENTS_PER_THREAD) {
+    atomic_fetch_add_explicit(&t->dropped, 1, memory_order_relaxed);
+    return;
+  }
+  t->events[count] = (struct span_event){
+      .ts_ns = trace_now_ns(),
+      .name = name,
+      .phase = phase,
+  };
+  atomic_store_explicit(&t->count, count + 1, memory_order_release);
+}
+
+bool spans_enabled(void) { return true; }
+
+void spans_thread_name(const char *name) {
+  struct span_thread *t = spans_self();
+  if (t == NULL ||
+      atomic_load_explicit(&t->name, memory_order_relaxed) != NULL) {
+    return;
+  }
+  atomic_store_explicit(&t->name, name, memory_order_release);
+}
+
+void spans_begin(const char *name) { spans_record(name, 'B'); }
+
+void spans_end(const char *name) { spans_record(name, 'E'); }
+
+ma_result spans_write_chrome(const char *path) {
+  FILE *out = fopen(path, "w");
+  if (out == NULL) {
+    return MA_ERROR;
+  }
+  ma_uint32 threads =
+      atomic_load_explicit(&span_thread_count, memory_order_relaxed);
+  if (threads > SPANS_MAX_THREADS) {
+    threads = SPANS_MAX_THREADS;
+  }
+  fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  const char *separator = "";
+  for (ma_uint32 tid = 0; tid < threads; ++tid) {
+    struct span_thread *t = &span_threads[tid];
+    const char *name = atomic_load_explicit(&t->name, memory_order_acquire);
+    if (name != NULL) {
+      fprintf(out,
+              "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+              "\"args\":{\"name\":\"%s\"}}",
+              separator, tid + 1, name);
+      separator = ",\n";
+    }
+    const ma_uint32 count =
+        atomic_load_explicit(&t->count, memory_order_acquire);
+    for (ma_uint32 i = 0; i < count; ++i) {
+      const struct span_event *e = &t->events[i];
+      fprintf(out,
+              "%s{\"name\":\"%s\",\"ph\":\"%c\",\"pid\":1,\"tid\":%u,"
+              "\"ts\":%llu.%03llu}",
+              separator, e->name, e->phase, tid + 1,
+              (unsigned long long)(e->ts_ns / 1000),
+              (unsigned long long)(e->ts_ns % 1000));
+      separator = ",\n";
+    }
+    const ma_uint64 dropped =
+        atomic_load_explicit(&t->dropped, memory_order_relaxed);
+    if (dropped > 0) {
+      fprintf(stderr, "span thread %u dropped %llu events, buffer full.\n",
+              tid + 1, (unsigned long long)dropped);
+    }
+  }
+  fprintf(out, "\n]}\n");
+  const bool failed = ferror(out) != 0;
+  if (fclose(out) != 0 || failed) {
+    return MA_ERROR;
+  }
+  return MA_SUCCESS;
+}
+
+#else
+
+bool spans_enabled(void) { return false; }
+
+void spans_thread_name(const char *name) { (void)name; }
+
+void spans_begin(const char *name) { (void)name; }
+
+void spans_end(const char *name) { (void)name; }
+
+ma_result spans_write_chrome(const char *path) {
+  (void)path;
+  return MA_NOT_IMPLEMENTED;
+}
+
+#endif
@@ -0,0 +1,168 @@
+#define _POSIX_C_SOURCE 200809L
+#include "audio_trace.h"
+
+#include <stdatomic.h>
+#include <time.h>
+
+/**
+ * Histograms are HDR style, log linear: every power of two range is split
+ * into TRACE_SUB_BUCKETS linear buckets, about 3% precision.
+ * Values are recorded in microseconds and clamped to 32 bits (~71 minutes).
+ */
+#define TRACE_SUB_BUCKET_BITS 5
+#define TRACE_SUB_BUCKETS (1u << TRACE_SUB_BUCKET_BITS)
+#define TRACE_MAX_VALUE 0xFFFFFFFFull
+#define TRACE_BUCKETS                                                          \
+  ((32 - TRACE_SUB_BUCKET_BITS) * TRACE_SUB_BUCKETS + 2 * TRACE_SUB_BUCKETS)
+
+struct trace_histogram {
+  _Atomic ma_uint64 count;
+  _Atomic ma_uint64 sum;
+  _Atomic ma_uint64 max;
+  _Atomic ma_uint64 buckets[TRACE_BUCKETS];
+};
+
+static struct trace_histogram trace_histograms[TRACE_STAGE_COUNT];
+
+static const char *trace_stage_names[TRACE_STAGE_COUNT] = {
+    "capture_read", "ring_write", "pace",    "marshal", "send",
+    "network",      "queue",      "playout", "total",
+};
+
+ma_uint64 trace_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ma_uint64)ts.tv_sec * 1000000000ull + (ma_uint64)ts.tv_nsec;
+}
+
+/**
+ * Bucket of a value. Values under 2 * TRACE_SUB_BUCKETS get their own
+ * bucket, above that each bucket covers 2^shift values.
+ */
+static size_t trace_bucket_index(ma_uint64 value) {
+  if (value < 2 * TRACE_SUB_BUCKETS) {
+    return (size_t)value;
+  }
+  unsigned magnitude = 0;
+  for (ma_uint64 v = value; v > 1; v >>= 1) {
+    ++magnitude;
+  }
+  const unsigned shift = magnitude - TRACE_SUB_BUCKET_BITS;
+  return (size_t)shift * TRACE_SUB_BUCKETS + (size_t)(value >> shift);
+}
+
+/**
+ * Highest value that lands in the given bucket.
+ */
+static ma_uint64 trace_bucket_value(size_t index) {
+  if (index < 2 * TRACE_SUB_BUCKETS) {
+    return index;
+  }
+  const size_t shift = index / TRACE_SUB_BUCKETS - 1;
+  const ma_uint64 low = (ma_uint64)(index - shift * TRACE_SUB_BUCKETS)
+                        << shift;
+  return low + (1ull << shift) - 1;
+}
+
+void trace_record(enum trace_stage stage, ma_uint64 start_ns,
+                  ma_uint64 end_ns) {
+  if (stage >= TRACE_STAGE_COUNT || start_ns == 0) {
+    return;
+  }
+  ma_uint64 value = end_ns > start_ns ? (end_ns - start_ns) / 1000 : 0;
+  if (value > TRACE_MAX_VALUE) {
+    value = TRACE_MAX_VALUE;
+  }
+  struct trace_histogram *h = &trace_histograms[stage];
+  atomic_fetch_add_explicit(&h->buckets[trace_bucket_index(value)], 1,
+                            memory_order_relaxed);
+  atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&h->sum, value, memory_order_relaxed);
+  ma_uint64 max = atomic_load_explicit(&h->max, memory_order_relaxed);
+  while (value > max &&
+         !atomic_compare_exchange_weak_explicit(&h->max, &max, value,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+  }
+}
+
+ma_uint64 trace_percentile_us(enum trace_stage stage, double percentile) {
+  if (stage >= TRACE_STAGE_COUNT) {
+    return 0;
+  }
+  struct trace_histogram *h = &trace_histograms[stage];
+  const ma_uint64 count = atomic_load_explicit(&h->count, memory_order_relaxed);
+  if (count == 0) {
+    return 0;
+  }
+  if (percentile >= 100.0) {
+    return atomic_load_explicit(&h->max, memory_order_relaxed);
+  }
+  ma_uint64 target = (ma_uint64)((percentile / 100.0) * (double)count);
+  if (target == 0) {
+    target = 1;
+  }
+  ma_uint64 seen = 0;
+  for (size_t i = 0; i < TRACE_BUCKETS; ++i) {
+    seen += atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+    if (seen >= target) {
+      const ma_uint64 value = trace_bucket_value(i);
+      const ma_uint64 max = atomic_load_explicit(&h->max, memory_order_relaxed);
+      return value < max ? value : max;
+    }
+  }
+  return atomic_load_explicit(&h->max, memory_order_relaxed);
+}
+
+ma_uint64 trace_count(enum trace_stage stage) {
+  if (stage >= TRACE_STAGE_COUNT) {
+    return 0;
+  }
+  return atomic_load_explicit(&trace_histograms[stage].count,
+                              memory_order_relaxed);
+}
+
+ma_uint64 trace_sum_us(enum trace_stage stage) {
+  if (stage >= TRACE_STAGE_COUNT) {
+    return 0;
+  }
+  return atomic_load_explicit(&trace_histograms[stage].sum,
+                              memory_order_relaxed);
+}
+
+const char *trace_stage_name(enum trace_stage stage) {
+  if (stage >= TRACE_STAGE_COUNT) {
+    return "unknown";
+  }
+  return trace_stage_names[stage];
+}
+
+void trace_print(FILE *out) {
+  if (out == NULL) {
+    out = stdout;
+  }
+  fprintf(out, "%-13s %10s %10s %10s %10s %10s %10s\n", "stage (us)", "count",
+          "p50", "p90", "p99", "p99.9", "max");
+  for (int stage = 0; stage < TRACE_STAGE_COUNT; ++stage) {
+    fprintf(out, "%-13s %10llu %10llu %10llu %10llu %10llu %10llu\n",
+            trace_stage_name(stage), (unsigned long long)trace_count(stage),
+            (unsigned long long)trace_percentile_us(stage, 50.0),
+            (unsigned long long)trace_percentile_us(stage, 90.0),
+            (unsigned long long)trace_percentile_us(stage, 99.0),
+            (unsigned long long)trace_percentile_us(stage, 99.9),
+            (unsigned long long)trace_percentile_us(stage, 100.0));
+  }
+  fflush(out);
+}
+
+void trace_reset(void) {
+  for (int stage = 0; stage < TRACE_STAGE_COUNT; ++stage) {
+    struct trace_histogram *h = &trace_histograms[stage];
+    atomic_store_explicit(&h->count, 0, memory_order_relaxed);
+    atomic_store_explicit(&h->sum, 0, memory_order_relaxed);
+    atomic_store_explicit(&h->max, 0, memory_order_relaxed);
+    for (size_t i = 0; i < TRACE_BUCKETS; ++i) {
+      atomic_store_explicit(&h->buckets[i], 0, memory_order_relaxed);
+    }
+  }
+}
@@ -7,8 +7,15 @@ struct capture_data_t* capture_data_create(size_t len) {
   if (local == NULL) {
     return NULL;
   }
+  local->kind = CAPTURE_DATA_AUDIO;
   local->sizeInFrames = 0;
   local->channels = 0;
+  local->sampleRate = 0;
+  local->stream_id = 0;
+  local->level = 0;
+  local->voice_active = MA_FALSE;
+  local->capture_ns = 0;
+  local->stage_ns = 0;
   local->format = ma_format_unknown;
   local->buffer_len = 0;
   local->buffer = malloc(sizeof(char)*len);
@@ -32,3 +39,14 @@ void capture_data_destroy(struct capture_data_t **cd) {
   free(*cd);
   *cd = NULL;
 }
+
+ma_bool32 capture_data_frames_fit(const struct capture_data_t *cd) {
+  if (cd == NULL || cd->buffer == NULL) {
+    return MA_FALSE;
+  }
+  if (cd->format <= ma_format_unknown || cd->format >= ma_format_count) {
+    return MA_FALSE;
+  }
+  const ma_uint64 frame_size = ma_get_bytes_per_frame(cd->format, cd->channels);
+  return (ma_uint64)cd->sizeInFrames * frame_size <= cd->buffer_len;
+}
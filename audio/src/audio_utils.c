@@ -5,6 +5,12 @@
 #include <math.h>
 #include <stdint.h>
 
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 // https://www.sounddevices.com/32-bit-float-files-explained/
 // TODO add test to verify these values.
 struct db_range get_db_range(ma_format format) {
@@ -24,7 +30,8 @@ struct db_range get_db_range(ma_format format) {
 double get_max_sample(ma_format format) {
   switch (format) {
   case ma_format_f32: {
-    return FLT_MAX;
+    // float samples are normalized to [-1, 1].
+    return 1.0;
   }
   case ma_format_s32: {
     return (double)INT_MAX;
@@ -184,3 +191,58 @@ double audio_get_decibels(const void *input, ma_uint32 frameCount,
   }
   return 20.0 * log10(volume / get_max_sample(format));
 }
+
+ma_uint8 audio_level_quantize(double dBFS) {
+  // NaN and -inf (pure silence) both fall through to silence.
+  if (!(dBFS > -(double)AUDIO_LEVEL_SILENCE)) {
+    return AUDIO_LEVEL_SILENCE;
+  }
+  if (dBFS >= 0.0) {
+    return 0;
+  }
+  return (ma_uint8)lround(-dBFS);
+}
+
+double audio_level_to_decibels(ma_uint8 level) {
+  if (level > AUDIO_LEVEL_SILENCE) {
+    level = AUDIO_LEVEL_SILENCE;
+  }
+  return -(double)level;
+}
+
+void audio_mix_f32(float *dst, const float *src, float gain, size_t len) {
+  size_t i = 0;
+#if defined(__SSE__)
+  const __m128 g = _mm_set1_ps(gain);
+  for (; i + 4 <= len; i += 4) {
+    const __m128 s = _mm_mul_ps(_mm_loadu_ps(src + i), g);
+    _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), s));
+  }
+#elif defined(__ARM_NEON)
+  const float32x4_t g = vdupq_n_f32(gain);
+  for (; i + 4 <= len; i += 4) {
+    vst1q_f32(dst + i, vmlaq_f32(vld1q_f32(dst + i), vld1q_f32(src + i), g));
+  }
+#endif
+  for (; i < len; i++) {
+    dst[i] += src[i] * gain;
+  }
+}
+
+void audio_soft_limit_f32(float *buffer, size_t len, float threshold) {
+  if (threshold <= 0.0f || threshold >= 1.0f) {
+    threshold = 0.8f;
+  }
+  const float headroom = 1.0f - threshold;
+  for (size_t i = 0; i < len; i++) {
+    const float value = buffer[i];
+    const float magnitude = fabsf(value);
+    if (magnitude <= threshold) {
+      continue;
+    }
+    // tanh knee so anything over the threshold approaches full scale.
+    const float limited =
+        threshold + headroom * tanhf((magnitude - threshold) / headroom);
+    buffer[i] = value < 0.0f ? -limited : limited;
+  }
+}
@@ -2,6 +2,7 @@
 #include <signal.h>
 
 #include "audio_capture.h"
+#include "audio_context.h"
 #include "audio_playback.h"
 #include "audio_types.h"
 
@@ -14,8 +15,13 @@ void sigint_handler(int signo) {
 }
 
 int main(void) {
-  struct capture_t *cap = capture_create(100);
-  struct playback_t *play = playback_create(100);
+  struct audio_context_t *ctx = audio_context_create(false, 0);
+  if (ctx == NULL) {
+    fprintf(stderr, "context creation failed.\n");
+    return -1;
+  }
+  struct capture_t *cap = capture_create(ctx, NULL);
+  struct playback_t *play = playback_create(ctx, NULL);
   if (cap == NULL || play == NULL) {
     fprintf(stderr, "creation failed.\n");
     return -1;
@@ -53,5 +59,6 @@ int main(void) {
 
   capture_destroy(&cap);
   playback_destroy(&play);
+  audio_context_destroy(&ctx);
   return 0;
 }
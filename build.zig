@@ -1,12 +1,30 @@
 const std = @import("std");
 
-fn build_audio_lib(b: *std.Build, target: std.Build.ResolvedTarget, optimize: std.builtin.OptimizeMode) *std.Build.Module {
+fn build_audio_lib(b: *std.Build, target: std.Build.ResolvedTarget, optimize: std.builtin.OptimizeMode, trace_events: bool) *std.Build.Module {
     const files: []const []const u8 = &.{
         "audio/src/audio_utils.c",
         "audio/src/audio.c",
         "audio/src/audio_types.c",
+        "audio/src/audio_mixer.c",
+        "audio/src/audio_cng.c",
+        "audio/src/audio_fec.c",
+        "audio/src/audio_convert.c",
+        "audio/src/audio_trace.c",
+        "audio/src/audio_counters.c",
+        "audio/src/audio_deadline.c",
+        "audio/src/audio_spans.c",
+        "audio/src/audio_quality.c",
+        "audio/src/audio_shm.c",
+        "audio/src/audio_pacer.c",
+        "audio/src/audio_sched.c",
+        "audio/src/audio_memory.c",
     };
-    const flags: []const []const u8 = &.{
+    const flags: []const []const u8 = if (trace_events) &.{
+        "-Wall",
+        "-std=c11",
+        "-ggdb",
+        "-DTINY_VC_TRACE_EVENTS",
+    } else &.{
         "-Wall",
         "-std=c11",
         "-ggdb",
@@ -32,6 +50,9 @@ fn build_audio_lib(b: *std.Build, target: std.Build.ResolvedTarget, optimize: st
 pub fn build(b: *std.Build) void {
     const target = b.standardTargetOptions(.{});
     const optimize = b.standardOptimizeOption(.{});
+    const trace_events = b.option(bool, "trace_events", "Record pipeline spans for a Chrome trace event file") orelse false;
+    const options = b.addOptions();
+    options.addOption(bool, "trace_events", trace_events);
     const dep_opts = .{
         .target = target,
         .optimize = optimize,
@@ -53,8 +74,9 @@ pub fn build(b: *std.Build) void {
             },
         }),
     });
+    exe.root_module.addOptions("build_options", options);
     // build and include audio lib
-    const audio_mod = build_audio_lib(b, target, optimize);
+    const audio_mod = build_audio_lib(b, target, optimize, trace_events);
     const audio_lib = b.addLibrary(.{
         .name = "audio",
         .root_module = audio_mod,
@@ -84,4 +106,77 @@ pub fn build(b: *std.Build) void {
 
     const test_step = b.step("test", "Run tests");
     test_step.dependOn(&run_exe_tests.step);
+
+    // load generator, needs a bus but no audio devices.
+    const loadgen = b.addExecutable(.{
+        .name = "tiny_vc_loadgen",
+        .root_module = b.createModule(.{
+            .root_source_file = b.path("src/loadgen.zig"),
+            .target = target,
+            .optimize = optimize,
+            .imports = &.{
+                .{ .name = "chebi", .module = chebi },
+                .{ .name = "clap", .module = clap },
+            },
+        }),
+    });
+    loadgen.addIncludePath(b.path("./audio/headers/"));
+    loadgen.linkLibrary(audio_lib);
+    loadgen.linkLibC();
+    b.installArtifact(loadgen);
+
+    const run_loadgen = b.addRunArtifact(loadgen);
+    run_loadgen.step.dependOn(b.getInstallStep());
+    if (b.args) |args| {
+        run_loadgen.addArgs(args);
+    }
+    const loadgen_step = b.step("loadgen", "Simulate speakers and listeners against a running bus");
+    loadgen_step.dependOn(&run_loadgen.step);
+
+    // micro-benchmarks always run optimized, debug numbers are meaningless.
+    const bench_optimize: std.builtin.OptimizeMode = if (optimize == .Debug) .ReleaseFast else optimize;
+    const bench_audio_lib = b.addLibrary(.{
+        .name = "audio_bench",
+        .root_module = build_audio_lib(b, target, bench_optimize, false),
+    });
+    bench_audio_lib.linkLibC();
+    const bench = b.addExecutable(.{
+        .name = "tiny_vc_bench",
+        .root_module = b.createModule(.{
+            .root_source_file = b.path("src/bench.zig"),
+            .target = target,
+            .optimize = bench_optimize,
+        }),
+    });
+    bench.addIncludePath(b.path("./audio/headers/"));
+    bench.linkLibrary(bench_audio_lib);
+    bench.linkLibC();
+
+    const run_bench = b.addRunArtifact(bench);
+    if (b.args) |args| {
+        run_bench.addArgs(args);
+    }
+    const bench_step = b.step("bench", "Run the micro-benchmarks, results are written to bench.json");
+    bench_step.dependOn(&run_bench.step);
+
+    // quality scoring runs on whole recordings, build it optimized too.
+    const quality = b.addExecutable(.{
+        .name = "tiny_vc_quality",
+        .root_module = b.createModule(.{
+            .root_source_file = b.path("src/quality.zig"),
+            .target = target,
+            .optimize = bench_optimize,
+        }),
+    });
+    quality.addIncludePath(b.path("./audio/headers/"));
+    quality.linkLibrary(bench_audio_lib);
+    quality.linkLibC();
+    b.installArtifact(quality);
+
+    const run_quality = b.addRunArtifact(quality);
+    if (b.args) |args| {
+        run_quality.addArgs(args);
+    }
+    const quality_step = b.step("quality", "Score a degraded recording against its reference");
+    quality_step.dependOn(&run_quality.step);
 }
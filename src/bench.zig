@@ -0,0 +1,296 @@
+const std = @import("std");
+const builtin = @import("builtin");
+const capture = @import("capture_data.zig");
+
+const audio = @cImport({
+    @cInclude("audio_utils.h");
+    @cInclude("audio_types.h");
+});
+
+/// How long each benchmark runs for after warming up.
+const min_run_ns: u64 = std.time.ns_per_ms * 200;
+/// Operations run between timer reads.
+const batch_size: u64 = 64;
+const warmup_ops: usize = 64;
+
+const frame_sizes = [_]u32{ 256, 1024, 4096 };
+
+const Format = struct {
+    name: []const u8,
+    value: audio.ma_format,
+};
+
+const formats = [_]Format{
+    .{ .name = "u8", .value = audio.ma_format_u8 },
+    .{ .name = "s16", .value = audio.ma_format_s16 },
+    .{ .name = "s24", .value = audio.ma_format_s24 },
+    .{ .name = "s32", .value = audio.ma_format_s32 },
+    .{ .name = "f32", .value = audio.ma_format_f32 },
+};
+
+/// Counts allocations made through it.
+const CountingAllocator = struct {
+    child: std.mem.Allocator,
+    allocs: u64 = 0,
+
+    fn allocator(self: *CountingAllocator) std.mem.Allocator {
+        return .{
+            .ptr = self,
+            .vtable = &.{
+                .alloc = alloc,
+                .resize = resize,
+                .remap = remap,
+                .free = free,
+            },
+        };
+    }
+
+    fn alloc(ctx: *anyopaque, len: usize, alignment: std.mem.Alignment, ret_addr: usize) ?[*]u8 {
+        const self: *CountingAllocator = @ptrCast(@alignCast(ctx));
+        self.allocs += 1;
+        return self.child.rawAlloc(len, alignment, ret_addr);
+    }
+
+    fn resize(ctx: *anyopaque, memory: []u8, alignment: std.mem.Alignment, new_len: usize, ret_addr: usize) bool {
+        const self: *CountingAllocator = @ptrCast(@alignCast(ctx));
+        return self.child.rawResize(memory, alignment, new_len, ret_addr);
+    }
+
+    fn remap(ctx: *anyopaque, memory: []u8, alignment: std.mem.Alignment, new_len: usize, ret_addr: usize) ?[*]u8 {
+        const self: *CountingAllocator = @ptrCast(@alignCast(ctx));
+        self.allocs += 1;
+        return self.child.rawRemap(memory, alignment, new_len, ret_addr);
+    }
+
+    fn free(ctx: *anyopaque, memory: []u8, alignment: std.mem.Alignment, ret_addr: usize) void {
+        const self: *CountingAllocator = @ptrCast(@alignCast(ctx));
+        self.child.rawFree(memory, alignment, ret_addr);
+    }
+};
+
+const Result = struct {
+    name: []const u8,
+    format: []const u8,
+    frames: u32,
+    iterations: u64,
+    ns_per_op: f64,
+    ns_per_frame: f64,
+    /// null when the allocations happen in C and are not tracked.
+    allocs_per_op: ?f64,
+};
+
+var g_results: [64]Result = undefined;
+var g_result_count: usize = 0;
+
+/// Run ctx.run() until min_run_ns passed and record the result.
+fn measure(name: []const u8, format: []const u8, frames: u32, counter: ?*CountingAllocator, ctx: anytype) !void {
+    for (0..warmup_ops) |_| {
+        ctx.run();
+    }
+    const allocs_before: u64 = if (counter) |cnt| cnt.allocs else 0;
+    var iterations: u64 = 0;
+    var timer = try std.time.Timer.start();
+    while (timer.read() < min_run_ns) {
+        for (0..batch_size) |_| {
+            ctx.run();
+        }
+        iterations += batch_size;
+    }
+    const elapsed: f64 = @floatFromInt(timer.read());
+    const ops: f64 = @floatFromInt(iterations);
+    var allocs_per_op: ?f64 = null;
+    if (counter) |cnt| {
+        allocs_per_op = @as(f64, @floatFromInt(cnt.allocs - allocs_before)) / ops;
+    }
+    const result: Result = .{
+        .name = name,
+        .format = format,
+        .frames = frames,
+        .iterations = iterations,
+        .ns_per_op = elapsed / ops,
+        .ns_per_frame = elapsed / ops / @as(f64, @floatFromInt(frames)),
+        .allocs_per_op = allocs_per_op,
+    };
+    std.debug.print("{s:<22} {s:<4} {d:>6} frames {d:>12.1} ns/op {d:>8.3} ns/frame\n", .{
+        result.name,
+        result.format,
+        result.frames,
+        result.ns_per_op,
+        result.ns_per_frame,
+    });
+    if (g_result_count < g_results.len) {
+        g_results[g_result_count] = result;
+        g_result_count += 1;
+    }
+}
+
+/// Fill the buffer with a sine in the given format.
+fn fill_sine(alloc: std.mem.Allocator, buffer: []u8, frames: u32, format: audio.ma_format) !void {
+    const sine = try alloc.alloc(f32, frames);
+    defer alloc.free(sine);
+    for (sine, 0..) |*sample, i| {
+        const t: f32 = @floatFromInt(i);
+        sample.* = 0.5 * @sin(t * 2.0 * std.math.pi * 440.0 / 44100.0);
+    }
+    audio.ma_pcm_convert(buffer.ptr, format, sine.ptr, audio.ma_format_f32, frames, audio.ma_dither_mode_none);
+}
+
+const RmsBench = struct {
+    buffer: []const u8,
+    format: audio.ma_format,
+
+    fn run(self: *const RmsBench) void {
+        std.mem.doNotOptimizeAway(audio.calculate_rms(self.buffer.ptr, self.buffer.len, self.format));
+    }
+};
+
+const DecibelBench = struct {
+    buffer: []const u8,
+    frames: u32,
+    format: audio.ma_format,
+
+    fn run(self: *const DecibelBench) void {
+        std.mem.doNotOptimizeAway(audio.audio_get_decibels(self.buffer.ptr, self.frames, self.format, 1));
+    }
+};
+
+const MarshalBench = struct {
+    data: capture.CaptureData,
+
+    fn run(self: *const MarshalBench) void {
+        const marshaled = self.data.marshal() catch @panic("marshal failed");
+        std.mem.doNotOptimizeAway(marshaled.ptr);
+        self.data.alloc.free(marshaled);
+    }
+};
+
+const UnmarshalBench = struct {
+    alloc: std.mem.Allocator,
+    marshaled: []const u8,
+
+    fn run(self: *const UnmarshalBench) void {
+        var data: capture.CaptureData = .init(self.alloc);
+        data.unmarshal(self.marshaled) catch @panic("unmarshal failed");
+        std.mem.doNotOptimizeAway(data.buffer.ptr);
+        data.deinit();
+    }
+};
+
+const CreateBench = struct {
+    len: usize,
+
+    fn run(self: *const CreateBench) void {
+        var cd = audio.capture_data_create(self.len);
+        std.mem.doNotOptimizeAway(cd);
+        audio.capture_data_destroy(&cd);
+    }
+};
+
+const RingBench = struct {
+    rb: *audio.ma_pcm_rb,
+    buffer: []u8,
+    frames: u32,
+
+    fn run(self: *const RingBench) void {
+        const frame_size: usize = @sizeOf(f32);
+        var size: audio.ma_uint32 = self.frames;
+        var ptr: ?*anyopaque = null;
+        if (audio.ma_pcm_rb_acquire_write(self.rb, &size, &ptr) != audio.MA_SUCCESS) {
+            @panic("ma_pcm_rb_acquire_write failed");
+        }
+        @memcpy(@as([*]u8, @ptrCast(ptr.?))[0 .. size * frame_size], self.buffer[0 .. size * frame_size]);
+        _ = audio.ma_pcm_rb_commit_write(self.rb, size);
+        size = self.frames;
+        if (audio.ma_pcm_rb_acquire_read(self.rb, &size, &ptr) != audio.MA_SUCCESS) {
+            @panic("ma_pcm_rb_acquire_read failed");
+        }
+        @memcpy(self.buffer[0 .. size * frame_size], @as([*]const u8, @ptrCast(ptr.?))[0 .. size * frame_size]);
+        _ = audio.ma_pcm_rb_commit_read(self.rb, size);
+    }
+};
+
+fn write_json(path: []const u8) !void {
+    var file = try std.fs.cwd().createFile(path, .{});
+    defer file.close();
+    var line_buffer: [512]u8 = undefined;
+    const header = try std.fmt.bufPrint(&line_buffer, "{{\"optimize\":\"{s}\",\"benchmarks\":[\n", .{@tagName(builtin.mode)});
+    try file.writeAll(header);
+    for (g_results[0..g_result_count], 0..) |result, i| {
+        var allocs_buffer: [32]u8 = undefined;
+        const allocs: []const u8 = if (result.allocs_per_op) |value|
+            try std.fmt.bufPrint(&allocs_buffer, "{d:.3}", .{value})
+        else
+            "null";
+        const line = try std.fmt.bufPrint(
+            &line_buffer,
+            "{{\"name\":\"{s}\",\"format\":\"{s}\",\"frames\":{d},\"iterations\":{d},\"ns_per_op\":{d:.3},\"ns_per_frame\":{d:.4},\"allocs_per_op\":{s}}}{s}\n",
+            .{
+                result.name,
+                result.format,
+                result.frames,
+                result.iterations,
+                result.ns_per_op,
+                result.ns_per_frame,
+                allocs,
+                if (i + 1 < g_result_count) "," else "",
+            },
+        );
+        try file.writeAll(line);
+    }
+    try file.writeAll("]}\n");
+}
+
+pub fn main() !void {
+    const alloc = std.heap.smp_allocator;
+    const args = try std.process.argsAlloc(alloc);
+    defer std.process.argsFree(alloc, args);
+    const output: []const u8 = if (args.len > 1) args[1] else "bench.json";
+
+    var counter: CountingAllocator = .{ .child = alloc };
+    const counted = counter.allocator();
+
+    for (frame_sizes) |frames| {
+        for (formats) |format| {
+            const buffer = try alloc.alloc(u8, frames * audio.ma_get_bytes_per_sample(format.value));
+            defer alloc.free(buffer);
+            try fill_sine(alloc, buffer, frames, format.value);
+            const rms: RmsBench = .{ .buffer = buffer, .format = format.value };
+            try measure("calculate_rms", format.name, frames, null, &rms);
+            const db: DecibelBench = .{ .buffer = buffer, .frames = frames, .format = format.value };
+            try measure("audio_get_decibels", format.name, frames, null, &db);
+        }
+    }
+
+    for (frame_sizes) |frames| {
+        var data: capture.CaptureData = .init(counted);
+        data.sizeInFrames = frames;
+        data.format = @intCast(audio.ma_format_f32);
+        data.channels = 1;
+        data.sampleRate = 44100;
+        data.buffer = try counted.alloc(u8, frames * @sizeOf(f32));
+        defer data.deinit();
+        try fill_sine(alloc, data.buffer, frames, audio.ma_format_f32);
+
+        const marshal: MarshalBench = .{ .data = data };
+        try measure("CaptureData.marshal", "f32", frames, &counter, &marshal);
+
+        const marshaled = try data.marshal();
+        defer counted.free(marshaled);
+        const unmarshal: UnmarshalBench = .{ .alloc = counted, .marshaled = marshaled };
+        try measure("CaptureData.unmarshal", "f32", frames, &counter, &unmarshal);
+
+        const create: CreateBench = .{ .len = frames * @sizeOf(f32) };
+        try measure("capture_data_create", "f32", frames, null, &create);
+
+        var rb: audio.ma_pcm_rb = undefined;
+        if (audio.ma_pcm_rb_init(audio.ma_format_f32, 1, frames * 4, null, null, &rb) != audio.MA_SUCCESS) {
+            return error.ring_buffer_init_failed;
+        }
+        defer audio.ma_pcm_rb_uninit(&rb);
+        const ring: RingBench = .{ .rb = &rb, .buffer = data.buffer, .frames = frames };
+        try measure("ma_pcm_rb", "f32", frames, null, &ring);
+    }
+
+    try write_json(output);
+    std.debug.print("results written to {s}\n", .{output});
+}
@@ -1,56 +1,217 @@
 const std = @import("std");
 
+const Error = error{
+    buffer_too_small,
+    /// Shorter than the fixed part of a packet.
+    truncated_packet,
+    /// Payload length field does not match the rest of the packet.
+    invalid_payload_len,
+};
+
+/// Bit of the marshaled level byte that carries the voice activity flag.
+const level_vad_bit: u8 = 0x80;
+
+/// Size of the fields peek reads: kind, stream_id, sequence, level, timestamp,
+/// capture_ns and marshal_ns.
+const header_size = @sizeOf(u8) + @sizeOf(u32) + @sizeOf(u32) + @sizeOf(u8) + @sizeOf(u32) +
+    @sizeOf(u64) + @sizeOf(u64);
+/// Size of everything before the payload: the header, sizeInFrames, format,
+/// channels, sampleRate and the payload length.
+const fixed_size = header_size + @sizeOf(u32) + @sizeOf(u8) + @sizeOf(u8) + @sizeOf(u32) +
+    @sizeOf(usize);
+
+/// Kind of data a packet holds, mirrors capture_data_kind in audio_types.h.
+pub const Kind = enum(u8) {
+    /// PCM frames.
+    audio = 0,
+    /// Comfort noise descriptor, sent while the sender is silent.
+    comfort_noise = 1,
+    /// FEC parity over a group of packets, see fec.zig. Never reaches audio.
+    fec_parity = 2,
+    /// Listener feedback about a sender, see report.zig. Sent on the report topic.
+    receiver_report = 3,
+    _,
+};
+
 pub const CaptureData = struct {
     alloc: std.mem.Allocator,
+    kind: Kind,
+    /// ID of the sender, used by receivers to mix streams separately.
+    stream_id: u32,
+    /// Per stream packet counter, used to detect and rebuild lost packets.
+    sequence: u32,
+    /// Level of the audio as attenuation from full scale, 0 (loud) to 127 (silence).
+    level: u8,
+    /// If voice activity was detected in the audio.
+    voice_active: bool,
+    /// Media time of the first frame in microseconds, wraps around.
+    timestamp: u32,
+    /// Sender trace clock when the audio was captured, 0 if unknown.
+    capture_ns: u64,
+    /// Sender trace clock when the packet was marshaled, 0 if unknown.
+    marshal_ns: u64,
+    /// Local trace clock of the last stage the data went through, not sent.
+    stage_ns: u64,
     sizeInFrames: u32,
     format: u8,
     channels: u8,
+    sampleRate: u32,
     buffer: []u8,
 
     pub fn init(alloc: std.mem.Allocator) CaptureData {
         const result: CaptureData = .{
             .alloc = alloc,
+            .kind = .audio,
+            .stream_id = 0,
+            .sequence = 0,
+            .level = 127,
+            .voice_active = false,
+            .timestamp = 0,
+            .capture_ns = 0,
+            .marshal_ns = 0,
+            .stage_ns = 0,
             .sizeInFrames = 0,
             .format = 0,
             .channels = 0,
+            .sampleRate = 0,
             .buffer = &.{},
         };
         return result;
     }
 
+    /// Header fields that can be read without unmarshaling the payload.
+    pub const Header = struct {
+        kind: Kind,
+        stream_id: u32,
+        sequence: u32,
+        level: u8,
+        voice_active: bool,
+        timestamp: u32,
+        capture_ns: u64,
+        marshal_ns: u64,
+    };
+
+    /// Peek at the header of a marshaled packet without touching the payload.
+    /// Lets relays and mixers pick active speakers without touching the PCM.
+    pub fn peek(buffer: []const u8) ?Header {
+        if (buffer.len < header_size) {
+            return null;
+        }
+        var offset: usize = 0;
+        const kind: Kind = @enumFromInt(std.mem.readPackedInt(u8, buffer, 0, .little));
+        offset += @sizeOf(u8);
+        const stream_id = std.mem.readPackedInt(u32, buffer[offset..], 0, .little);
+        offset += @sizeOf(u32);
+        const sequence = std.mem.readPackedInt(u32, buffer[offset..], 0, .little);
+        offset += @sizeOf(u32);
+        const level_info = std.mem.readPackedInt(u8, buffer[offset..], 0, .little);
+        offset += @sizeOf(u8);
+        const timestamp = std.mem.readPackedInt(u32, buffer[offset..], 0, .little);
+        offset += @sizeOf(u32);
+        const capture_ns = std.mem.readPackedInt(u64, buffer[offset..], 0, .little);
+        offset += @sizeOf(u64);
+        const marshal_ns = std.mem.readPackedInt(u64, buffer[offset..], 0, .little);
+        return .{
+            .kind = kind,
+            .stream_id = stream_id,
+            .sequence = sequence,
+            .level = level_info & ~level_vad_bit,
+            .voice_active = (level_info & level_vad_bit) != 0,
+            .timestamp = timestamp,
+            .capture_ns = capture_ns,
+            .marshal_ns = marshal_ns,
+        };
+    }
+
     pub fn marshal_size(self: *const CaptureData) usize {
-        return @sizeOf(u32) +
-            @sizeOf(u8) + @sizeOf(u8) +
-            @sizeOf(usize) + self.buffer.len;
+        return fixed_size + self.buffer.len;
     }
 
     pub fn marshal(self: *const CaptureData) ![]const u8 {
+        const buffer: []u8 = try self.alloc.alloc(u8, self.marshal_size());
+        errdefer self.alloc.free(buffer);
+        _ = try self.marshal_into(buffer);
+        return buffer;
+    }
+
+    /// Marshal into a caller provided buffer, e.g. a shared memory slot.
+    /// Returns the number of bytes written.
+    pub fn marshal_into(self: *const CaptureData, out: []u8) !usize {
         const byteSize = self.marshal_size();
-        const buffer: []u8 = try self.alloc.alloc(u8, byteSize);
-        @memset(buffer, 0);
+        if (out.len < byteSize) {
+            return Error.buffer_too_small;
+        }
+        const buffer = out[0..byteSize];
         var offset: usize = 0;
-        std.mem.writePackedInt(u32, buffer, 0, self.sizeInFrames, .little);
+        std.mem.writePackedInt(u8, buffer, 0, @intFromEnum(self.kind), .little);
+        offset += @sizeOf(u8);
+        std.mem.writePackedInt(u32, buffer[offset..], 0, self.stream_id, .little);
+        offset += @sizeOf(u32);
+        std.mem.writePackedInt(u32, buffer[offset..], 0, self.sequence, .little);
+        offset += @sizeOf(u32);
+        var level_info: u8 = self.level & ~level_vad_bit;
+        if (self.voice_active) {
+            level_info |= level_vad_bit;
+        }
+        std.mem.writePackedInt(u8, buffer[offset..], 0, level_info, .little);
+        offset += @sizeOf(u8);
+        std.mem.writePackedInt(u32, buffer[offset..], 0, self.timestamp, .little);
+        offset += @sizeOf(u32);
+        std.mem.writePackedInt(u64, buffer[offset..], 0, self.capture_ns, .little);
+        offset += @sizeOf(u64);
+        std.mem.writePackedInt(u64, buffer[offset..], 0, self.marshal_ns, .little);
+        offset += @sizeOf(u64);
+        std.mem.writePackedInt(u32, buffer[offset..], 0, self.sizeInFrames, .little);
         offset += @sizeOf(u32);
         std.mem.writePackedInt(u8, buffer[offset..], 0, self.format, .little);
         offset += @sizeOf(u8);
         std.mem.writePackedInt(u8, buffer[offset..], 0, self.channels, .little);
         offset += @sizeOf(u8);
+        std.mem.writePackedInt(u32, buffer[offset..], 0, self.sampleRate, .little);
+        offset += @sizeOf(u32);
         std.mem.writePackedInt(usize, buffer[offset..], 0, self.buffer.len, .little);
         offset += @sizeOf(usize);
         @memcpy(buffer[offset..], self.buffer);
-        return buffer;
+        return byteSize;
     }
 
+    /// Unmarshal a packet, the payload is copied into a new buffer.
+    /// Packets come off the network, a truncated or inconsistent one is an
+    /// error and leaves the payload empty.
     pub fn unmarshal(self: *CaptureData, buffer: []const u8) !void {
+        if (buffer.len < fixed_size) {
+            return Error.truncated_packet;
+        }
         var offset: usize = 0;
-        self.sizeInFrames = std.mem.readPackedInt(u32, buffer, 0, .little);
+        self.kind = @enumFromInt(std.mem.readPackedInt(u8, buffer, 0, .little));
+        offset += @sizeOf(u8);
+        self.stream_id = std.mem.readPackedInt(u32, buffer[offset..], 0, .little);
+        offset += @sizeOf(u32);
+        self.sequence = std.mem.readPackedInt(u32, buffer[offset..], 0, .little);
+        offset += @sizeOf(u32);
+        const level_info = std.mem.readPackedInt(u8, buffer[offset..], 0, .little);
+        self.level = level_info & ~level_vad_bit;
+        self.voice_active = (level_info & level_vad_bit) != 0;
+        offset += @sizeOf(u8);
+        self.timestamp = std.mem.readPackedInt(u32, buffer[offset..], 0, .little);
+        offset += @sizeOf(u32);
+        self.capture_ns = std.mem.readPackedInt(u64, buffer[offset..], 0, .little);
+        offset += @sizeOf(u64);
+        self.marshal_ns = std.mem.readPackedInt(u64, buffer[offset..], 0, .little);
+        offset += @sizeOf(u64);
+        self.sizeInFrames = std.mem.readPackedInt(u32, buffer[offset..], 0, .little);
         offset += @sizeOf(u32);
         self.format = std.mem.readPackedInt(u8, buffer[offset..], 0, .little);
         offset += @sizeOf(u8);
         self.channels = std.mem.readPackedInt(u8, buffer[offset..], 0, .little);
         offset += @sizeOf(u8);
+        self.sampleRate = std.mem.readPackedInt(u32, buffer[offset..], 0, .little);
+        offset += @sizeOf(u32);
         const payload_len = std.mem.readPackedInt(usize, buffer[offset..], 0, .little);
         offset += @sizeOf(usize);
+        if (payload_len != buffer.len - offset) {
+            return Error.invalid_payload_len;
+        }
         self.buffer = try self.alloc.alloc(u8, payload_len);
         @memcpy(self.buffer, buffer[offset..]);
     }
@@ -59,3 +220,45 @@ pub const CaptureData = struct {
         self.alloc.free(self.buffer);
     }
 };
+
+test "unmarshal round trip" {
+    const alloc = std.testing.allocator;
+    var payload = [_]u8{ 1, 2, 3, 4, 5 };
+    var cd: CaptureData = .init(alloc);
+    cd.stream_id = 7;
+    cd.sequence = 42;
+    cd.level = 9;
+    cd.voice_active = true;
+    cd.buffer = &payload;
+    const packet = try cd.marshal();
+    defer alloc.free(packet);
+
+    var out: CaptureData = .init(alloc);
+    defer out.deinit();
+    try out.unmarshal(packet);
+    try std.testing.expectEqual(@as(u32, 7), out.stream_id);
+    try std.testing.expectEqual(@as(u32, 42), out.sequence);
+    try std.testing.expectEqual(@as(u8, 9), out.level);
+    try std.testing.expect(out.voice_active);
+    try std.testing.expectEqualSlices(u8, &payload, out.buffer);
+}
+
+test "unmarshal rejects truncated and inconsistent packets" {
+    const alloc = std.testing.allocator;
+    var payload = [_]u8{ 1, 2, 3, 4, 5 };
+    var cd: CaptureData = .init(alloc);
+    cd.buffer = &payload;
+    const packet = try cd.marshal();
+    defer alloc.free(packet);
+
+    var out: CaptureData = .init(alloc);
+    defer out.deinit();
+    try std.testing.expectError(Error.truncated_packet, out.unmarshal(packet[0 .. fixed_size - 1]));
+    try std.testing.expectError(Error.invalid_payload_len, out.unmarshal(packet[0 .. packet.len - 1]));
+    const padded = try alloc.alloc(u8, packet.len + 1);
+    defer alloc.free(padded);
+    @memcpy(padded[0..packet.len], packet);
+    padded[packet.len] = 0;
+    try std.testing.expectError(Error.invalid_payload_len, out.unmarshal(padded));
+    try std.testing.expectEqual(@as(usize, 0), out.buffer.len);
+}
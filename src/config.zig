@@ -1,32 +1,131 @@
 const std = @import("std");
 const clap = @import("clap");
+const impair = @import("impair.zig");
+const sched = @import("sched.zig");
 
 const Error = error {
     invalid_mode,
+    invalid_fec,
+    invalid_topics,
 };
 
 pub const Config = struct {
     alloc: std.mem.Allocator,
     ip: []const u8,
     port: u16,
-    topic: []const u8,
+    /// Topics (rooms) to publish and play back on, one session each.
+    topics: []const []const u8,
+    /// ID this node sends its audio under, receivers mix each ID separately.
+    stream_id: u32,
+    /// Number of packets in each FEC group.
+    fec_group: u8 = 4,
+    /// Number of FEC parity packets sent per group, 0 disables FEC.
+    fec_parity: u8 = 0,
     capture_only: bool = false,
     playback_only: bool = false,
+    /// Run on the null audio backend instead of sound hardware.
+    headless: bool = false,
+    /// Headless only: WAV file captured instead of the microphone.
+    input_wav: ?[:0]const u8 = null,
+    /// Headless only: WAV file playback is written to.
+    output_wav: ?[:0]const u8 = null,
+    /// Seconds between latency trace dumps, 0 only dumps on SIGUSR1.
+    trace_interval: u32 = 0,
+    /// Receiver clock minus sender clock, for cross host one way latency.
+    clock_offset_us: i64 = 0,
+    /// Chrome trace event file spans are written to, needs -Dtrace_events.
+    trace_events_file: ?[:0]const u8 = null,
+    /// Carry audio over shared memory instead of the bus, same host only.
+    shm: bool = false,
+    /// Network impairment applied to everything received, off when null.
+    impair: ?impair.Config = null,
+    /// Time every audio callback against its period.
+    deadline_monitor: bool = false,
+    /// Local port /metrics is served on, 0 disables it.
+    metrics_port: u16 = 0,
+    /// Release packets at the cadence of their audio instead of as soon as they are ready.
+    pace: bool = true,
+    /// Open the audio devices with small periods, the low latency profile and exclusive mode.
+    low_latency: bool = false,
+    /// Device period to ask for in microseconds, 0 for the profile's default.
+    period_us: u32 = 0,
+    /// Scheduling policy, priority and CPU affinity of the pipeline threads.
+    sched: sched.Config = .{},
+    /// Lock audio rings and device buffers into RAM, prefaulted.
+    lock_memory: bool = false,
+    /// Put large audio rings on huge pages.
+    huge_pages: bool = false,
+    /// Resample each sender to follow its clock so its playout delay stays put.
+    drift_compensation: bool = true,
 
     pub fn deinit(self: *Config) void {
         self.alloc.free(self.ip);
-        self.alloc.free(self.topic);
+        for (self.topics) |topic| {
+            self.alloc.free(topic);
+        }
+        self.alloc.free(self.topics);
+        if (self.input_wav) |input_wav| {
+            self.alloc.free(input_wav);
+        }
+        if (self.output_wav) |output_wav| {
+            self.alloc.free(output_wav);
+        }
+        if (self.trace_events_file) |trace_events_file| {
+            self.alloc.free(trace_events_file);
+        }
     }
 };
 
+/// Owned copies of the --topic values, "test" when none were given.
+fn topics_config(alloc: std.mem.Allocator, args: []const []const u8) ![]const []const u8 {
+    const given: []const []const u8 = if (args.len > 0) args else &.{"test"};
+    for (given, 0..) |topic, i| {
+        if (topic.len == 0) {
+            std.log.info("--topic cannot be empty.", .{});
+            return Error.invalid_topics;
+        }
+        for (given[0..i]) |other| {
+            if (std.mem.eql(u8, topic, other)) {
+                std.log.info("--topic {s} is given more than once.", .{topic});
+                return Error.invalid_topics;
+            }
+        }
+    }
+    const topics = try alloc.alloc([]const u8, given.len);
+    for (given, 0..) |topic, i| {
+        topics[i] = try alloc.dupe(u8, topic);
+    }
+    return topics;
+}
+
 pub fn config(alloc: std.mem.Allocator) !Config {
     const params = comptime clap.parseParamsComptime(
         \\ -h, --help           Display this help and exit.
         \\ --ip <str>           Connection IP of message bus.
         \\ -p, --port <u16>     Port of the message bus.
-        \\ -t, --topic <str>    Topic to connect to.
+        \\ -t, --topic <str>... Topic to connect to, repeat to join several rooms. Defaults to test.
+        \\ --stream_id <u32>    ID to send audio under. Defaults to a random ID.
+        \\ --fec_group <u8>     Number of packets in each FEC group. Defaults to 4.
+        \\ --fec_parity <u8>    Number of FEC parity packets per group. Defaults to 0 (off).
         \\ --capture_only       Start the application as capture only.
         \\ --playback_only      Start the application as playback only.
+        \\ --headless           Use a null audio device instead of sound hardware.
+        \\ --input_wav <str>    Capture this WAV file instead of the microphone. Implies --headless.
+        \\ --output_wav <str>   Write playback to this WAV file. Implies --headless.
+        \\ --trace_interval <u32>  Seconds between latency trace dumps. Defaults to 0 (SIGUSR1 only).
+        \\ --clock_offset_us <i64> Receiver minus sender clock offset for one way latency. Defaults to 0.
+        \\ --trace_events_file <str>  Where spans go when built with -Dtrace_events. Defaults to trace_events.json.
+        \\ --shm                Carry audio to a playback_only process on this host over shared memory.
+        \\ --impair <str>       Emulate a bad network on receive, e.g. "loss=2%,burst=5%:30%,jitter=20,reorder=1%,dup=1%,rate=128,seed=7".
+        \\ --deadline_monitor   Time every audio callback against its period deadline.
+        \\ --metrics_port <u16>  Serve Prometheus metrics on localhost at this port. Defaults to 0 (off).
+        \\ --no_pace            Send packets as soon as they are ready instead of at the audio cadence.
+        \\ --low_latency        Ask the audio devices for small periods and exclusive mode.
+        \\ --period_us <u32>    Audio device period in microseconds, e.g. 2500, 5000 or 10000. Defaults to 5000 with --low_latency, else the backend's.
+        \\ --lock_memory        Prefault audio rings and device buffers and lock them into RAM.
+        \\ --huge_pages         Put large audio rings on huge pages.
+        \\ --no_drift_compensation Play senders at their nominal rate instead of following their clock.
+        \\ --sched <str>...     Thread scheduling, e.g. "capture=fifo:80@2". Threads: capture, broadcast, receive, playout.
     );
     var diag = clap.Diagnostic{};
     var res = clap.parse(clap.Help, &params, clap.parsers.default, .{
@@ -42,7 +141,8 @@ pub fn config(alloc: std.mem.Allocator) !Config {
         .alloc = alloc,
         .ip = try alloc.dupe(u8, "127.0.0.1"),
         .port = 3000,
-        .topic = try alloc.dupe(u8, "test"),
+        .topics = &.{},
+        .stream_id = std.crypto.random.int(u32),
     };
 
     if (res.args.help != 0) {
@@ -54,8 +154,19 @@ pub fn config(alloc: std.mem.Allocator) !Config {
     if (res.args.port) |port| {
         conf.port = port;
     }
-    if (res.args.topic) |topic| {
-        conf.topic = try alloc.dupe(u8, topic);
+    conf.topics = try topics_config(alloc, res.args.topic);
+    if (res.args.stream_id) |stream_id| {
+        conf.stream_id = stream_id;
+    }
+    if (res.args.fec_group) |fec_group| {
+        conf.fec_group = fec_group;
+    }
+    if (res.args.fec_parity) |fec_parity| {
+        conf.fec_parity = fec_parity;
+    }
+    if (conf.fec_group == 0 or conf.fec_group > 64 or conf.fec_parity > 64) {
+        std.log.info("fec_group must be between 1 and 64 and fec_parity at most 64.", .{});
+        return Error.invalid_fec;
     }
     if (res.args.capture_only != 0) {
         conf.capture_only = true;
@@ -63,10 +174,72 @@ pub fn config(alloc: std.mem.Allocator) !Config {
     if (res.args.playback_only != 0) {
         conf.playback_only = true;
     }
+    if (res.args.headless != 0) {
+        conf.headless = true;
+    }
+    if (res.args.input_wav) |input_wav| {
+        conf.input_wav = try alloc.dupeZ(u8, input_wav);
+        conf.headless = true;
+    }
+    if (res.args.output_wav) |output_wav| {
+        conf.output_wav = try alloc.dupeZ(u8, output_wav);
+        conf.headless = true;
+    }
+    if (res.args.trace_interval) |trace_interval| {
+        conf.trace_interval = trace_interval;
+    }
+    if (res.args.clock_offset_us) |clock_offset_us| {
+        conf.clock_offset_us = clock_offset_us;
+    }
+    if (res.args.trace_events_file) |trace_events_file| {
+        conf.trace_events_file = try alloc.dupeZ(u8, trace_events_file);
+    }
+    if (res.args.shm != 0) {
+        conf.shm = true;
+    }
+    if (res.args.impair) |spec| {
+        conf.impair = impair.Config.parse(spec) catch |err| {
+            std.log.info("invalid --impair spec: {s}", .{spec});
+            return err;
+        };
+    }
+    if (res.args.deadline_monitor != 0) {
+        conf.deadline_monitor = true;
+    }
+    if (res.args.metrics_port) |metrics_port| {
+        conf.metrics_port = metrics_port;
+    }
+    if (res.args.no_pace != 0) {
+        conf.pace = false;
+    }
+    if (res.args.low_latency != 0) {
+        conf.low_latency = true;
+    }
+    if (res.args.period_us) |period_us| {
+        conf.period_us = period_us;
+    }
+    if (res.args.lock_memory != 0) {
+        conf.lock_memory = true;
+    }
+    if (res.args.huge_pages != 0) {
+        conf.huge_pages = true;
+    }
+    if (res.args.no_drift_compensation != 0) {
+        conf.drift_compensation = false;
+    }
+    for (res.args.sched) |spec| {
+        conf.sched.add(spec) catch |err| {
+            std.log.info("invalid --sched spec: {s}", .{spec});
+            return err;
+        };
+    }
     if (conf.capture_only and conf.playback_only) {
         std.log.info("capture_only and playback_only flags cannot be both set at the same time.\n", .{});
         return Error.invalid_mode;
     }
-    std.log.info("configuration loaded: ip = {s}, port = {}, topic = {s}, capture_only = {}, playback_only = {}\n", .{conf.ip, conf.port, conf.topic, conf.capture_only, conf.playback_only});
+    std.log.info("configuration loaded: ip = {s}, port = {}, topics = {d}, stream_id = {}, fec = {}:{}, capture_only = {}, playback_only = {}, headless = {}", .{conf.ip, conf.port, conf.topics.len, conf.stream_id, conf.fec_group, conf.fec_parity, conf.capture_only, conf.playback_only, conf.headless});
+    for (conf.topics) |topic| {
+        std.log.info("topic: {s}", .{topic});
+    }
     return conf;
 }
@@ -0,0 +1,707 @@
+const std = @import("std");
+const capture = @import("capture_data.zig");
+
+const c = @cImport({
+    @cInclude("audio_fec.h");
+});
+
+/// Maximum number of data or parity packets in one group.
+pub const max_shards: usize = @intCast(c.FEC_MAX_SHARDS);
+
+/// Parity payload starts with the group size, parity count and parity index.
+const parity_header_size = 3 * @sizeOf(u8);
+/// Every shard starts with the length of the packet it protects.
+const length_prefix_size = @sizeOf(u32);
+
+const Error = error{
+    invalid_packet,
+    invalid_group,
+    encode_failed,
+};
+
+/// Fill a shard with the length prefixed packet, zero padded.
+fn fill_shard(shard: []u8, packet: []const u8) void {
+    @memset(shard, 0);
+    std.mem.writePackedInt(u32, shard, 0, @intCast(packet.len), .little);
+    @memcpy(shard[length_prefix_size..][0..packet.len], packet);
+}
+
+/// Signed distance between two sequence numbers, handles wrap around.
+fn sequence_distance(a: u32, b: u32) i32 {
+    return @bitCast(a -% b);
+}
+
+/// Sender side, adds parity packets over groups of sent packets.
+pub const Encoder = struct {
+    alloc: std.mem.Allocator,
+    group_size: u8,
+    parity_count: u8,
+    base_sequence: u32 = 0,
+    count: usize = 0,
+    packets: [max_shards][]const u8 = undefined,
+
+    pub fn init(alloc: std.mem.Allocator, group_size: u8, parity_count: u8) Encoder {
+        var result: Encoder = .{
+            .alloc = alloc,
+            .group_size = 1,
+            .parity_count = 0,
+        };
+        result.configure(group_size, parity_count);
+        return result;
+    }
+
+    pub fn deinit(self: *Encoder) void {
+        self.reset();
+    }
+
+    /// Change the ratio, the current partial group is dropped.
+    /// A parity count of 0 disables FEC.
+    pub fn configure(self: *Encoder, group_size: u8, parity_count: u8) void {
+        self.reset();
+        self.group_size = @intCast(std.math.clamp(group_size, 1, max_shards));
+        self.parity_count = @intCast(@min(parity_count, max_shards));
+    }
+
+    pub fn enabled(self: *const Encoder) bool {
+        return self.parity_count > 0;
+    }
+
+    fn reset(self: *Encoder) void {
+        for (self.packets[0..self.count]) |packet| {
+            self.alloc.free(packet);
+        }
+        self.count = 0;
+    }
+
+    /// Add a marshaled packet that was just sent.
+    /// Once a group is complete the marshaled parity packets are returned,
+    /// the caller owns both the slice and the packets.
+    pub fn add(self: *Encoder, stream_id: u32, sequence: u32, packet: []const u8) !?[][]const u8 {
+        if (!self.enabled()) {
+            return null;
+        }
+        if (self.count == 0) {
+            self.base_sequence = sequence;
+        }
+        self.packets[self.count] = try self.alloc.dupe(u8, packet);
+        self.count += 1;
+        if (self.count < self.group_size) {
+            return null;
+        }
+        defer self.reset();
+        return try self.encode(stream_id);
+    }
+
+    fn encode(self: *Encoder, stream_id: u32) ![][]const u8 {
+        const k = self.count;
+        const m: usize = self.parity_count;
+        var shard_len: usize = 0;
+        for (self.packets[0..k]) |packet| {
+            shard_len = @max(shard_len, packet.len);
+        }
+        shard_len += length_prefix_size;
+        const data = try self.alloc.alloc(u8, k * shard_len);
+        defer self.alloc.free(data);
+        const parity = try self.alloc.alloc(u8, m * shard_len);
+        defer self.alloc.free(parity);
+        var data_ptrs: [max_shards][*c]const u8 = undefined;
+        var parity_ptrs: [max_shards][*c]u8 = undefined;
+        for (self.packets[0..k], 0..) |packet, i| {
+            const shard = data[i * shard_len ..][0..shard_len];
+            fill_shard(shard, packet);
+            data_ptrs[i] = shard.ptr;
+        }
+        for (0..m) |i| {
+            parity_ptrs[i] = parity[i * shard_len ..].ptr;
+        }
+        const result = c.fec_encode(&data_ptrs, @intCast(k), &parity_ptrs, @intCast(m), shard_len);
+        if (result != c.MA_SUCCESS) {
+            return Error.encode_failed;
+        }
+        const out = try self.alloc.alloc([]const u8, m);
+        var built: usize = 0;
+        errdefer {
+            for (out[0..built]) |packet| {
+                self.alloc.free(packet);
+            }
+            self.alloc.free(out);
+        }
+        const payload = try self.alloc.alloc(u8, parity_header_size + shard_len);
+        defer self.alloc.free(payload);
+        for (0..m) |i| {
+            payload[0] = @intCast(k);
+            payload[1] = @intCast(m);
+            payload[2] = @intCast(i);
+            @memcpy(payload[parity_header_size..], parity[i * shard_len ..][0..shard_len]);
+            var cd: capture.CaptureData = .init(self.alloc);
+            cd.kind = .fec_parity;
+            cd.stream_id = stream_id;
+            cd.sequence = self.base_sequence;
+            cd.buffer = payload;
+            out[i] = try cd.marshal();
+            built += 1;
+        }
+        return out;
+    }
+};
+
+/// Receiver side, rebuilds lost packets from parity packets and hands every
+/// packet out in sequence order.
+/// Streams that never sent parity are passed straight through.
+pub const Decoder = struct {
+    alloc: std.mem.Allocator,
+    streams: std.AutoHashMap(u32, *Stream),
+    ready: [ready_len][]const u8 = undefined,
+    ready_head: usize = 0,
+    ready_count: usize = 0,
+
+    const history_len = 256;
+    const group_slots = 4;
+    const ready_len = 2 * history_len;
+
+    const Entry = struct {
+        sequence: u32 = 0,
+        valid: bool = false,
+        delivered: bool = false,
+        data: ?[]const u8 = null,
+    };
+
+    const Group = struct {
+        valid: bool = false,
+        done: bool = false,
+        base: u32 = 0,
+        group_size: u8 = 0,
+        parity_count: u8 = 0,
+        shard_len: usize = 0,
+        parity: [max_shards]?[]const u8 = [_]?[]const u8{null} ** max_shards,
+
+        fn contains(self: *const Group, sequence: u32) bool {
+            return (sequence -% self.base) < self.group_size;
+        }
+    };
+
+    const Stream = struct {
+        /// Set once a parity packet was seen, packets are held in order after that.
+        protected: bool = false,
+        /// Next sequence to hand out.
+        next_sequence: u32 = 0,
+        /// Highest sequence received.
+        highest: u32 = 0,
+        /// How far ahead packets may get before a missing one is given up on.
+        window: i32 = 0,
+        history: [history_len]Entry = [_]Entry{.{}} ** history_len,
+        groups: [group_slots]Group = [_]Group{.{}} ** group_slots,
+        next_group: usize = 0,
+
+        fn entry(self: *Stream, sequence: u32) ?*Entry {
+            const result = &self.history[sequence % history_len];
+            if (result.valid and result.sequence == sequence) {
+                return result;
+            }
+            return null;
+        }
+    };
+
+    pub fn init(alloc: std.mem.Allocator) Decoder {
+        return .{
+            .alloc = alloc,
+            .streams = .init(alloc),
+        };
+    }
+
+    pub fn deinit(self: *Decoder) void {
+        var it = self.streams.valueIterator();
+        while (it.next()) |stream| {
+            for (&stream.*.history) |*entry| {
+                self.clear_entry(entry);
+            }
+            for (&stream.*.groups) |*group| {
+                self.clear_group(group);
+            }
+            self.alloc.destroy(stream.*);
+        }
+        self.streams.deinit();
+        while (self.next()) |packet| {
+            self.alloc.free(packet);
+        }
+    }
+
+    /// Push a received marshaled packet, data or parity.
+    pub fn push(self: *Decoder, packet: []const u8) !void {
+        const header = capture.CaptureData.peek(packet) orelse return Error.invalid_packet;
+        const stream = try self.get_stream(header.stream_id);
+        if (header.kind == .fec_parity) {
+            var parity: capture.CaptureData = .init(self.alloc);
+            defer parity.deinit();
+            try parity.unmarshal(packet);
+            try self.on_parity(stream, &parity);
+        } else {
+            try self.on_data(stream, header.sequence, packet);
+        }
+        try self.release(stream);
+    }
+
+    /// Next marshaled packet ready to play, the caller owns it.
+    pub fn next(self: *Decoder) ?[]const u8 {
+        if (self.ready_count == 0) {
+            return null;
+        }
+        const packet = self.ready[self.ready_head];
+        self.ready_head = (self.ready_head + 1) % ready_len;
+        self.ready_count -= 1;
+        return packet;
+    }
+
+    fn push_ready(self: *Decoder, packet: []const u8) !void {
+        const copy = try self.alloc.dupe(u8, packet);
+        if (self.ready_count == ready_len) {
+            // caller is not draining, drop the oldest.
+            if (self.next()) |oldest| {
+                self.alloc.free(oldest);
+            }
+        }
+        self.ready[(self.ready_head + self.ready_count) % ready_len] = copy;
+        self.ready_count += 1;
+    }
+
+    fn get_stream(self: *Decoder, stream_id: u32) !*Stream {
+        const result = try self.streams.getOrPut(stream_id);
+        if (!result.found_existing) {
+            const stream = self.alloc.create(Stream) catch |err| {
+                _ = self.streams.remove(stream_id);
+                return err;
+            };
+            stream.* = .{};
+            result.value_ptr.* = stream;
+        }
+        return result.value_ptr.*;
+    }
+
+    fn clear_entry(self: *Decoder, entry: *Entry) void {
+        if (entry.data) |data| {
+            self.alloc.free(data);
+        }
+        entry.* = .{};
+    }
+
+    fn free_parity(self: *Decoder, group: *Group) void {
+        for (&group.parity) |*parity| {
+            if (parity.*) |data| {
+                self.alloc.free(data);
+            }
+            parity.* = null;
+        }
+    }
+
+    fn clear_group(self: *Decoder, group: *Group) void {
+        self.free_parity(group);
+        group.* = .{};
+    }
+
+    /// Drop everything held for a stream and start it over at `sequence`.
+    /// Packets pass straight through again until the next parity packet.
+    fn reset_stream(self: *Decoder, stream: *Stream, sequence: u32) void {
+        for (&stream.history) |*entry| {
+            self.clear_entry(entry);
+        }
+        for (&stream.groups) |*group| {
+            self.clear_group(group);
+        }
+        stream.* = .{ .highest = sequence };
+    }
+
+    fn on_data(self: *Decoder, stream: *Stream, sequence: u32, packet: []const u8) !void {
+        if (stream.protected and
+            @abs(sequence_distance(sequence, stream.next_sequence)) > history_len)
+        {
+            // the sender restarted its sequence, or jumped further than the
+            // history reaches. Neither dropping it as late nor stepping up
+            // to it one sequence at a time would ever catch up.
+            self.reset_stream(stream, sequence);
+        }
+        if (stream.entry(sequence) != null) {
+            // duplicate, or already rebuilt from parity.
+            return;
+        }
+        if (!stream.protected) {
+            const entry = &stream.history[sequence % history_len];
+            self.clear_entry(entry);
+            entry.* = .{ .sequence = sequence, .valid = true, .delivered = true };
+            stream.highest = sequence;
+            return self.push_ready(packet);
+        }
+        if (sequence_distance(sequence, stream.next_sequence) < 0) {
+            // too late, it has already been skipped over.
+            return;
+        }
+        const entry = &stream.history[sequence % history_len];
+        self.clear_entry(entry);
+        entry.* = .{
+            .sequence = sequence,
+            .valid = true,
+            .data = try self.alloc.dupe(u8, packet),
+        };
+        if (sequence_distance(sequence, stream.highest) > 0) {
+            stream.highest = sequence;
+        }
+        // a late packet can complete a group whose parity is already here.
+        for (&stream.groups) |*group| {
+            if (group.valid and group.contains(sequence)) {
+                try self.recover(stream, group);
+            }
+        }
+    }
+
+    fn on_parity(self: *Decoder, stream: *Stream, parity: *const capture.CaptureData) !void {
+        if (parity.buffer.len <= parity_header_size + length_prefix_size) {
+            return Error.invalid_group;
+        }
+        const group_size = parity.buffer[0];
+        const parity_count = parity.buffer[1];
+        const index = parity.buffer[2];
+        if (group_size == 0 or group_size > max_shards or
+            parity_count > max_shards or index >= parity_count)
+        {
+            return Error.invalid_group;
+        }
+        const shard = parity.buffer[parity_header_size..];
+        if (!stream.protected) {
+            // everything up to here has already been handed out.
+            stream.protected = true;
+            stream.next_sequence = stream.highest +% 1;
+        }
+        stream.window = @as(i32, group_size) + parity_count + 1;
+        const group = self.find_group(stream, parity.sequence, group_size, parity_count, shard.len);
+        if (group.done or group.shard_len != shard.len or
+            group.group_size != group_size or group.parity_count != parity_count)
+        {
+            return;
+        }
+        if (group.parity[index] == null) {
+            group.parity[index] = try self.alloc.dupe(u8, shard);
+        }
+        try self.recover(stream, group);
+    }
+
+    fn find_group(self: *Decoder, stream: *Stream, base: u32, group_size: u8, parity_count: u8, shard_len: usize) *Group {
+        for (&stream.groups) |*group| {
+            if (group.valid and group.base == base) {
+                return group;
+            }
+        }
+        const group = &stream.groups[stream.next_group];
+        stream.next_group = (stream.next_group + 1) % group_slots;
+        self.clear_group(group);
+        group.* = .{
+            .valid = true,
+            .base = base,
+            .group_size = group_size,
+            .parity_count = parity_count,
+            .shard_len = shard_len,
+        };
+        return group;
+    }
+
+    fn recover(self: *Decoder, stream: *Stream, group: *Group) !void {
+        if (group.done) {
+            return;
+        }
+        const k: usize = group.group_size;
+        const m: usize = group.parity_count;
+        const shard_len = group.shard_len;
+        var present: [2 * max_shards]u8 = @splat(0);
+        var missing: usize = 0;
+        var needed: usize = 0;
+        var parities: usize = 0;
+        for (0..k) |i| {
+            const entry_opt = stream.entry(group.base +% @as(u32, @intCast(i)));
+            if (entry_opt) |entry| {
+                if (entry.data) |data| {
+                    if (data.len + length_prefix_size > shard_len) {
+                        return Error.invalid_group;
+                    }
+                    present[i] = 1;
+                    continue;
+                }
+            } else {
+                needed += 1;
+            }
+            missing += 1;
+        }
+        for (0..m) |i| {
+            if (group.parity[i] != null) {
+                present[k + i] = 1;
+                parities += 1;
+            }
+        }
+        if (needed == 0) {
+            group.done = true;
+            self.free_parity(group);
+            return;
+        }
+        if (missing > parities) {
+            return;
+        }
+        const shards = try self.alloc.alloc(u8, (k + m) * shard_len);
+        defer self.alloc.free(shards);
+        var shard_ptrs: [2 * max_shards][*c]u8 = undefined;
+        for (0..k + m) |i| {
+            const shard = shards[i * shard_len ..][0..shard_len];
+            shard_ptrs[i] = shard.ptr;
+            if (present[i] == 0) {
+                continue;
+            }
+            if (i < k) {
+                const entry = stream.entry(group.base +% @as(u32, @intCast(i))).?;
+                fill_shard(shard, entry.data.?);
+            } else {
+                @memcpy(shard, group.parity[i - k].?);
+            }
+        }
+        const result = c.fec_decode(&shard_ptrs, &present, @intCast(k), @intCast(m), shard_len);
+        if (result != c.MA_SUCCESS) {
+            return;
+        }
+        for (0..k) |i| {
+            const sequence = group.base +% @as(u32, @intCast(i));
+            if (present[i] != 0 or stream.entry(sequence) != null) {
+                continue;
+            }
+            if (sequence_distance(sequence, stream.next_sequence) < 0) {
+                continue;
+            }
+            const shard = shards[i * shard_len ..][0..shard_len];
+            const len = std.mem.readPackedInt(u32, shard, 0, .little);
+            if (len + length_prefix_size > shard_len) {
+                continue;
+            }
+            const entry = &stream.history[sequence % history_len];
+            self.clear_entry(entry);
+            entry.* = .{
+                .sequence = sequence,
+                .valid = true,
+                .data = try self.alloc.dupe(u8, shard[length_prefix_size..][0..len]),
+            };
+        }
+        group.done = true;
+        self.free_parity(group);
+    }
+
+    /// Hand out every packet that is next in sequence, skipping over missing
+    /// packets once the stream has moved on past any chance of rebuilding them.
+    fn release(self: *Decoder, stream: *Stream) !void {
+        if (!stream.protected) {
+            return;
+        }
+        while (sequence_distance(stream.highest, stream.next_sequence) >= 0) {
+            if (stream.entry(stream.next_sequence)) |entry| {
+                if (!entry.delivered) {
+                    if (entry.data) |data| {
+                        try self.push_ready(data);
+                    }
+                    entry.delivered = true;
+                }
+            } else if (sequence_distance(stream.highest, stream.next_sequence) < stream.window) {
+                return;
+            }
+            stream.next_sequence +%= 1;
+        }
+    }
+};
+
+test "fec_decode rebuilds any lost shards up to the parity count" {
+    const k = 5;
+    const m = 3;
+    // one AVX2 block, one SSSE3 block and a scalar tail.
+    const len = 32 + 16 + 5;
+    var data: [k * len]u8 = undefined;
+    for (&data, 0..) |*byte, i| {
+        byte.* = @truncate(i *% 73 +% 11);
+    }
+    var parity: [m * len]u8 = undefined;
+    var data_ptrs: [k][*c]const u8 = undefined;
+    var parity_ptrs: [m][*c]u8 = undefined;
+    for (0..k) |i| {
+        data_ptrs[i] = data[i * len ..].ptr;
+    }
+    for (0..m) |i| {
+        parity_ptrs[i] = parity[i * len ..].ptr;
+    }
+    try std.testing.expect(c.fec_encode(&data_ptrs, k, &parity_ptrs, m, len) == c.MA_SUCCESS);
+
+    var shards: [(k + m) * len]u8 = undefined;
+    var shard_ptrs: [k + m][*c]u8 = undefined;
+    var present: [k + m]u8 = undefined;
+    for (0..1 << (k + m)) |lost| {
+        for (0..k + m) |i| {
+            const shard = shards[i * len ..][0..len];
+            shard_ptrs[i] = shards[i * len ..].ptr;
+            if ((lost >> @intCast(i)) & 1 != 0) {
+                @memset(shard, 0xaa);
+                present[i] = 0;
+            } else if (i < k) {
+                @memcpy(shard, data[i * len ..][0..len]);
+                present[i] = 1;
+            } else {
+                @memcpy(shard, parity[(i - k) * len ..][0..len]);
+                present[i] = 1;
+            }
+        }
+        const result = c.fec_decode(&shard_ptrs, &present, k, m, len);
+        if (@popCount(lost) > m) {
+            try std.testing.expect(result == c.MA_INVALID_DATA);
+            continue;
+        }
+        try std.testing.expect(result == c.MA_SUCCESS);
+        try std.testing.expectEqualSlices(u8, &data, shards[0 .. k * len]);
+    }
+}
+
+/// Marshaled audio packet whose payload and length depend on the sequence.
+fn test_packet(alloc: std.mem.Allocator, stream_id: u32, sequence: u32) ![]const u8 {
+    var payload: [64]u8 = undefined;
+    // lengths differ so shards are padded to the longest packet.
+    const len = 16 + sequence % 48;
+    for (payload[0..len], 0..) |*byte, i| {
+        byte.* = @truncate(sequence *% 31 +% @as(u32, @intCast(i)));
+    }
+    var cd: capture.CaptureData = .init(alloc);
+    cd.stream_id = stream_id;
+    cd.sequence = sequence;
+    cd.buffer = payload[0..len];
+    return cd.marshal();
+}
+
+/// Send groups through an Encoder and a Decoder, losing `lost` data packets
+/// of every group but the first and the last and as many parity packets as
+/// can be spared. Every packet must come out rebuilt and in order.
+fn expect_recovery(first_sequence: u32, group_size: u8, parity_count: u8, lost: usize) !void {
+    const alloc = std.testing.allocator;
+    const stream_id: u32 = 9;
+    const groups = 6;
+    const k: usize = group_size;
+    var encoder: Encoder = .init(alloc, group_size, parity_count);
+    defer encoder.deinit();
+    var decoder: Decoder = .init(alloc);
+    defer decoder.deinit();
+    var sequence = first_sequence;
+    var expected = first_sequence;
+    for (0..groups) |g| {
+        // the first group turns protection on, the last one moves the
+        // stream past the rebuilt packets of the one before.
+        const lossy = g != 0 and g != groups - 1;
+        for (0..k) |i| {
+            const packet = try test_packet(alloc, stream_id, sequence);
+            defer alloc.free(packet);
+            const parity_opt = try encoder.add(stream_id, sequence, packet);
+            sequence +%= 1;
+            // a different run of packets goes missing in every group.
+            if (!lossy or (i + k - g % k) % k >= lost) {
+                try decoder.push(packet);
+            }
+            const parity = parity_opt orelse continue;
+            defer {
+                for (parity) |p| {
+                    alloc.free(p);
+                }
+                alloc.free(parity);
+            }
+            try std.testing.expectEqual(@as(usize, parity_count), parity.len);
+            for (parity, 0..) |p, index| {
+                // keep just enough parity, rebuilding must not rely on the first rows.
+                if (!lossy or index >= parity.len - lost) {
+                    try decoder.push(p);
+                }
+            }
+        }
+        while (decoder.next()) |out| {
+            defer alloc.free(out);
+            var cd: capture.CaptureData = .init(alloc);
+            defer cd.deinit();
+            try cd.unmarshal(out);
+            try std.testing.expectEqual(expected, cd.sequence);
+            const want = try test_packet(alloc, stream_id, expected);
+            defer alloc.free(want);
+            try std.testing.expectEqualSlices(u8, want, out);
+            expected +%= 1;
+        }
+    }
+    try std.testing.expectEqual(sequence, expected);
+}
+
+test "decoder rebuilds up to parity_count lost packets per group" {
+    for (1..4) |lost| {
+        try expect_recovery(1000, 4, 3, lost);
+    }
+    try expect_recovery(1000, 8, 1, 1);
+    try expect_recovery(1000, 1, 1, 1);
+}
+
+test "decoder rebuilds across sequence wraparound" {
+    for (1..3) |lost| {
+        try expect_recovery(std.math.maxInt(u32) - 9, 4, 2, lost);
+    }
+}
+
+/// Send `count` packets from `first` and their parity through a Decoder,
+/// losing none. Every packet must come out in order as soon as it is pushed.
+fn expect_passed(encoder: *Encoder, decoder: *Decoder, stream_id: u32, first: u32, count: usize) !void {
+    const alloc = std.testing.allocator;
+    var expected = first;
+    for (0..count) |i| {
+        const sequence = first +% @as(u32, @intCast(i));
+        const packet = try test_packet(alloc, stream_id, sequence);
+        defer alloc.free(packet);
+        try decoder.push(packet);
+        const parity_opt = try encoder.add(stream_id, sequence, packet);
+        if (parity_opt) |parity| {
+            defer {
+                for (parity) |p| {
+                    alloc.free(p);
+                }
+                alloc.free(parity);
+            }
+            for (parity) |p| {
+                try decoder.push(p);
+            }
+        }
+        while (decoder.next()) |out| {
+            defer alloc.free(out);
+            const header = capture.CaptureData.peek(out).?;
+            try std.testing.expectEqual(expected, header.sequence);
+            expected +%= 1;
+        }
+        try std.testing.expectEqual(sequence +% 1, expected);
+    }
+}
+
+test "decoder starts over when a sender restarts its sequence" {
+    const alloc = std.testing.allocator;
+    const stream_id: u32 = 9;
+    var decoder: Decoder = .init(alloc);
+    defer decoder.deinit();
+    var encoder: Encoder = .init(alloc, 4, 1);
+    defer encoder.deinit();
+    try expect_passed(&encoder, &decoder, stream_id, 5000, 12);
+    try std.testing.expect(decoder.streams.get(stream_id).?.protected);
+    // same stream id, a new sender counting from 0.
+    var restarted: Encoder = .init(alloc, 4, 1);
+    defer restarted.deinit();
+    try expect_passed(&restarted, &decoder, stream_id, 0, 12);
+    try std.testing.expect(decoder.streams.get(stream_id).?.protected);
+}
+
+test "decoder starts over when a stream jumps far ahead" {
+    const alloc = std.testing.allocator;
+    const stream_id: u32 = 9;
+    var decoder: Decoder = .init(alloc);
+    defer decoder.deinit();
+    var encoder: Encoder = .init(alloc, 4, 1);
+    defer encoder.deinit();
+    try expect_passed(&encoder, &decoder, stream_id, 1000, 12);
+    // far enough that stepping up to it would take about 2^31 iterations.
+    try expect_passed(&encoder, &decoder, stream_id, 1000 + 0x7fff_0000, 12);
+    const stream = decoder.streams.get(stream_id).?;
+    try std.testing.expect(stream.protected);
+    try std.testing.expectEqual(@as(u32, 1000 + 0x7fff_0000 + 12), stream.next_sequence);
+}
@@ -0,0 +1,328 @@
+const std = @import("std");
+
+const Error = error{
+    invalid_impairment,
+};
+
+/// Network conditions to emulate, parsed from a netem style spec.
+pub const Config = struct {
+    /// Random loss probability, 0 to 1.
+    loss: f64 = 0,
+    /// Gilbert-Elliott burst loss, chance of moving from the good to the bad
+    /// state and back on every packet. Off while burst_p is 0.
+    burst_p: f64 = 0,
+    burst_r: f64 = 1,
+    /// Loss probability while in the bad state.
+    burst_loss: f64 = 1,
+    /// Base one way delay added to every packet.
+    delay_ms: u32 = 0,
+    /// Uniform random delay on top of delay_ms.
+    jitter_ms: u32 = 0,
+    /// Probability a packet is held back behind the ones after it.
+    reorder: f64 = 0,
+    /// Probability a packet is delivered twice.
+    duplicate: f64 = 0,
+    /// Link rate in kbit/s, 0 is unlimited.
+    rate_kbps: u32 = 0,
+    /// Packets queued behind the rate cap longer than this are dropped.
+    queue_ms: u32 = 200,
+    seed: u64 = 1,
+
+    /// Parse a comma separated list of key=value pairs, for example
+    /// "loss=2%,burst=5%:30%,delay=40,jitter=20,reorder=1%,dup=1%,rate=128,seed=7".
+    /// Probabilities take a fraction or a percentage.
+    pub fn parse(spec: []const u8) !Config {
+        var result: Config = .{};
+        var it = std.mem.tokenizeScalar(u8, spec, ',');
+        while (it.next()) |pair| {
+            const eq = std.mem.indexOfScalar(u8, pair, '=') orelse return Error.invalid_impairment;
+            const key = std.mem.trim(u8, pair[0..eq], " ");
+            const value = std.mem.trim(u8, pair[eq + 1 ..], " ");
+            if (std.mem.eql(u8, key, "loss")) {
+                result.loss = try parse_probability(value);
+            } else if (std.mem.eql(u8, key, "burst")) {
+                // p:r or p:r:loss
+                var parts = std.mem.splitScalar(u8, value, ':');
+                result.burst_p = try parse_probability(parts.next() orelse return Error.invalid_impairment);
+                result.burst_r = try parse_probability(parts.next() orelse return Error.invalid_impairment);
+                if (parts.next()) |burst_loss| {
+                    result.burst_loss = try parse_probability(burst_loss);
+                }
+            } else if (std.mem.eql(u8, key, "delay")) {
+                result.delay_ms = try std.fmt.parseInt(u32, value, 10);
+            } else if (std.mem.eql(u8, key, "jitter")) {
+                result.jitter_ms = try std.fmt.parseInt(u32, value, 10);
+            } else if (std.mem.eql(u8, key, "reorder")) {
+                result.reorder = try parse_probability(value);
+            } else if (std.mem.eql(u8, key, "dup")) {
+                result.duplicate = try parse_probability(value);
+            } else if (std.mem.eql(u8, key, "rate")) {
+                result.rate_kbps = try std.fmt.parseInt(u32, value, 10);
+            } else if (std.mem.eql(u8, key, "queue")) {
+                result.queue_ms = try std.fmt.parseInt(u32, value, 10);
+            } else if (std.mem.eql(u8, key, "seed")) {
+                result.seed = try std.fmt.parseInt(u64, value, 10);
+            } else {
+                return Error.invalid_impairment;
+            }
+        }
+        return result;
+    }
+
+    fn parse_probability(value: []const u8) !f64 {
+        var result: f64 = 0;
+        if (std.mem.endsWith(u8, value, "%")) {
+            result = try std.fmt.parseFloat(f64, value[0 .. value.len - 1]) / 100.0;
+        } else {
+            result = try std.fmt.parseFloat(f64, value);
+        }
+        if (result < 0 or result > 1) {
+            return Error.invalid_impairment;
+        }
+        return result;
+    }
+};
+
+const Delayed = struct {
+    deliver_ns: u64,
+    /// Order of arrival, keeps packets due at the same time in order.
+    order: u64,
+    data: []u8,
+
+    fn compare(_: void, a: Delayed, b: Delayed) std.math.Order {
+        const order = std.math.order(a.deliver_ns, b.deliver_ns);
+        if (order != .eq) {
+            return order;
+        }
+        return std.math.order(a.order, b.order);
+    }
+};
+
+/// Counts of what the impairment did, for reporting.
+pub const Stats = struct {
+    passed: u64 = 0,
+    lost_random: u64 = 0,
+    lost_burst: u64 = 0,
+    lost_queue: u64 = 0,
+    duplicated: u64 = 0,
+    reordered: u64 = 0,
+};
+
+/// In process impairment between the transport and the receive loop.
+/// Every random decision comes from one seeded generator, so a run over the
+/// same input packets is reproducible. Single threaded.
+pub const Impairment = struct {
+    alloc: std.mem.Allocator,
+    config: Config,
+    prng: std.Random.DefaultPrng,
+    queue: std.PriorityQueue(Delayed, void, Delayed.compare),
+    /// Gilbert-Elliott state.
+    bad_state: bool = false,
+    /// When the emulated link finishes sending what is already queued.
+    link_free_ns: u64 = 0,
+    order: u64 = 0,
+    stats: Stats = .{},
+
+    pub fn init(alloc: std.mem.Allocator, config: Config) Impairment {
+        return .{
+            .alloc = alloc,
+            .config = config,
+            .prng = .init(config.seed),
+            .queue = .init(alloc, {}),
+        };
+    }
+
+    pub fn deinit(self: *Impairment) void {
+        while (self.queue.removeOrNull()) |delayed| {
+            self.alloc.free(delayed.data);
+        }
+        self.queue.deinit();
+    }
+
+    fn chance(self: *Impairment, probability: f64) bool {
+        if (probability <= 0) {
+            return false;
+        }
+        return self.prng.random().float(f64) < probability;
+    }
+
+    fn lost(self: *Impairment) bool {
+        if (self.config.burst_p > 0) {
+            if (self.bad_state) {
+                self.bad_state = !self.chance(self.config.burst_r);
+            } else {
+                self.bad_state = self.chance(self.config.burst_p);
+            }
+            if (self.bad_state and self.chance(self.config.burst_loss)) {
+                self.stats.lost_burst += 1;
+                return true;
+            }
+        }
+        if (self.chance(self.config.loss)) {
+            self.stats.lost_random += 1;
+            return true;
+        }
+        return false;
+    }
+
+    /// Delay of one copy of a packet, rate cap not included.
+    fn delay_ns(self: *Impairment) u64 {
+        var delay: u64 = @as(u64, self.config.delay_ms) * std.time.ns_per_ms;
+        if (self.config.jitter_ms > 0) {
+            delay += self.prng.random().uintLessThan(u64, @as(u64, self.config.jitter_ms) * std.time.ns_per_ms);
+        }
+        if (self.chance(self.config.reorder)) {
+            // held back long enough for the packets behind it to overtake.
+            delay += @as(u64, @max(self.config.jitter_ms, 10)) * 2 * std.time.ns_per_ms;
+            self.stats.reordered += 1;
+        }
+        return delay;
+    }
+
+    fn enqueue(self: *Impairment, payload: []const u8, deliver_ns: u64) !void {
+        const data = try self.alloc.dupe(u8, payload);
+        errdefer self.alloc.free(data);
+        try self.queue.add(.{ .deliver_ns = deliver_ns, .order = self.order, .data = data });
+        self.order += 1;
+    }
+
+    /// Feed in a packet that just arrived. The payload is copied.
+    pub fn push(self: *Impairment, payload: []const u8, now_ns: u64) !void {
+        if (self.lost()) {
+            return;
+        }
+        var sent_ns = now_ns;
+        if (self.config.rate_kbps > 0) {
+            const start_ns = @max(now_ns, self.link_free_ns);
+            if (start_ns - now_ns > @as(u64, self.config.queue_ms) * std.time.ns_per_ms) {
+                self.stats.lost_queue += 1;
+                return;
+            }
+            const bits: u64 = payload.len * 8;
+            // kbit/s is bits per ms, so bits * 1e6 / kbps is ns.
+            self.link_free_ns = start_ns + bits * std.time.ns_per_ms / self.config.rate_kbps;
+            sent_ns = self.link_free_ns;
+        }
+        try self.enqueue(payload, sent_ns + self.delay_ns());
+        if (self.chance(self.config.duplicate)) {
+            self.stats.duplicated += 1;
+            try self.enqueue(payload, sent_ns + self.delay_ns());
+        }
+        self.stats.passed += 1;
+    }
+
+    /// Next packet due by now_ns, null if none is.
+    /// Caller owns the returned packet.
+    pub fn pop(self: *Impairment, now_ns: u64) ?[]u8 {
+        const next = self.queue.peek() orelse return null;
+        if (next.deliver_ns > now_ns) {
+            return null;
+        }
+        return self.queue.remove().data;
+    }
+};
+
+test "parse accepts the documented spec" {
+    const config = try Config.parse("loss=2%,burst=5%:30%,delay=40,jitter=20,reorder=1%,dup=1%,rate=128,seed=7");
+    try std.testing.expectApproxEqAbs(0.02, config.loss, 1e-9);
+    try std.testing.expectApproxEqAbs(0.05, config.burst_p, 1e-9);
+    try std.testing.expectApproxEqAbs(0.3, config.burst_r, 1e-9);
+    try std.testing.expectApproxEqAbs(1.0, config.burst_loss, 1e-9);
+    try std.testing.expectEqual(@as(u32, 40), config.delay_ms);
+    try std.testing.expectEqual(@as(u32, 20), config.jitter_ms);
+    try std.testing.expectApproxEqAbs(0.01, config.reorder, 1e-9);
+    try std.testing.expectApproxEqAbs(0.01, config.duplicate, 1e-9);
+    try std.testing.expectEqual(@as(u32, 128), config.rate_kbps);
+    try std.testing.expectEqual(@as(u32, 200), config.queue_ms);
+    try std.testing.expectEqual(@as(u64, 7), config.seed);
+
+    const fractions = try Config.parse(" loss = 0.5 ,burst=0.1:0.2:0.9,queue=50");
+    try std.testing.expectApproxEqAbs(0.5, fractions.loss, 1e-9);
+    try std.testing.expectApproxEqAbs(0.9, fractions.burst_loss, 1e-9);
+    try std.testing.expectEqual(@as(u32, 50), fractions.queue_ms);
+}
+
+test "parse rejects bad keys and probabilities" {
+    const specs = [_][]const u8{
+        "latency=40",
+        "loss",
+        "loss=150%",
+        "loss=-1%",
+        "dup=1.5",
+        "burst=5%",
+        "burst=5%:130%",
+    };
+    for (specs) |spec| {
+        try std.testing.expectError(Error.invalid_impairment, Config.parse(spec));
+    }
+    // numbers that do not parse are rejected too.
+    if (Config.parse("delay=soon")) |_| {
+        return error.TestUnexpectedResult;
+    } else |_| {}
+}
+
+/// Send 500 packets 10 ms apart through an impairment, and write the
+/// sequence of every packet that comes out, in order of delivery.
+/// Returns how many came out.
+fn run_impairment(config: Config, out: []u32) !usize {
+    var impairment: Impairment = .init(std.testing.allocator, config);
+    defer impairment.deinit();
+    var delivered: usize = 0;
+    for (0..500) |i| {
+        var payload: [32]u8 = @splat(0);
+        std.mem.writeInt(u32, payload[0..4], @intCast(i), .little);
+        const now_ns: u64 = i * 10 * std.time.ns_per_ms;
+        try impairment.push(&payload, now_ns);
+        while (impairment.pop(now_ns)) |packet| {
+            defer std.testing.allocator.free(packet);
+            out[delivered] = std.mem.readInt(u32, packet[0..4], .little);
+            delivered += 1;
+        }
+    }
+    while (impairment.pop(std.math.maxInt(u64))) |packet| {
+        defer std.testing.allocator.free(packet);
+        out[delivered] = std.mem.readInt(u32, packet[0..4], .little);
+        delivered += 1;
+    }
+    return delivered;
+}
+
+test "the same seed gives the same losses and deliveries" {
+    const spec = "loss=10%,burst=5%:30%,delay=40,jitter=20,reorder=5%,dup=5%,seed=7";
+    var first: [1000]u32 = undefined;
+    var second: [1000]u32 = undefined;
+    const first_len = try run_impairment(try Config.parse(spec), &first);
+    const second_len = try run_impairment(try Config.parse(spec), &second);
+    try std.testing.expectEqualSlices(u32, first[0..first_len], second[0..second_len]);
+    // the impairment did do something.
+    try std.testing.expect(first_len != 500 or !std.sort.isSorted(u32, first[0..first_len], {}, std.sort.asc(u32)));
+
+    var reseeded_config = try Config.parse(spec);
+    reseeded_config.seed = 8;
+    var reseeded: [1000]u32 = undefined;
+    const reseeded_len = try run_impairment(reseeded_config, &reseeded);
+    try std.testing.expect(!std.mem.eql(u32, first[0..first_len], reseeded[0..reseeded_len]));
+}
+
+test "rate drops packets queued longer than queue_ms" {
+    // 1000 bytes at 64 kbit/s take 125 ms on the link.
+    var impairment: Impairment = .init(std.testing.allocator, .{ .rate_kbps = 64, .queue_ms = 300 });
+    defer impairment.deinit();
+    var payload: [1000]u8 = @splat(0);
+    for (0..5) |_| {
+        try impairment.push(&payload, 0);
+    }
+    // the 4th would wait 375 ms for the link.
+    try std.testing.expectEqual(@as(u64, 3), impairment.stats.passed);
+    try std.testing.expectEqual(@as(u64, 2), impairment.stats.lost_queue);
+    // once the link has drained it takes packets again.
+    try impairment.push(&payload, 375 * std.time.ns_per_ms);
+    try std.testing.expectEqual(@as(u64, 4), impairment.stats.passed);
+
+    try std.testing.expect(impairment.pop(125 * std.time.ns_per_ms - 1) == null);
+    for (1..5) |i| {
+        const packet = impairment.pop(i * 125 * std.time.ns_per_ms) orelse return error.TestUnexpectedResult;
+        std.testing.allocator.free(packet);
+    }
+    try std.testing.expect(impairment.pop(std.math.maxInt(u64)) == null);
+}
@@ -0,0 +1,343 @@
+const std = @import("std");
+const clap = @import("clap");
+const chebi = @import("chebi");
+const client = chebi.client;
+const capture = @import("capture_data.zig");
+const report = @import("report.zig");
+
+const audio = @cImport({
+    @cInclude("audio_trace.h");
+});
+
+/// ma_format_f32 from miniaudio.h.
+const format_f32: u8 = 5;
+
+const Options = struct {
+    ip: []const u8 = "127.0.0.1",
+    port: u16 = 3000,
+    topic_prefix: []const u8 = "loadgen_",
+    speakers: u32 = 10,
+    topics: u32 = 1,
+    listeners: u32 = 1,
+    duration_s: u32 = 10,
+    period_ms: u32 = 10,
+    sample_rate: u32 = 44100,
+};
+
+var g_running: std.atomic.Value(bool) = .init(true);
+var g_alloc = std.heap.smp_allocator;
+
+/// One simulated sender, publishes a packet every period like a capture would.
+const Speaker = struct {
+    options: *const Options,
+    topic: []const u8,
+    stream_id: u32,
+    /// Synthetic audio shared by every speaker, read only.
+    payload: []const u8,
+    sent: u64 = 0,
+    send_failures: u64 = 0,
+    /// Periods the speaker woke up after the next one was already due.
+    late: u64 = 0,
+
+    fn run(self: *Speaker) void {
+        self.run_loop() catch |err| {
+            std.debug.print("speaker {d} stopped: {any}\n", .{ self.stream_id, err });
+        };
+    }
+
+    fn run_loop(self: *Speaker) !void {
+        const addr = try std.net.Address.parseIp4(self.options.ip, self.options.port);
+        var c = try client.Client.init(g_alloc, addr);
+        defer c.deinit();
+        try c.connect();
+
+        const period_ns: u64 = @as(u64, self.options.period_ms) * std.time.ns_per_ms;
+        const frames: u32 = @intCast(self.payload.len / @sizeOf(f32));
+        var data: capture.CaptureData = .init(g_alloc);
+        data.stream_id = self.stream_id;
+        data.level = 20;
+        data.voice_active = true;
+        data.sizeInFrames = frames;
+        data.format = format_f32;
+        data.channels = 1;
+        data.sampleRate = self.options.sample_rate;
+        // not owned, the payload is shared.
+        data.buffer = @constCast(self.payload);
+
+        var media_frames: u64 = 0;
+        var next_ns = audio.trace_now_ns();
+        while (g_running.load(.monotonic)) {
+            data.sequence +%= 1;
+            data.timestamp = @truncate(media_frames * std.time.us_per_s / self.options.sample_rate);
+            media_frames += frames;
+            data.capture_ns = audio.trace_now_ns();
+            data.marshal_ns = data.capture_ns;
+            const marshal_data = try data.marshal();
+            defer g_alloc.free(marshal_data);
+            var msg = try chebi.message.Message.init_with_body(g_alloc, self.topic, marshal_data, .text);
+            defer msg.deinit();
+            if (c.write_msg(&msg)) |_| {
+                self.sent += 1;
+            } else |_| {
+                self.send_failures += 1;
+            }
+
+            // schedule on absolute time so slow sends do not drift the cadence.
+            next_ns += period_ns;
+            const now_ns = audio.trace_now_ns();
+            if (now_ns >= next_ns) {
+                self.late += 1;
+                continue;
+            }
+            std.Thread.sleep(next_ns - now_ns);
+        }
+    }
+};
+
+/// One simulated listener, measures every speaker on its topic.
+const Listener = struct {
+    options: *const Options,
+    topic: []const u8,
+    /// Guards stats and received, the summary is read from the main thread.
+    mutex: std.Thread.Mutex = .{},
+    stats: std.AutoHashMap(u32, report.ReceiverStats),
+    received: u64 = 0,
+    subscribed: std.atomic.Value(bool) = .init(false),
+
+    fn run(self: *Listener) void {
+        self.run_loop() catch |err| {
+            std.debug.print("listener on {s} stopped: {any}\n", .{ self.topic, err });
+        };
+        // let the main thread stop waiting on a listener that failed.
+        self.subscribed.store(true, .monotonic);
+    }
+
+    fn run_loop(self: *Listener) !void {
+        const addr = try std.net.Address.parseIp4(self.options.ip, self.options.port);
+        var c = try client.Client.init(g_alloc, addr);
+        defer c.deinit();
+        try c.connect();
+        try c.subscribe(self.topic);
+        self.subscribed.store(true, .monotonic);
+
+        while (g_running.load(.monotonic)) {
+            var msg = try c.next_msg();
+            defer msg.deinit();
+            const receive_ns = audio.trace_now_ns();
+            const payload = msg.payload orelse continue;
+            const header = capture.CaptureData.peek(payload) orelse continue;
+            if (header.kind != .audio) {
+                continue;
+            }
+            audio.trace_record(audio.TRACE_NETWORK, header.marshal_ns, receive_ns);
+            self.mutex.lock();
+            defer self.mutex.unlock();
+            self.received += 1;
+            const entry = try self.stats.getOrPut(header.stream_id);
+            if (!entry.found_existing) {
+                entry.value_ptr.* = .{};
+            }
+            entry.value_ptr.on_packet(header.sequence, header.timestamp, std.time.microTimestamp());
+        }
+    }
+};
+
+const usage =
+    \\ -h, --help           Display this help and exit.
+    \\ --ip <str>           Connection IP of message bus.
+    \\ -p, --port <u16>     Port of the message bus.
+    \\ --topic_prefix <str> Prefix of the generated topics. Defaults to loadgen_.
+    \\ --speakers <u32>     Number of simulated speakers. Defaults to 10.
+    \\ --topics <u32>       Number of topics (rooms) speakers are spread over. Defaults to 1.
+    \\ --listeners <u32>    Number of simulated listeners, spread over the topics. Defaults to 1.
+    \\ --duration <u32>     Seconds to run for. Defaults to 10.
+    \\ --period_ms <u32>    Milliseconds of audio in each packet. Defaults to 10.
+    \\ --sample_rate <u32>  Sample rate of the synthetic audio. Defaults to 44100.
+;
+
+fn parse_options(alloc: std.mem.Allocator) !Options {
+    const params = comptime clap.parseParamsComptime(usage);
+    var diag = clap.Diagnostic{};
+    var res = clap.parse(clap.Help, &params, clap.parsers.default, .{
+        .allocator = alloc,
+        .diagnostic = &diag,
+    }) catch |err| {
+        try diag.reportToFile(.stderr(), err);
+        return err;
+    };
+    defer res.deinit();
+
+    var options: Options = .{};
+    if (res.args.help != 0) {
+        std.debug.print("{s}\n", .{usage});
+        std.process.exit(0);
+    }
+    if (res.args.ip) |ip| {
+        options.ip = try alloc.dupe(u8, ip);
+    }
+    if (res.args.port) |port| {
+        options.port = port;
+    }
+    if (res.args.topic_prefix) |topic_prefix| {
+        options.topic_prefix = try alloc.dupe(u8, topic_prefix);
+    }
+    if (res.args.speakers) |speakers| {
+        options.speakers = speakers;
+    }
+    if (res.args.topics) |topics| {
+        options.topics = @max(topics, 1);
+    }
+    if (res.args.listeners) |listeners| {
+        options.listeners = listeners;
+    }
+    if (res.args.duration) |duration| {
+        options.duration_s = duration;
+    }
+    if (res.args.period_ms) |period_ms| {
+        options.period_ms = @max(period_ms, 1);
+    }
+    if (res.args.sample_rate) |sample_rate| {
+        options.sample_rate = @max(sample_rate, 1);
+    }
+    return options;
+}
+
+/// One period of a 440 Hz sine, as f32 mono.
+fn synthetic_payload(alloc: std.mem.Allocator, options: *const Options) ![]u8 {
+    const frames = options.sample_rate * options.period_ms / std.time.ms_per_s;
+    const samples = try alloc.alloc(f32, @max(frames, 1));
+    for (samples, 0..) |*sample, i| {
+        const t: f32 = @floatFromInt(i);
+        const rate: f32 = @floatFromInt(options.sample_rate);
+        sample.* = 0.5 * @sin(t * 2.0 * std.math.pi * 440.0 / rate);
+    }
+    return std.mem.sliceAsBytes(samples);
+}
+
+fn print_summary(alloc: std.mem.Allocator, options: *const Options, speakers: []const Speaker, listeners: []Listener, elapsed_s: f64) !void {
+    var sent: u64 = 0;
+    var send_failures: u64 = 0;
+    var late: u64 = 0;
+    const sent_per_topic = try alloc.alloc(u64, options.topics);
+    @memset(sent_per_topic, 0);
+    for (speakers, 0..) |speaker, i| {
+        sent += speaker.sent;
+        send_failures += speaker.send_failures;
+        late += speaker.late;
+        sent_per_topic[i % options.topics] += speaker.sent;
+    }
+
+    var expected: u64 = 0;
+    var received: u64 = 0;
+    var cumulative_lost: u64 = 0;
+    var jitter_sum_us: u64 = 0;
+    var jitter_max_us: u32 = 0;
+    var streams: u64 = 0;
+    for (listeners, 0..) |*listener, i| {
+        listener.mutex.lock();
+        defer listener.mutex.unlock();
+        expected += sent_per_topic[i % options.topics];
+        received += listener.received;
+        var it = listener.stats.iterator();
+        while (it.next()) |entry| {
+            const rr = entry.value_ptr.report(0, entry.key_ptr.*, 0);
+            cumulative_lost += rr.cumulative_lost;
+            jitter_sum_us += rr.jitter_us;
+            jitter_max_us = @max(jitter_max_us, rr.jitter_us);
+            streams += 1;
+        }
+    }
+
+    const sent_f: f64 = @floatFromInt(sent);
+    const expected_f: f64 = @floatFromInt(@max(expected, 1));
+    const received_f: f64 = @floatFromInt(received);
+    std.debug.print(
+        \\
+        \\speakers {d}, topics {d}, listeners {d}, period {d} ms, {d:.1} s
+        \\sent         {d} packets ({d:.1}/s), {d} send failures, {d} late periods
+        \\delivered    {d} of {d} expected ({d:.3}%), {d} lost by sequence
+        \\jitter       mean {d} us, max {d} us over {d} streams
+        \\
+    , .{
+        options.speakers,
+        options.topics,
+        options.listeners,
+        options.period_ms,
+        elapsed_s,
+        sent,
+        sent_f / elapsed_s,
+        send_failures,
+        late,
+        received,
+        expected,
+        received_f / expected_f * 100.0,
+        cumulative_lost,
+        if (streams > 0) jitter_sum_us / streams else 0,
+        jitter_max_us,
+        streams,
+    });
+    std.debug.print("latency (us)  p50 {d}  p90 {d}  p99 {d}  p99.9 {d}  max {d}\n", .{
+        audio.trace_percentile_us(audio.TRACE_NETWORK, 50.0),
+        audio.trace_percentile_us(audio.TRACE_NETWORK, 90.0),
+        audio.trace_percentile_us(audio.TRACE_NETWORK, 99.0),
+        audio.trace_percentile_us(audio.TRACE_NETWORK, 99.9),
+        audio.trace_percentile_us(audio.TRACE_NETWORK, 100.0),
+    });
+}
+
+/// Simulates speakers and listeners against a bus without any audio devices.
+/// Listeners run in the same process, so latency is measured on one clock.
+pub fn main() !void {
+    var arena: std.heap.ArenaAllocator = .init(g_alloc);
+    defer arena.deinit();
+    const alloc = arena.allocator();
+    const options = try parse_options(alloc);
+
+    const topics = try alloc.alloc([]const u8, options.topics);
+    for (topics, 0..) |*topic, i| {
+        topic.* = try std.fmt.allocPrint(alloc, "{s}{d}", .{ options.topic_prefix, i });
+    }
+    const payload = try synthetic_payload(alloc, &options);
+
+    const listeners = try alloc.alloc(Listener, options.listeners);
+    for (listeners, 0..) |*listener, i| {
+        listener.* = .{
+            .options = &options,
+            .topic = topics[i % topics.len],
+            // the arena is not thread safe, listeners grow their maps concurrently.
+            .stats = .init(g_alloc),
+        };
+        const thread = try std.Thread.spawn(.{ .allocator = g_alloc }, Listener.run, .{listener});
+        thread.detach();
+    }
+    // speakers only start once everyone listens, or the first packets count as lost.
+    for (listeners) |*listener| {
+        while (!listener.subscribed.load(.monotonic)) {
+            std.Thread.sleep(std.time.ns_per_ms * 10);
+        }
+    }
+
+    const speakers = try alloc.alloc(Speaker, options.speakers);
+    const speaker_threads = try alloc.alloc(std.Thread, options.speakers);
+    for (speakers, speaker_threads, 0..) |*speaker, *thread, i| {
+        speaker.* = .{
+            .options = &options,
+            .topic = topics[i % topics.len],
+            .stream_id = @intCast(i + 1),
+            .payload = payload,
+        };
+        thread.* = try std.Thread.spawn(.{ .allocator = g_alloc }, Speaker.run, .{speaker});
+    }
+
+    var timer = try std.time.Timer.start();
+    std.Thread.sleep(@as(u64, options.duration_s) * std.time.ns_per_s);
+    g_running.store(false, .monotonic);
+    for (speaker_threads) |thread| {
+        thread.join();
+    }
+    const elapsed_s = @as(f64, @floatFromInt(timer.read())) / std.time.ns_per_s;
+    // give the last packets time to arrive, listeners block in next_msg.
+    std.Thread.sleep(std.time.ns_per_ms * 500);
+    try print_summary(alloc, &options, speakers, listeners, elapsed_s);
+    std.process.exit(0);
+}
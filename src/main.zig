@@ -1,6 +1,13 @@
 const std = @import("std");
 const config = @import("config.zig");
 const capture = @import("capture_data.zig");
+const fec = @import("fec.zig");
+const report = @import("report.zig");
+const metrics = @import("metrics.zig");
+const spans = @import("spans.zig");
+const impair = @import("impair.zig");
+const spsc = @import("spsc.zig");
+const sched = @import("sched.zig");
 const chebi = @import("chebi");
 const client = chebi.client;
 
@@ -8,8 +15,14 @@ const rb = @import("rb");
 const Ring = rb.RingBuffer(50, capture.CaptureData);
 
 const audio = @cImport({
+    @cInclude("audio_context.h");
     @cInclude("audio_capture.h");
     @cInclude("audio_playback.h");
+    @cInclude("audio_convert.h");
+    @cInclude("audio_trace.h");
+    @cInclude("audio_deadline.h");
+    @cInclude("audio_shm.h");
+    @cInclude("audio_pacer.h");
 });
 
 var g_alloc = std.heap.smp_allocator;
@@ -19,15 +32,43 @@ const Error = error{
     capture_start_failed,
     unknown_format,
     not_supported,
+    conversion_failed,
+    shm_creation_failed,
 };
 
+/// Shared memory ring of a --shm listener, 256 slots of 16 KiB.
+const shm_slot_count = 256;
+const shm_slot_size = 16 * 1024;
+/// How long the --shm listener waits for audio before doing its other work.
+const shm_read_timeout_ms = 100;
+/// Paced packets go out this much faster than real time, so a backlog drains.
+const pace_speedup_percent = 5;
+/// Packets later than this are not caught up on, the schedule restarts instead.
+const pace_max_lag_ns = 20 * std.time.ns_per_ms;
+/// Captures the capture thread can get ahead of the paced broadcast thread.
+const pace_queue_capacity = 64;
+/// With pacing the broadcast thread takes captures as they arrive, so the
+/// pacer smooths the stream rather than releasing a full ring late.
+const PaceQueue = spsc.Spsc(capture.CaptureData, pace_queue_capacity);
+/// How long the paced broadcast thread waits for a capture before doing its other work.
+const pace_wait_ns = 100 * std.time.ns_per_ms;
+
 const Info = struct {
     ring: *Ring,
+    /// Used instead of the ring when pacing.
+    pace_queue: *PaceQueue,
     running: bool = true,
+    /// Audio devices of every session are opened on this one context.
+    ctx: ?*audio.audio_context_t = null,
+    /// What the audio devices are opened with, see --low_latency.
+    profile: audio.audio_device_profile_t = undefined,
     cap: *audio.capture_t,
-    play: *audio.playback_t,
     c: *client.Client,
     conf: config.Config,
+    /// One per --topic, in the order given.
+    sessions: []*Session = &.{},
+    /// Bus topic to the session it belongs to, audio and report topics alike.
+    routes: std.StringHashMapUnmanaged(*Session) = .empty,
 
     pub fn stop(self: *Info) void {
         self.running = false;
@@ -36,66 +77,761 @@ const Info = struct {
 
 var g_info: Info = .{
     .ring = undefined,
+    .pace_queue = undefined,
     .c = undefined,
-    .play = undefined,
     .cap = undefined,
     .conf = undefined,
 };
 
+/// One room: a topic this process publishes and plays back on. Sessions
+/// share the capture device and the bus connection, everything else is
+/// per topic, and each session has its own playout thread.
+const Session = struct {
+    topic: []const u8,
+    /// Topic receiver reports are exchanged on.
+    report_topic: []const u8,
+    /// Shared memory name audio is carried over with --shm.
+    shm_name: [:0]const u8,
+    /// Playback of this room, only with --playback_only.
+    play: ?*audio.playback_t = null,
+    fec_decoder: fec.Decoder,
+    /// Bitrate adaptation, fed by reports and read by the broadcast thread.
+    adaptation: report.Adaptation,
+    sequence: u32 = 0,
+    /// Broadcast state, only touched by the broadcast thread.
+    sender: Sender,
+    /// Receive state, only touched by the playout thread.
+    receiver: Receiver,
+    /// Packets read off the bus for this room, drained by the playout thread.
+    queue: ReceiveQueue = .{},
+    /// Ring this room is read from by a --shm listener.
+    shm_reader: ?*audio.shm_ring_t = null,
+    playout: ?std.Thread = null,
+
+    fn create(alloc: std.mem.Allocator, conf: config.Config, topic: []const u8) !*Session {
+        const self = try alloc.create(Session);
+        errdefer alloc.destroy(self);
+        const report_topic = try report.report_topic(alloc, topic);
+        errdefer alloc.free(report_topic);
+        const shm_name = try std.fmt.allocPrintSentinel(alloc, "/tiny_vc_{s}", .{topic}, 0);
+        self.* = .{
+            .topic = topic,
+            .report_topic = report_topic,
+            .shm_name = shm_name,
+            .fec_decoder = .init(alloc),
+            // listeners are assumed to run with the same jitter buffer.
+            .adaptation = .init(conf.fec_group, conf.fec_parity, g_info.profile.buffer_ms),
+            .sender = .{
+                .encoder = .init(alloc, conf.fec_group, conf.fec_parity),
+            },
+            .receiver = .init(alloc, conf.impair),
+        };
+        return self;
+    }
+
+    /// The playout and broadcast threads must have stopped.
+    fn destroy(self: *Session, alloc: std.mem.Allocator) void {
+        if (self.play != null) {
+            audio.playback_destroy(&self.play);
+        }
+        if (self.shm_reader != null) {
+            audio.shm_ring_destroy(&self.shm_reader);
+        }
+        while (self.queue.pop()) |packet| {
+            alloc.free(packet.payload);
+        }
+        if (self.receiver.impairment) |*imp| {
+            print_impairment(self.topic, imp);
+        }
+        self.receiver.deinit();
+        self.sender.deinit();
+        self.fec_decoder.deinit();
+        alloc.free(self.shm_name);
+        alloc.free(self.report_topic);
+        alloc.destroy(self);
+    }
+
+    /// Count a received packet and hand it on, through the impairment if set.
+    fn receive(self: *Session, payload: []const u8, receive_ns: u64) !void {
+        spans.begin("receive");
+        defer spans.end("receive");
+        _ = g_metrics.messages_received.fetchAdd(1, .monotonic);
+        _ = g_metrics.bytes_received.fetchAdd(payload.len, .monotonic);
+        if (self.receiver.impairment) |*imp| {
+            try imp.push(payload, receive_ns);
+        } else {
+            try handle_payload(self, payload, receive_ns);
+        }
+    }
+
+    /// Work that is due whether packets arrive or not.
+    fn tick(self: *Session) !void {
+        maybe_dump_stats();
+        if (self.receiver.impairment) |*imp| {
+            // held packets are only released between packets and waits, so
+            // the emulated delay is as precise as the packet interval.
+            while (imp.pop(audio.trace_now_ns())) |packet| {
+                defer g_alloc.free(packet);
+                try handle_payload(self, packet, audio.trace_now_ns());
+            }
+        }
+        const now_ms = std.time.milliTimestamp();
+        if (g_info.conf.playback_only and now_ms - self.receiver.last_report_ms >= report.report_interval_ms) {
+            self.receiver.last_report_ms = now_ms;
+            send_reports(self);
+        }
+    }
+};
+
+var g_metrics: metrics.Metrics = .{};
+
 export fn interrupt_stop(_: i32) void {
     g_info.running = false;
 }
 
+/// Set by SIGUSR1 to ask for a latency trace and counters dump.
+var g_trace_dump: std.atomic.Value(bool) = .init(false);
+var g_trace_last_dump_ms: std.atomic.Value(i64) = .init(0);
+
+export fn trace_dump_signal(_: i32) void {
+    g_trace_dump.store(true, .monotonic);
+}
+
+/// Counters of the capture device, or of every room's playback added up.
+/// False when there is neither.
+fn total_counters(counters: *audio.audio_counters_t) bool {
+    if (g_info.conf.capture_only) {
+        audio.capture_get_counters(g_info.cap, counters);
+        return true;
+    }
+    if (!g_info.conf.playback_only) {
+        return false;
+    }
+    for (g_info.sessions) |session| {
+        const play = session.play orelse continue;
+        var room: audio.audio_counters_t = .{};
+        audio.playback_get_counters(play, &room);
+        inline for (std.meta.fields(audio.audio_counters_t)) |field| {
+            @field(counters, field.name) += @field(room, field.name);
+        }
+    }
+    return true;
+}
+
+fn print_counters() void {
+    var counters: audio.audio_counters_t = .{};
+    if (!total_counters(&counters)) {
+        return;
+    }
+    std.debug.print(
+        "counters: captured = {}, gated = {}, dropped_overflow = {}, queued = {}, dropped_queue = {}, underruns = {}, overruns = {}, malformed = {}\n",
+        .{
+            counters.frames_captured,
+            counters.frames_gated,
+            counters.frames_dropped_overflow,
+            counters.frames_queued,
+            counters.frames_dropped_queue,
+            counters.underrun_periods,
+            counters.callback_overruns,
+            counters.packets_malformed,
+        },
+    );
+}
+
+fn write_trace_events() void {
+    spans.write(g_info.conf.trace_events_file orelse "trace_events.json");
+}
+
+/// Print the latency histograms and counters if asked for or the interval is up.
+/// Called from both the receiving and the broadcast thread.
+fn maybe_dump_stats() void {
+    var dump = g_trace_dump.swap(false, .monotonic);
+    if (g_info.conf.trace_interval > 0) {
+        const now_ms = std.time.milliTimestamp();
+        const last_ms = g_trace_last_dump_ms.load(.monotonic);
+        if (now_ms - last_ms >= @as(i64, g_info.conf.trace_interval) * std.time.ms_per_s and
+            g_trace_last_dump_ms.cmpxchgStrong(last_ms, now_ms, .monotonic, .monotonic) == null)
+        {
+            dump = true;
+        }
+    }
+    if (dump) {
+        audio.trace_print(null);
+        print_counters();
+        if (g_info.conf.deadline_monitor) {
+            audio.deadline_print(null);
+        }
+    }
+}
+
+fn render_metrics(text: *metrics.Text) void {
+    var counters: audio.audio_counters_t = .{};
+    _ = total_counters(&counters);
+    text.metric("tiny_vc_frames_captured_total", "counter", "Frames handed to the capture callback.", counters.frames_captured);
+    text.metric("tiny_vc_frames_gated_total", "counter", "Captured frames not sent because the gate was closed.", counters.frames_gated);
+    text.metric("tiny_vc_frames_dropped_overflow_total", "counter", "Captured frames lost to a full capture ring buffer.", counters.frames_dropped_overflow);
+    text.metric("tiny_vc_frames_queued_total", "counter", "Frames queued for playback.", counters.frames_queued);
+    text.metric("tiny_vc_frames_dropped_queue_total", "counter", "Frames lost to a full jitter buffer.", counters.frames_dropped_queue);
+    text.metric("tiny_vc_underrun_periods_total", "counter", "Playback periods where a stream ran out of data.", counters.underrun_periods);
+    text.metric("tiny_vc_callback_overruns_total", "counter", "Audio callbacks that took longer than their period.", counters.callback_overruns);
+    text.metric("tiny_vc_packets_malformed_total", "counter", "Received packets rejected because their frames did not fit their payload.", counters.packets_malformed);
+    var memory: audio.audio_memory_stats_t = .{};
+    if (g_info.ctx != null) {
+        audio.audio_context_get_memory_stats(g_info.ctx, &memory);
+    }
+    text.metric("tiny_vc_audio_memory_locked_bytes", "gauge", "Audio rings and device buffers locked into RAM.", memory.locked_bytes);
+    text.metric("tiny_vc_audio_memory_huge_page_bytes", "gauge", "Audio rings on huge pages.", memory.huge_page_bytes);
+    text.metric("tiny_vc_audio_memory_lock_failures_total", "counter", "Audio memory blocks that could not be locked into RAM.", memory.lock_failures);
+    text.metric("tiny_vc_ring_depth", "gauge", "Captured packets waiting to be broadcast.", g_metrics.ring_depth());
+    text.metric("tiny_vc_ring_dropped_total", "counter", "Captured packets dropped because the paced broadcast thread fell behind.", g_metrics.ring_dropped.load(.monotonic));
+    text.metric("tiny_vc_receive_queue_depth", "gauge", "Received packets waiting for the playout thread.", g_metrics.receive_depth());
+    text.metric("tiny_vc_receive_queue_dropped_total", "counter", "Received packets dropped because the playout thread fell behind.", g_metrics.receive_dropped.load(.monotonic));
+    text.metric("tiny_vc_bus_messages_sent_total", "counter", "Messages written to the bus.", g_metrics.messages_sent.load(.monotonic));
+    text.metric("tiny_vc_bus_bytes_sent_total", "counter", "Payload bytes written to the bus.", g_metrics.bytes_sent.load(.monotonic));
+    text.metric("tiny_vc_bus_send_failures_total", "counter", "Messages that failed to be written to the bus.", g_metrics.send_failures.load(.monotonic));
+    text.metric("tiny_vc_bus_messages_received_total", "counter", "Messages read from the bus.", g_metrics.messages_received.load(.monotonic));
+    text.metric("tiny_vc_bus_bytes_received_total", "counter", "Payload bytes read from the bus.", g_metrics.bytes_received.load(.monotonic));
+    text.metric("tiny_vc_marshal_failures_total", "counter", "Packets that failed to marshal.", g_metrics.marshal_failures.load(.monotonic));
+    text.metric("tiny_vc_unmarshal_failures_total", "counter", "Packets that failed to unmarshal.", g_metrics.unmarshal_failures.load(.monotonic));
+    if (g_info.conf.capture_only) {
+        text.print("# HELP tiny_vc_adaptation_level Current sender quality level, 0 is the best.\n", .{});
+        text.print("# TYPE tiny_vc_adaptation_level gauge\n", .{});
+        for (g_info.sessions) |session| {
+            text.print("tiny_vc_adaptation_level{{topic=\"{s}\"}} {d}\n", .{ session.topic, session.adaptation.current().level });
+        }
+    }
+
+    text.print("# HELP tiny_vc_latency_seconds Time spent in each stage of the capture to playback path.\n", .{});
+    text.print("# TYPE tiny_vc_latency_seconds summary\n", .{});
+    const quantiles = [_]f64{ 0.5, 0.9, 0.99, 0.999 };
+    const stage_count: usize = @intCast(audio.TRACE_STAGE_COUNT);
+    for (0..stage_count) |i| {
+        const stage: audio.enum_trace_stage = @intCast(i);
+        const name = std.mem.span(audio.trace_stage_name(stage));
+        for (quantiles) |quantile| {
+            const us: f64 = @floatFromInt(audio.trace_percentile_us(stage, quantile * 100.0));
+            text.print("tiny_vc_latency_seconds{{stage=\"{s}\",quantile=\"{d}\"}} {d}\n", .{ name, quantile, us / std.time.us_per_s });
+        }
+        const sum_us: f64 = @floatFromInt(audio.trace_sum_us(stage));
+        text.print("tiny_vc_latency_seconds_sum{{stage=\"{s}\"}} {d}\n", .{ name, sum_us / std.time.us_per_s });
+        text.print("tiny_vc_latency_seconds_count{{stage=\"{s}\"}} {d}\n", .{ name, audio.trace_count(stage) });
+    }
+
+    if (!g_info.conf.deadline_monitor) {
+        return;
+    }
+    text.print("# HELP tiny_vc_callback_load Audio callback duration as a fraction of its period.\n", .{});
+    text.print("# TYPE tiny_vc_callback_load summary\n", .{});
+    const callback_count: usize = @intCast(audio.DEADLINE_CALLBACK_COUNT);
+    for (0..callback_count) |i| {
+        const callback: audio.enum_deadline_callback = @intCast(i);
+        const name = std.mem.span(audio.deadline_callback_name(callback));
+        for (quantiles) |quantile| {
+            text.print("tiny_vc_callback_load{{callback=\"{s}\",quantile=\"{d}\"}} {d}\n", .{ name, quantile, audio.deadline_percentile(callback, quantile * 100.0) });
+        }
+        text.print("tiny_vc_callback_load_count{{callback=\"{s}\"}} {d}\n", .{ name, audio.deadline_count(callback) });
+    }
+    text.print("# HELP tiny_vc_callback_deadline_misses_total Audio callbacks that ran past their period.\n", .{});
+    text.print("# TYPE tiny_vc_callback_deadline_misses_total counter\n", .{});
+    for (0..callback_count) |i| {
+        const callback: audio.enum_deadline_callback = @intCast(i);
+        const name = std.mem.span(audio.deadline_callback_name(callback));
+        text.print("tiny_vc_callback_deadline_misses_total{{callback=\"{s}\"}} {d}\n", .{ name, audio.deadline_misses(callback) });
+    }
+}
+
+fn print_impairment(topic: []const u8, imp: *const impair.Impairment) void {
+    std.debug.print("impairment on {s}: passed {d}, lost random {d}, lost burst {d}, lost queue {d}, duplicated {d}, reordered {d}\n", .{
+        topic,
+        imp.stats.passed,
+        imp.stats.lost_random,
+        imp.stats.lost_burst,
+        imp.stats.lost_queue,
+        imp.stats.duplicated,
+        imp.stats.reordered,
+    });
+}
+
+/// A packet read off the bus, waiting for the playout thread.
+const ReceivedPacket = struct {
+    payload: []u8,
+    receive_ns: u64,
+};
+/// Packets the network thread can read ahead of the playout thread.
+const receive_queue_capacity = 1024;
+const ReceiveQueue = spsc.Spsc(ReceivedPacket, receive_queue_capacity);
+/// How long the playout thread waits for a packet before doing its other work.
+const playout_wait_ns = 100 * std.time.ns_per_ms;
+
+/// What a session keeps about received packets.
+const Receiver = struct {
+    stats: std.AutoHashMap(u32, report.ReceiverStats),
+    receive_times: ReceiveTimes,
+    impairment: ?impair.Impairment,
+    last_report_ms: i64,
+
+    fn init(alloc: std.mem.Allocator, impair_config: ?impair.Config) Receiver {
+        return .{
+            .stats = .init(alloc),
+            .receive_times = .init(alloc),
+            .impairment = if (impair_config) |settings| impair.Impairment.init(alloc, settings) else null,
+            .last_report_ms = std.time.milliTimestamp(),
+        };
+    }
+
+    fn deinit(self: *Receiver) void {
+        if (self.impairment) |*imp| {
+            imp.deinit();
+        }
+        self.receive_times.deinit();
+        self.stats.deinit();
+    }
+};
+
+/// Network thread side of the handoff, never waits on the playout thread.
+fn forward_packet(queue: *ReceiveQueue, payload: []const u8, receive_ns: u64) void {
+    const owned = g_alloc.dupe(u8, payload) catch {
+        _ = g_metrics.receive_dropped.fetchAdd(1, .monotonic);
+        return;
+    };
+    if (!queue.push(.{ .payload = owned, .receive_ns = receive_ns })) {
+        g_alloc.free(owned);
+        _ = g_metrics.receive_dropped.fetchAdd(1, .monotonic);
+        return;
+    }
+    _ = g_metrics.receive_queued.fetchAdd(1, .monotonic);
+}
+
+/// Playout thread of a session, does everything with what the network
+/// thread read for its room, or reads the room's ring with --shm.
+fn handle_received(info: *Info, session: *Session) void {
+    spans.thread_name("handle_received");
+    sched.apply(info.conf.sched, .playout);
+    while (info.running) {
+        if (session.shm_reader) |ring| {
+            var packet: audio.shm_packet_t = .{};
+            spans.begin("shm_read");
+            const result = audio.shm_ring_acquire_read(ring, &packet, shm_read_timeout_ms);
+            spans.end("shm_read");
+            if (result == audio.MA_SUCCESS) {
+                defer audio.shm_ring_release_read(ring, &packet);
+                // handled in place, the slot is only released afterwards.
+                const payload = @as([*]const u8, @ptrCast(packet.data.?))[0..packet.len];
+                session.receive(payload, audio.trace_now_ns()) catch |err| {
+                    std.debug.print("failed to handle received packet: {any}\n", .{err});
+                };
+            }
+        } else if (session.queue.pop_timeout(playout_wait_ns)) |packet| {
+            defer g_alloc.free(packet.payload);
+            _ = g_metrics.receive_handled.fetchAdd(1, .monotonic);
+            session.receive(packet.payload, packet.receive_ns) catch |err| {
+                std.debug.print("failed to handle received packet: {any}\n", .{err});
+            };
+        }
+        session.tick() catch |err| {
+            std.debug.print("failed to release held packets: {any}\n", .{err});
+        };
+    }
+}
+
+/// Handle one packet off the bus, or out of the impairment.
+fn handle_payload(session: *Session, payload: []const u8, receive_ns: u64) !void {
+    const stats = &session.receiver.stats;
+    const receive_times = &session.receiver.receive_times;
+    const header = capture.CaptureData.peek(payload) orelse return;
+    if (header.kind == .receiver_report) {
+        if (g_info.conf.capture_only) {
+            handle_report(session, payload);
+        }
+        return;
+    }
+    if (g_info.conf.capture_only) {
+        return;
+    }
+    if (header.kind == .audio or header.kind == .comfort_noise) {
+        const entry = try stats.getOrPut(header.stream_id);
+        if (!entry.found_existing) {
+            entry.value_ptr.* = .{};
+        }
+        entry.value_ptr.on_packet(header.sequence, header.timestamp, std.time.microTimestamp());
+        audio.trace_record(audio.TRACE_NETWORK, to_local_ns(header.marshal_ns), receive_ns);
+        if (receive_times.count() >= max_receive_times) {
+            receive_times.clearRetainingCapacity();
+        }
+        try receive_times.put(receive_key(header.stream_id, header.sequence), receive_ns);
+    }
+    session.fec_decoder.push(payload) catch |err| {
+        std.debug.print("fec decode failed: {any}\n", .{err});
+        return;
+    };
+    while (session.fec_decoder.next()) |packet| {
+        defer g_alloc.free(packet);
+        try queue_packet(session, packet);
+    }
+}
+
+/// Move a timestamp from the sender's trace clock onto ours.
+fn to_local_ns(sender_ns: u64) u64 {
+    if (sender_ns == 0) {
+        return 0;
+    }
+    const local_ns = @as(i64, @intCast(sender_ns)) + g_info.conf.clock_offset_us * std.time.ns_per_us;
+    return @intCast(@max(local_ns, 1));
+}
+
 fn cap_data_encode(alloc: std.mem.Allocator, cap: *audio.capture_data_t) !capture.CaptureData {
     var result: capture.CaptureData = .init(alloc);
+    result.kind = @enumFromInt(cap.kind);
+    result.stream_id = g_info.conf.stream_id;
+    result.level = cap.level;
+    result.voice_active = cap.voice_active != 0;
     result.sizeInFrames = @intCast(cap.sizeInFrames);
     result.format = @intCast(cap.format);
     result.channels = @intCast(cap.channels);
+    result.sampleRate = @intCast(cap.sampleRate);
+    result.capture_ns = cap.capture_ns;
+    result.stage_ns = cap.stage_ns;
     result.buffer = try alloc.alloc(u8, cap.buffer_len);
     @memcpy(result.buffer, @as([*]const u8, @ptrCast(cap.buffer.?)));
     return result;
 }
 
 fn cap_data_decode(cap: capture.CaptureData, out: *audio.capture_data_t) void {
+    out.kind = @intFromEnum(cap.kind);
+    out.stream_id = @intCast(cap.stream_id);
+    out.level = cap.level;
+    out.voice_active = @intFromBool(cap.voice_active);
     out.sizeInFrames = @intCast(cap.sizeInFrames);
     out.format = @intCast(cap.format);
     out.channels = @intCast(cap.channels);
+    out.sampleRate = @intCast(cap.sampleRate);
+    out.capture_ns = cap.capture_ns;
+    out.stage_ns = cap.stage_ns;
     out.buffer_len = cap.buffer.len;
     out.buffer = cap.buffer.ptr;
 }
 
+fn send_packet(info: *Info, topic: []const u8, marshal_data: []const u8) void {
+    if (chebi.message.Message.init_with_body(
+        g_alloc,
+        topic,
+        marshal_data,
+        .text,
+    )) |*msg| {
+        var local_msg: chebi.message.Message = msg.*;
+        if (info.c.write_msg(&local_msg)) |_| {
+            _ = g_metrics.messages_sent.fetchAdd(1, .monotonic);
+            _ = g_metrics.bytes_sent.fetchAdd(marshal_data.len, .monotonic);
+        } else |err| {
+            _ = g_metrics.send_failures.fetchAdd(1, .monotonic);
+            std.debug.print("write cap_datature msg failed: {any}\n", .{err});
+        }
+        local_msg.deinit();
+    } else |err| {
+        std.debug.print("init_with_body failed: {any}\n", .{err});
+    }
+}
+
+/// Broadcast state of a session.
+const Sender = struct {
+    encoder: fec.Encoder,
+    converter: ?*audio.converter_t = null,
+    settings: ?report.Settings = null,
+    /// Captured frames so far, drives the media timestamp.
+    media_frames: u64 = 0,
+    /// Audio waiting to be batched into one packet.
+    pending: ?capture.CaptureData = null,
+    pending_count: u8 = 0,
+    /// Shared memory ring of the listener with --shm, opened once it exists.
+    shm: ?*audio.shm_ring_t = null,
+    shm_retry_ms: i64 = 0,
+
+    fn deinit(self: *Sender) void {
+        if (self.shm != null) {
+            audio.shm_ring_destroy(&self.shm);
+        }
+        if (self.pending) |*pending| {
+            pending.deinit();
+        }
+        if (self.converter != null) {
+            audio.converter_destroy(&self.converter);
+        }
+        self.encoder.deinit();
+    }
+};
+
+/// Ring of the local listener, retried once a second until it shows up.
+fn shm_writer(session: *Session) ?*audio.shm_ring_t {
+    const sender = &session.sender;
+    if (sender.shm == null) {
+        const now_ms = std.time.milliTimestamp();
+        if (now_ms - sender.shm_retry_ms < std.time.ms_per_s) {
+            return null;
+        }
+        sender.shm_retry_ms = now_ms;
+        sender.shm = audio.shm_ring_open(session.shm_name.ptr);
+    }
+    return sender.shm;
+}
+
+/// Marshal straight into a shared memory slot, no copy and no socket.
+/// FEC is skipped, the ring does not lose packets.
+fn send_capture_shm(session: *Session, cap: *capture.CaptureData) void {
+    const ring = shm_writer(session) orelse {
+        _ = g_metrics.send_failures.fetchAdd(1, .monotonic);
+        return;
+    };
+    var packet: audio.shm_packet_t = .{};
+    if (audio.shm_ring_acquire_write(ring, &packet) != audio.MA_SUCCESS) {
+        // the listener is behind, drop like a congested network would.
+        _ = g_metrics.send_failures.fetchAdd(1, .monotonic);
+        return;
+    }
+    const slot = @as([*]u8, @ptrCast(packet.data.?))[0..packet.len];
+    packet.len = cap.marshal_into(slot) catch |err| blk: {
+        _ = g_metrics.marshal_failures.fetchAdd(1, .monotonic);
+        std.debug.print("failed to marshal cap_datature_data: {any}\n", .{err});
+        break :blk 0;
+    };
+    _ = audio.shm_ring_commit_write(ring, &packet);
+    if (packet.len > 0) {
+        _ = g_metrics.messages_sent.fetchAdd(1, .monotonic);
+        _ = g_metrics.bytes_sent.fetchAdd(packet.len, .monotonic);
+    }
+    audio.trace_record(audio.TRACE_SEND, cap.marshal_ns, audio.trace_now_ns());
+}
+
+/// Audio a packet carries, which is how long the pacer holds the next one back.
+fn packet_duration_ns(cap: *const capture.CaptureData) u64 {
+    if (cap.sampleRate == 0) {
+        return 0;
+    }
+    return @as(u64, cap.sizeInFrames) * std.time.ns_per_s / cap.sampleRate;
+}
+
+fn send_capture(info: *Info, session: *Session, cap: *capture.CaptureData) void {
+    cap.sequence = session.sequence;
+    session.sequence +%= 1;
+    cap.marshal_ns = audio.trace_now_ns();
+    audio.trace_record(audio.TRACE_MARSHAL, cap.stage_ns, cap.marshal_ns);
+    if (info.conf.shm) {
+        send_capture_shm(session, cap);
+        return;
+    }
+    const marshal_data: []const u8 = cap.marshal() catch |err| {
+        _ = g_metrics.marshal_failures.fetchAdd(1, .monotonic);
+        std.debug.print("failed to marshal cap_datature_data: {any}\n", .{err});
+        return;
+    };
+    defer cap.alloc.free(marshal_data);
+    send_packet(info, session.topic, marshal_data);
+    audio.trace_record(audio.TRACE_SEND, cap.marshal_ns, audio.trace_now_ns());
+    const parity_opt = session.sender.encoder.add(cap.stream_id, cap.sequence, marshal_data) catch |err| {
+        std.debug.print("fec encode failed: {any}\n", .{err});
+        return;
+    };
+    if (parity_opt) |parity| {
+        defer g_alloc.free(parity);
+        for (parity) |packet| {
+            defer g_alloc.free(packet);
+            send_packet(info, session.topic, packet);
+        }
+    }
+}
+
+fn flush_pending(info: *Info, session: *Session) void {
+    const sender = &session.sender;
+    if (sender.pending) |*pending| {
+        defer pending.deinit();
+        send_capture(info, session, pending);
+    }
+    sender.pending = null;
+    sender.pending_count = 0;
+}
+
+/// Pick up new settings from the adaptation.
+fn apply_settings(info: *Info, session: *Session) void {
+    const sender = &session.sender;
+    const settings = session.adaptation.current();
+    if (sender.settings) |current| {
+        if (std.meta.eql(current, settings)) {
+            return;
+        }
+    }
+    flush_pending(info, session);
+    sender.settings = settings;
+    sender.encoder.configure(settings.fec_group, settings.fec_parity);
+}
+
+/// Convert the audio to the format and sample rate of the current quality.
+fn convert_capture(sender: *Sender, cap: *capture.CaptureData) !void {
+    const quality = sender.settings.?.quality();
+    if (cap.format == quality.format and cap.sampleRate == quality.sample_rate) {
+        return;
+    }
+    if (sender.converter == null or !audio.converter_matches(
+        sender.converter,
+        cap.format,
+        quality.format,
+        cap.channels,
+        cap.sampleRate,
+        quality.sample_rate,
+    )) {
+        if (sender.converter != null) {
+            audio.converter_destroy(&sender.converter);
+        }
+        sender.converter = audio.converter_create(
+            cap.format,
+            quality.format,
+            cap.channels,
+            cap.sampleRate,
+            quality.sample_rate,
+        );
+        if (sender.converter == null) {
+            return Error.conversion_failed;
+        }
+    }
+    var in: audio.capture_data_t = .{};
+    cap_data_decode(cap.*, &in);
+    var out_opt: ?*audio.capture_data_t = null;
+    const result: audio.ma_result = audio.converter_process(sender.converter, &in, &out_opt);
+    if (result != audio.MA_SUCCESS) {
+        std.debug.print("converter_process failed: code({})\n", .{result});
+        return Error.conversion_failed;
+    }
+    defer audio.capture_data_destroy(&out_opt);
+    const out = out_opt.?;
+    const buffer = try cap.alloc.alloc(u8, out.buffer_len);
+    if (out.buffer_len > 0) {
+        @memcpy(buffer, @as([*]const u8, @ptrCast(out.buffer.?)));
+    }
+    cap.alloc.free(cap.buffer);
+    cap.buffer = buffer;
+    cap.sizeInFrames = @intCast(out.sizeInFrames);
+    cap.format = @intCast(out.format);
+    cap.sampleRate = @intCast(out.sampleRate);
+}
+
+/// Batch audio into fewer, larger packets when the quality asks for it.
+/// Takes ownership of the capture data.
+fn batch_capture(info: *Info, session: *Session, cap: *capture.CaptureData) !void {
+    const sender = &session.sender;
+    const batch = sender.settings.?.quality().batch;
+    if (cap.kind != .audio or batch <= 1) {
+        flush_pending(info, session);
+        defer cap.deinit();
+        send_capture(info, session, cap);
+        return;
+    }
+    if (sender.pending) |*pending| {
+        if (pending.format != cap.format or pending.sampleRate != cap.sampleRate or pending.channels != cap.channels) {
+            flush_pending(info, session);
+        }
+    }
+    if (sender.pending) |*pending| {
+        defer cap.deinit();
+        const merged = try pending.alloc.realloc(pending.buffer, pending.buffer.len + cap.buffer.len);
+        @memcpy(merged[pending.buffer.len..], cap.buffer);
+        pending.buffer = merged;
+        pending.sizeInFrames += cap.sizeInFrames;
+        pending.level = @min(pending.level, cap.level);
+        pending.voice_active = pending.voice_active or cap.voice_active;
+    } else {
+        sender.pending = cap.*;
+    }
+    sender.pending_count += 1;
+    if (sender.pending_count >= batch) {
+        flush_pending(info, session);
+    }
+}
+
+/// Send one capture to a room. Takes ownership of the capture data.
+fn broadcast_capture(info: *Info, session: *Session, cap: *capture.CaptureData) void {
+    const sender = &session.sender;
+    apply_settings(info, session);
+    if (cap.sampleRate > 0) {
+        cap.timestamp = @truncate(sender.media_frames * std.time.us_per_s / cap.sampleRate);
+    }
+    if (cap.kind == .audio) {
+        sender.media_frames += cap.sizeInFrames;
+        convert_capture(sender, cap) catch |err| {
+            std.debug.print("failed to convert capture_data: {any}\n", .{err});
+            cap.deinit();
+            return;
+        };
+        if (cap.sizeInFrames == 0) {
+            // the resampler is still filling up.
+            cap.deinit();
+            return;
+        }
+    }
+    batch_capture(info, session, cap) catch |err| {
+        std.debug.print("failed to batch capture_data: {any}\n", .{err});
+        cap.deinit();
+    };
+}
+
+/// Send one capture to every room. Takes ownership of the capture data.
+fn broadcast_rooms(info: *Info, cap: *capture.CaptureData) void {
+    const paced_ns = audio.trace_now_ns();
+    audio.trace_record(audio.TRACE_PACE, cap.stage_ns, paced_ns);
+    cap.stage_ns = paced_ns;
+    const last = info.sessions.len - 1;
+    for (info.sessions[0..last]) |session| {
+        var copy = cap.*;
+        copy.buffer = cap.alloc.dupe(u8, cap.buffer) catch |err| {
+            std.debug.print("failed to copy capture_data: {any}\n", .{err});
+            continue;
+        };
+        broadcast_capture(info, session, &copy);
+    }
+    broadcast_capture(info, info.sessions[last], cap);
+}
+
 fn handle_ring_buffer_data(info: *Info) void {
+    var pacer: ?*audio.pacer_t = null;
+    if (info.conf.pace) {
+        pacer = audio.pacer_create(pace_speedup_percent, pace_max_lag_ns);
+    }
+    defer if (pacer != null) {
+        audio.pacer_destroy(&pacer);
+    };
+    spans.thread_name("handle_ring_buffer_data");
+    sched.apply(info.conf.sched, .broadcast);
     while (info.running) {
+        maybe_dump_stats();
+        if (pacer) |p| {
+            // waiting on a full ring would add a ring of latency before
+            // the pacer even starts, take each capture as it arrives.
+            var cap = info.pace_queue.pop_timeout(pace_wait_ns) orelse continue;
+            _ = g_metrics.ring_read.fetchAdd(1, .monotonic);
+            spans.begin("broadcast");
+            defer spans.end("broadcast");
+            // paced once per capture, every room then sends its packet.
+            spans.begin("pace");
+            _ = audio.pacer_wait(p, packet_duration_ns(&cap));
+            spans.end("pace");
+            broadcast_rooms(info, &cap);
+            continue;
+        }
+        spans.begin("read_when_full");
         const items_opt = info.ring.read_when_full(g_alloc, std.time.ns_per_s * 1) catch unreachable;
+        spans.end("read_when_full");
         if (items_opt) |items| {
+            spans.begin("broadcast");
+            defer spans.end("broadcast");
             defer g_alloc.free(items);
+            _ = g_metrics.ring_read.fetchAdd(items.len, .monotonic);
             for (items) |*cap| {
-                defer cap.*.deinit();
-                const marshal_data: []const u8 = cap.*.marshal() catch |err| {
-                    std.debug.print("failed to marshal cap_datature_data: {any}\n", .{err});
-                    continue;
-                };
-                defer cap.*.alloc.free(marshal_data);
-                if (chebi.message.Message.init_with_body(
-                    g_alloc,
-                    info.conf.topic,
-                    marshal_data,
-                    .text,
-                )) |*msg| {
-                    var local_msg: chebi.message.Message = msg.*;
-                    info.c.write_msg(&local_msg) catch |err| {
-                        std.debug.print("write cap_datature msg failed: {any}\n", .{err});
-                    };
-                    local_msg.deinit();
-                } else |err| {
-                    std.debug.print("init_with_body failed: {any}\n", .{err});
-                }
+                broadcast_rooms(info, cap);
             }
         }
     }
 }
 
 fn handle_capture(info: *Info) void {
+    spans.thread_name("handle_capture");
+    sched.apply(info.conf.sched, .capture);
     while (info.running) {
         var cd_opt: ?*audio.capture_data_t = null;
         const result: audio.ma_result = audio.capture_next_available(info.cap, &cd_opt);
@@ -110,26 +846,62 @@ fn handle_capture(info: *Info) void {
             continue;
         }
         if (cd_opt) |*cd| {
+            // only spans with data, the empty polls would fill the buffer.
+            spans.begin("handle_capture");
+            defer spans.end("handle_capture");
             defer audio.capture_data_destroy(@ptrCast(cd));
             if (cd.*.buffer) |_| {
-                const cap_data: capture.CaptureData = cap_data_encode(g_alloc, cd.*) catch |err| {
+                var cap_data: capture.CaptureData = cap_data_encode(g_alloc, cd.*) catch |err| {
                     std.debug.print("failed to encode capture_data: {any}\n", .{err});
                     continue;
                 };
-                g_info.ring.write(cap_data, true) catch unreachable;
+                const ring_ns = audio.trace_now_ns();
+                audio.trace_record(audio.TRACE_RING_WRITE, cap_data.stage_ns, ring_ns);
+                cap_data.stage_ns = ring_ns;
+                if (info.conf.pace) {
+                    if (!info.pace_queue.push(cap_data)) {
+                        // the broadcast thread fell a whole queue behind.
+                        cap_data.deinit();
+                        _ = g_metrics.ring_dropped.fetchAdd(1, .monotonic);
+                        continue;
+                    }
+                } else {
+                    g_info.ring.write(cap_data, true) catch unreachable;
+                }
+                _ = g_metrics.ring_written.fetchAdd(1, .monotonic);
             }
         }
     }
 }
 
+/// Log what the backend opened a device with, it may not be what was asked.
+fn log_device(kind: []const u8, device: audio.audio_device_info_t) void {
+    std.log.info("{s} device: {} Hz, {} channels, {} periods of {} frames ({} us), exclusive = {}, buffer = {} frames", .{
+        kind,
+        device.sample_rate,
+        device.channels,
+        device.periods,
+        device.period_frames,
+        device.period_us,
+        device.exclusive,
+        device.buffer_frames,
+    });
+}
+
 fn create_capture() !void {
-    const capture_opt = audio.capture_create(200);
+    const capture_opt = if (g_info.conf.headless)
+        audio.capture_create_headless(g_info.ctx, &g_info.profile, if (g_info.conf.input_wav) |path| path.ptr else null)
+    else
+        audio.capture_create(g_info.ctx, &g_info.profile);
     if (capture_opt == null) {
         return Error.audio_creation_failed;
     }
     if (capture_opt) |cap| {
         g_info.cap = cap;
     }
+    var device: audio.audio_device_info_t = undefined;
+    audio.capture_get_device_info(g_info.cap, &device);
+    log_device("capture", device);
     // capture thread
     _ = try std.Thread.spawn(.{
         .allocator = g_alloc,
@@ -141,20 +913,97 @@ fn create_capture() !void {
     }
 }
 
-fn create_playback() !void {
-    const playback_opt = audio.playback_create(200);
-    if (playback_opt == null) {
-        return Error.audio_creation_failed;
-    }
-    if (playback_opt) |play| {
-        g_info.play = play;
+/// WAV file a room is recorded to. With several rooms each gets its own,
+/// "out.wav" becomes "out_<topic>.wav".
+fn output_wav_path(alloc: std.mem.Allocator, session: *Session) !?[:0]u8 {
+    const path = g_info.conf.output_wav orelse return null;
+    if (g_info.sessions.len <= 1) {
+        return try alloc.dupeZ(u8, path);
     }
-    const result = audio.playback_start(g_info.play);
+    const stem = if (std.mem.endsWith(u8, path, ".wav")) path[0 .. path.len - ".wav".len] else path;
+    return try std.fmt.allocPrintSentinel(alloc, "{s}_{s}.wav", .{ stem, session.topic }, 0);
+}
+
+fn create_playback(session: *Session) !void {
+    const output_wav = try output_wav_path(g_alloc, session);
+    defer if (output_wav) |path| g_alloc.free(path);
+    const playback_opt = if (g_info.conf.headless)
+        audio.playback_create_headless(g_info.ctx, &g_info.profile, if (output_wav) |path| path.ptr else null)
+    else
+        audio.playback_create(g_info.ctx, &g_info.profile);
+    session.play = playback_opt orelse return Error.audio_creation_failed;
+    audio.playback_set_drift_compensation(session.play, g_info.conf.drift_compensation);
+    var device: audio.audio_device_info_t = undefined;
+    audio.playback_get_device_info(session.play, &device);
+    log_device("playback", device);
+    const result = audio.playback_start(session.play);
     if (result != audio.MA_SUCCESS) {
         std.debug.print("playback failed to start: code({})\n", .{result});
         return Error.playback_start_failed;
     }
-    try g_info.c.subscribe(g_info.conf.topic);
+    if (!g_info.conf.shm) {
+        try g_info.c.subscribe(session.topic);
+    }
+}
+
+/// Send a receiver report for every sender heard in the room since the last call.
+fn send_reports(session: *Session) void {
+    var it = session.receiver.stats.iterator();
+    while (it.next()) |entry| {
+        var delay_ms: audio.ma_uint32 = 0;
+        const result: audio.ma_result = audio.playback_stream_delay(session.play, entry.key_ptr.*, &delay_ms);
+        if (result != audio.MA_SUCCESS) {
+            // stream is not playing (yet or anymore).
+            continue;
+        }
+        const rr = entry.value_ptr.report(g_info.conf.stream_id, entry.key_ptr.*, delay_ms);
+        const marshal_data = rr.marshal(g_alloc) catch |err| {
+            _ = g_metrics.marshal_failures.fetchAdd(1, .monotonic);
+            std.debug.print("failed to marshal receiver report: {any}\n", .{err});
+            continue;
+        };
+        defer g_alloc.free(marshal_data);
+        send_packet(&g_info, session.report_topic, marshal_data);
+    }
+}
+
+fn handle_report(session: *Session, payload: []const u8) void {
+    const rr = report.ReceiverReport.unmarshal(payload) catch |err| {
+        std.debug.print("invalid receiver report: {any}\n", .{err});
+        return;
+    };
+    if (rr.stream_id != g_info.conf.stream_id) {
+        return;
+    }
+    session.adaptation.on_report(rr, std.time.milliTimestamp());
+}
+
+/// Receive time of packets waiting in the FEC decoder, keyed by stream_id and sequence.
+const ReceiveTimes = std.AutoHashMap(u64, u64);
+/// Bound on ReceiveTimes, packets that never come out again are forgotten.
+const max_receive_times = 4096;
+
+fn receive_key(stream_id: u32, sequence: u32) u64 {
+    return (@as(u64, stream_id) << 32) | sequence;
+}
+
+fn queue_packet(session: *Session, packet: []const u8) !void {
+    var data: capture.CaptureData = .init(g_alloc);
+    defer data.deinit();
+    data.unmarshal(packet) catch |err| {
+        _ = g_metrics.unmarshal_failures.fetchAdd(1, .monotonic);
+        return err;
+    };
+    if (session.receiver.receive_times.fetchRemove(receive_key(data.stream_id, data.sequence))) |entry| {
+        data.stage_ns = entry.value;
+    }
+    data.capture_ns = to_local_ns(data.capture_ns);
+    var cd: audio.capture_data_t = .{};
+    cap_data_decode(data, &cd);
+    const queue_result: audio.ma_result = audio.playback_queue(session.play, &cd);
+    if (queue_result != audio.MA_SUCCESS) {
+        std.debug.print("playback_queue failed: code({})\n", .{queue_result});
+    }
 }
 
 pub fn main() !void {
@@ -163,9 +1012,65 @@ pub fn main() !void {
 
     defer g_info.stop();
     g_info.conf = conf;
+    audio.deadline_set_enabled(conf.deadline_monitor);
 
     var local_ring: Ring = .init();
     g_info.ring = &local_ring;
+    var local_pace_queue: PaceQueue = .{};
+    g_info.pace_queue = &local_pace_queue;
+
+    var memory_flags: audio.ma_uint32 = 0;
+    if (conf.lock_memory) {
+        memory_flags |= audio.AUDIO_MEMORY_LOCKED;
+    }
+    if (conf.huge_pages) {
+        memory_flags |= audio.AUDIO_MEMORY_HUGE_PAGES;
+    }
+    g_info.ctx = audio.audio_context_create(conf.headless, memory_flags) orelse return Error.audio_creation_failed;
+    g_info.profile = if (conf.low_latency)
+        audio.audio_device_profile_low_latency(conf.period_us)
+    else
+        audio.audio_device_profile_default();
+    if (!conf.low_latency and conf.period_us != 0) {
+        g_info.profile.period_us = conf.period_us;
+    }
+    // the capture device runs until the process exits, so does its context.
+    // playback devices are destroyed with their sessions, before this runs.
+    defer if (!conf.capture_only) audio.audio_context_destroy(&g_info.ctx);
+
+    const sessions = try g_alloc.alloc(*Session, conf.topics.len);
+    defer g_alloc.free(sessions);
+    var session_count: usize = 0;
+    defer {
+        for (sessions[0..session_count]) |session| {
+            session.destroy(g_alloc);
+        }
+    }
+    for (conf.topics) |topic| {
+        sessions[session_count] = try Session.create(g_alloc, conf, topic);
+        session_count += 1;
+    }
+    g_info.sessions = sessions;
+    defer g_info.routes.deinit(g_alloc);
+    for (sessions) |session| {
+        try g_info.routes.put(g_alloc, session.topic, session);
+        try g_info.routes.put(g_alloc, session.report_topic, session);
+    }
+    // every thread that touches a session is stopped before it is destroyed.
+    var broadcast: ?std.Thread = null;
+    defer {
+        g_info.stop();
+        if (broadcast) |thread| {
+            thread.join();
+        }
+        for (sessions) |session| {
+            if (session.playout) |thread| {
+                thread.join();
+            }
+        }
+        // written once, after every thread that records spans has stopped.
+        write_trace_events();
+    }
 
     const empty_sig: [16]c_ulong = @splat(0);
     _ = std.c.sigaction(std.c.SIG.INT, &.{
@@ -173,6 +1078,12 @@ pub fn main() !void {
         .mask = empty_sig,
         .flags = 0,
     }, null);
+    _ = std.c.sigaction(std.c.SIG.USR1, &.{
+        .handler = .{ .handler = trace_dump_signal },
+        .mask = empty_sig,
+        .flags = 0,
+    }, null);
+    g_trace_last_dump_ms.store(std.time.milliTimestamp(), .monotonic);
 
     const addr = try std.net.Address.parseIp4(conf.ip, conf.port);
     var c = try client.Client.init(g_alloc, addr);
@@ -182,31 +1093,71 @@ pub fn main() !void {
 
     if (conf.capture_only) {
         try create_capture();
-        // broadcast thread
-        _ = try std.Thread.spawn(.{
+        for (sessions) |session| {
+            try c.subscribe(session.report_topic);
+        }
+        broadcast = try std.Thread.spawn(.{
             .allocator = g_alloc,
         }, handle_ring_buffer_data, .{&g_info});
     }
     if (conf.playback_only) {
-        try create_playback();
+        for (sessions) |session| {
+            try create_playback(session);
+        }
+    }
+    if (conf.metrics_port != 0) {
+        _ = try std.Thread.spawn(.{
+            .allocator = g_alloc,
+        }, metrics.serve, .{ g_alloc, conf.metrics_port, render_metrics });
+    }
+
+    // a --shm listener reads each room's audio from its own shared memory
+    // ring, the bus only carries its reports.
+    const shm_listener = conf.shm and conf.playback_only;
+    if (shm_listener) {
+        for (sessions) |session| {
+            session.shm_reader = audio.shm_ring_create(session.shm_name.ptr, shm_slot_count, shm_slot_size);
+            if (session.shm_reader == null) {
+                return Error.shm_creation_failed;
+            }
+        }
+    }
+    for (sessions) |session| {
+        session.playout = try std.Thread.spawn(.{
+            .allocator = g_alloc,
+        }, handle_received, .{ &g_info, session });
+    }
+
+    spans.thread_name("main");
+    if (shm_listener) {
+        while (g_info.running) {
+            std.Thread.sleep(shm_read_timeout_ms * std.time.ns_per_ms);
+        }
+        return;
     }
 
+    // applied after every other thread is started, they would inherit it.
+    sched.apply(conf.sched, .receive);
+    // main only reads the socket and hands each packet to the playout
+    // thread of its room, a slow jitter buffer or FEC recovery never holds
+    // up the next read.
     while (g_info.running) {
+        spans.begin("next_msg");
         var msg = try g_info.c.next_msg();
+        spans.end("next_msg");
         defer msg.deinit();
-        if (conf.capture_only) {
-            continue;
-        }
-        if (msg.payload) |payload| {
-            var data: capture.CaptureData = .init(g_alloc);
-            defer data.deinit();
-            try data.unmarshal(payload);
-            var cd: audio.capture_data_t = .{};
-            cap_data_decode(data, &cd);
-            const queue_result: audio.ma_result = audio.playback_queue(g_info.play, &cd);
-            if (queue_result != audio.MA_SUCCESS) {
-                std.debug.print("playback_queue failed: code({})\n", .{queue_result});
-            }
-        }
+        const payload = msg.payload orelse continue;
+        const topic: ?[]const u8 = msg.topic;
+        const session = g_info.routes.get(topic orelse continue) orelse continue;
+        forward_packet(&session.queue, payload, audio.trace_now_ns());
     }
 }
+
+test {
+    _ = capture;
+    _ = fec;
+    _ = report;
+    _ = spsc;
+    _ = impair;
+    _ = sched;
+}
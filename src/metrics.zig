@@ -0,0 +1,120 @@
+const std = @import("std");
+const posix = std.posix;
+
+/// Application side counters, bumped from any thread.
+pub const Metrics = struct {
+    messages_sent: std.atomic.Value(u64) = .init(0),
+    bytes_sent: std.atomic.Value(u64) = .init(0),
+    send_failures: std.atomic.Value(u64) = .init(0),
+    messages_received: std.atomic.Value(u64) = .init(0),
+    bytes_received: std.atomic.Value(u64) = .init(0),
+    marshal_failures: std.atomic.Value(u64) = .init(0),
+    unmarshal_failures: std.atomic.Value(u64) = .init(0),
+    /// Items written to and read from the broadcast ring, depth is the difference.
+    ring_written: std.atomic.Value(u64) = .init(0),
+    ring_read: std.atomic.Value(u64) = .init(0),
+    /// Captures dropped because the paced broadcast thread fell behind.
+    ring_dropped: std.atomic.Value(u64) = .init(0),
+    /// Packets handed from the network thread to the playout thread, and
+    /// packets dropped because the playout thread fell behind.
+    receive_queued: std.atomic.Value(u64) = .init(0),
+    receive_handled: std.atomic.Value(u64) = .init(0),
+    receive_dropped: std.atomic.Value(u64) = .init(0),
+
+    pub fn ring_depth(self: *const Metrics) u64 {
+        const written = self.ring_written.load(.monotonic);
+        const read = self.ring_read.load(.monotonic);
+        return written -| read;
+    }
+
+    pub fn receive_depth(self: *const Metrics) u64 {
+        const queued = self.receive_queued.load(.monotonic);
+        const handled = self.receive_handled.load(.monotonic);
+        return queued -| handled;
+    }
+};
+
+/// Text buffer the exposition is rendered into, output past the end is cut.
+pub const Text = struct {
+    buffer: []u8,
+    len: usize = 0,
+
+    pub fn print(self: *Text, comptime fmt: []const u8, args: anytype) void {
+        const out = std.fmt.bufPrint(self.buffer[self.len..], fmt, args) catch return;
+        self.len += out.len;
+    }
+
+    /// Print a metric with its HELP and TYPE lines.
+    pub fn metric(self: *Text, name: []const u8, kind: []const u8, help: []const u8, value: anytype) void {
+        self.print("# HELP {s} {s}\n# TYPE {s} {s}\n{s} {d}\n", .{ name, help, name, kind, name, value });
+    }
+
+    pub fn slice(self: *const Text) []const u8 {
+        return self.buffer[0..self.len];
+    }
+};
+
+/// Renders the exposition text of every metric.
+pub const RenderFn = *const fn (text: *Text) void;
+
+const max_response_len = 64 * 1024;
+/// Slow scrapers get dropped instead of holding up the next one.
+const client_timeout: posix.timeval = .{ .sec = 1, .usec = 0 };
+
+fn write_all(fd: posix.socket_t, bytes: []const u8) !void {
+    var offset: usize = 0;
+    while (offset < bytes.len) {
+        offset += try posix.write(fd, bytes[offset..]);
+    }
+}
+
+fn handle_client(fd: posix.socket_t, render: RenderFn, body_buffer: []u8) !void {
+    try posix.setsockopt(fd, posix.SOL.SOCKET, posix.SO.RCVTIMEO, std.mem.asBytes(&client_timeout));
+    try posix.setsockopt(fd, posix.SOL.SOCKET, posix.SO.SNDTIMEO, std.mem.asBytes(&client_timeout));
+    var request: [1024]u8 = undefined;
+    const request_len = try posix.read(fd, &request);
+    if (!std.mem.startsWith(u8, request[0..request_len], "GET /metrics")) {
+        try write_all(fd, "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+        return;
+    }
+    var text: Text = .{ .buffer = body_buffer };
+    render(&text);
+    var header_buffer: [256]u8 = undefined;
+    const header = try std.fmt.bufPrint(
+        &header_buffer,
+        "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: {d}\r\nConnection: close\r\n\r\n",
+        .{text.len},
+    );
+    try write_all(fd, header);
+    try write_all(fd, text.slice());
+}
+
+/// Serve /metrics on localhost, one scrape at a time.
+/// Runs on its own thread, only reads atomics so it never blocks audio or network.
+pub fn serve(alloc: std.mem.Allocator, port: u16, render: RenderFn) void {
+    serve_loop(alloc, port, render) catch |err| {
+        std.debug.print("metrics server stopped: {any}\n", .{err});
+    };
+}
+
+fn serve_loop(alloc: std.mem.Allocator, port: u16, render: RenderFn) !void {
+    const body_buffer = try alloc.alloc(u8, max_response_len);
+    defer alloc.free(body_buffer);
+    const addr = try std.net.Address.parseIp4("127.0.0.1", port);
+    const fd = try posix.socket(posix.AF.INET, posix.SOCK.STREAM | posix.SOCK.CLOEXEC, 0);
+    defer posix.close(fd);
+    try posix.setsockopt(fd, posix.SOL.SOCKET, posix.SO.REUSEADDR, &std.mem.toBytes(@as(c_int, 1)));
+    try posix.bind(fd, &addr.any, addr.getOsSockLen());
+    try posix.listen(fd, 16);
+    std.log.info("serving metrics on http://127.0.0.1:{}/metrics", .{port});
+    while (true) {
+        const client = posix.accept(fd, null, null, posix.SOCK.CLOEXEC) catch |err| {
+            std.debug.print("metrics accept failed: {any}\n", .{err});
+            continue;
+        };
+        defer posix.close(client);
+        handle_client(client, render, body_buffer) catch |err| {
+            std.debug.print("metrics request failed: {any}\n", .{err});
+        };
+    }
+}
@@ -0,0 +1,79 @@
+const std = @import("std");
+
+const audio = @cImport({
+    @cInclude("audio_quality.h");
+});
+
+fn write_json(path: []const u8, reference: []const u8, degraded: []const u8, q: audio.quality_result_t, seconds: f64) !void {
+    var file = try std.fs.cwd().createFile(path, .{});
+    defer file.close();
+    var buffer: [1024]u8 = undefined;
+    const json = try std.fmt.bufPrint(
+        &buffer,
+        "{{\"reference\":\"{s}\",\"degraded\":\"{s}\",\"offset_frames\":{d},\"correlation\":{d:.4},\"gain\":{d:.4},\"snr_db\":{d:.3},\"segmental_snr_db\":{d:.3},\"log_spectral_distance_db\":{d:.3},\"glitches\":{d},\"frames_compared\":{d},\"sample_rate\":{d},\"processing_seconds\":{d:.3}}}\n",
+        .{
+            reference,
+            degraded,
+            q.offset_frames,
+            q.correlation,
+            q.gain,
+            q.snr_db,
+            q.segmental_snr_db,
+            q.log_spectral_distance_db,
+            q.glitches,
+            q.frames_compared,
+            q.sampleRate,
+            seconds,
+        },
+    );
+    try file.writeAll(json);
+}
+
+/// Score a degraded recording, usually --output_wav of a run fed with
+/// --input_wav, against the reference it was made from.
+pub fn main() !void {
+    const alloc = std.heap.smp_allocator;
+    const args = try std.process.argsAlloc(alloc);
+    defer std.process.argsFree(alloc, args);
+    if (args.len < 3) {
+        std.debug.print("usage: tiny_vc_quality <reference.wav> <degraded.wav> [result.json]\n", .{});
+        return error.missing_arguments;
+    }
+
+    var q: audio.quality_result_t = .{};
+    var timer = try std.time.Timer.start();
+    const result = audio.quality_compare_files(args[1].ptr, args[2].ptr, &q);
+    if (result != audio.MA_SUCCESS) {
+        std.debug.print("failed to compare {s} with {s}: code({})\n", .{ args[1], args[2], result });
+        return error.compare_failed;
+    }
+    const seconds = @as(f64, @floatFromInt(timer.read())) / std.time.ns_per_s;
+    const audio_seconds = @as(f64, @floatFromInt(q.frames_compared)) / @as(f64, @floatFromInt(q.sampleRate));
+
+    std.debug.print(
+        \\offset            {d} frames ({d:.1} ms)
+        \\correlation       {d:.4}, gain {d:.3}
+        \\snr               {d:.2} dB
+        \\segmental snr     {d:.2} dB
+        \\log spectral dist {d:.2} dB
+        \\glitches          {d}
+        \\compared          {d:.1} s of audio in {d:.2} s ({d:.0}x real time)
+        \\
+    , .{
+        q.offset_frames,
+        @as(f64, @floatFromInt(q.offset_frames)) * std.time.ms_per_s / @as(f64, @floatFromInt(q.sampleRate)),
+        q.correlation,
+        q.gain,
+        q.snr_db,
+        q.segmental_snr_db,
+        q.log_spectral_distance_db,
+        q.glitches,
+        audio_seconds,
+        seconds,
+        audio_seconds / @max(seconds, 1e-9),
+    });
+    if (args.len > 3) {
+        try write_json(args[3], args[1], args[2], q, seconds);
+        std.debug.print("results written to {s}\n", .{args[3]});
+    }
+}
@@ -0,0 +1,406 @@
+const std = @import("std");
+const capture = @import("capture_data.zig");
+
+const Error = error{
+    invalid_report,
+};
+
+/// How often listeners report on every sender they hear.
+pub const report_interval_ms = std.time.ms_per_s;
+
+/// Topic receiver reports for a room are sent on.
+/// Caller owns the returned string.
+pub fn report_topic(alloc: std.mem.Allocator, topic: []const u8) ![]u8 {
+    return std.fmt.allocPrint(alloc, "{s}_report", .{topic});
+}
+
+/// Signed distance between two sequence numbers, handles wrap around.
+fn sequence_distance(a: u32, b: u32) i32 {
+    return @bitCast(a -% b);
+}
+
+/// Sent periodically by listeners, one for every sender they hear.
+pub const ReceiverReport = struct {
+    /// ID of the listener sending the report.
+    reporter_id: u32 = 0,
+    /// The sender the report is about.
+    stream_id: u32 = 0,
+    /// Fraction of packets lost since the last report, out of 256.
+    fraction_lost: u8 = 0,
+    /// Total packets lost.
+    cumulative_lost: u32 = 0,
+    /// Highest sequence received.
+    highest_sequence: u32 = 0,
+    /// Interarrival jitter in microseconds.
+    jitter_us: u32 = 0,
+    /// Audio waiting in the listener's jitter buffer in milliseconds.
+    playout_delay_ms: u32 = 0,
+
+    pub fn marshal_size() usize {
+        return @sizeOf(u8) + @sizeOf(u32) + @sizeOf(u32) +
+            @sizeOf(u8) + @sizeOf(u32) + @sizeOf(u32) +
+            @sizeOf(u32) + @sizeOf(u32);
+    }
+
+    pub fn marshal(self: *const ReceiverReport, alloc: std.mem.Allocator) ![]const u8 {
+        const buffer: []u8 = try alloc.alloc(u8, marshal_size());
+        var offset: usize = 0;
+        std.mem.writePackedInt(u8, buffer, 0, @intFromEnum(capture.Kind.receiver_report), .little);
+        offset += @sizeOf(u8);
+        std.mem.writePackedInt(u32, buffer[offset..], 0, self.reporter_id, .little);
+        offset += @sizeOf(u32);
+        std.mem.writePackedInt(u32, buffer[offset..], 0, self.stream_id, .little);
+        offset += @sizeOf(u32);
+        std.mem.writePackedInt(u8, buffer[offset..], 0, self.fraction_lost, .little);
+        offset += @sizeOf(u8);
+        std.mem.writePackedInt(u32, buffer[offset..], 0, self.cumulative_lost, .little);
+        offset += @sizeOf(u32);
+        std.mem.writePackedInt(u32, buffer[offset..], 0, self.highest_sequence, .little);
+        offset += @sizeOf(u32);
+        std.mem.writePackedInt(u32, buffer[offset..], 0, self.jitter_us, .little);
+        offset += @sizeOf(u32);
+        std.mem.writePackedInt(u32, buffer[offset..], 0, self.playout_delay_ms, .little);
+        return buffer;
+    }
+
+    pub fn unmarshal(buffer: []const u8) !ReceiverReport {
+        if (buffer.len < marshal_size()) {
+            return Error.invalid_report;
+        }
+        var offset: usize = 0;
+        const kind: capture.Kind = @enumFromInt(std.mem.readPackedInt(u8, buffer, 0, .little));
+        if (kind != .receiver_report) {
+            return Error.invalid_report;
+        }
+        offset += @sizeOf(u8);
+        var result: ReceiverReport = .{};
+        result.reporter_id = std.mem.readPackedInt(u32, buffer[offset..], 0, .little);
+        offset += @sizeOf(u32);
+        result.stream_id = std.mem.readPackedInt(u32, buffer[offset..], 0, .little);
+        offset += @sizeOf(u32);
+        result.fraction_lost = std.mem.readPackedInt(u8, buffer[offset..], 0, .little);
+        offset += @sizeOf(u8);
+        result.cumulative_lost = std.mem.readPackedInt(u32, buffer[offset..], 0, .little);
+        offset += @sizeOf(u32);
+        result.highest_sequence = std.mem.readPackedInt(u32, buffer[offset..], 0, .little);
+        offset += @sizeOf(u32);
+        result.jitter_us = std.mem.readPackedInt(u32, buffer[offset..], 0, .little);
+        offset += @sizeOf(u32);
+        result.playout_delay_ms = std.mem.readPackedInt(u32, buffer[offset..], 0, .little);
+        return result;
+    }
+};
+
+/// Listener side statistics of one sender, RFC 3550 style.
+pub const ReceiverStats = struct {
+    started: bool = false,
+    base_sequence: u32 = 0,
+    highest_sequence: u32 = 0,
+    received: u32 = 0,
+    expected_prior: u32 = 0,
+    received_prior: u32 = 0,
+    last_timestamp_us: u32 = 0,
+    last_arrival_us: i64 = 0,
+    jitter_us: f64 = 0,
+
+    /// Record a received audio or comfort noise packet.
+    pub fn on_packet(self: *ReceiverStats, sequence: u32, timestamp_us: u32, arrival_us: i64) void {
+        if (!self.started) {
+            self.* = .{
+                .started = true,
+                .base_sequence = sequence,
+                .highest_sequence = sequence,
+                .received = 1,
+                .last_timestamp_us = timestamp_us,
+                .last_arrival_us = arrival_us,
+            };
+            return;
+        }
+        self.received +%= 1;
+        if (sequence_distance(sequence, self.highest_sequence) > 0) {
+            self.highest_sequence = sequence;
+        }
+        // difference in transit time between this packet and the last one.
+        const sent_delta: i64 = sequence_distance(timestamp_us, self.last_timestamp_us);
+        const transit_delta = (arrival_us - self.last_arrival_us) - sent_delta;
+        self.jitter_us += (@as(f64, @floatFromInt(@abs(transit_delta))) - self.jitter_us) / 16.0;
+        self.last_timestamp_us = timestamp_us;
+        self.last_arrival_us = arrival_us;
+    }
+
+    /// Build the report for the interval since the last call.
+    pub fn report(self: *ReceiverStats, reporter_id: u32, stream_id: u32, playout_delay_ms: u32) ReceiverReport {
+        const expected = self.highest_sequence -% self.base_sequence +% 1;
+        const expected_interval = expected -% self.expected_prior;
+        const received_interval = self.received -% self.received_prior;
+        self.expected_prior = expected;
+        self.received_prior = self.received;
+        const lost_interval = @as(i64, expected_interval) - @as(i64, received_interval);
+        var fraction_lost: u8 = 0;
+        if (expected_interval > 0 and lost_interval > 0) {
+            fraction_lost = @intCast(@min(255, @divTrunc(lost_interval * 256, expected_interval)));
+        }
+        const cumulative_lost = @as(i64, expected) - @as(i64, self.received);
+        return .{
+            .reporter_id = reporter_id,
+            .stream_id = stream_id,
+            .fraction_lost = fraction_lost,
+            .cumulative_lost = @intCast(@max(0, cumulative_lost)),
+            .highest_sequence = self.highest_sequence,
+            .jitter_us = @intFromFloat(@min(self.jitter_us, std.math.maxInt(u32))),
+            .playout_delay_ms = playout_delay_ms,
+        };
+    }
+};
+
+/// ma_format values from miniaudio.h.
+const format_u8: u8 = 1;
+const format_s16: u8 = 2;
+const format_f32: u8 = 5;
+
+/// What the sender puts on the wire at one level of degradation.
+pub const Quality = struct {
+    /// ma_format of the samples.
+    format: u8,
+    sample_rate: u32,
+    /// Number of captured periods sent in one packet.
+    batch: u8,
+};
+
+/// Qualities from best to most degraded.
+pub const qualities = [_]Quality{
+    .{ .format = format_f32, .sample_rate = 44100, .batch = 1 },
+    .{ .format = format_s16, .sample_rate = 44100, .batch = 1 },
+    .{ .format = format_s16, .sample_rate = 22050, .batch = 2 },
+    .{ .format = format_s16, .sample_rate = 16000, .batch = 4 },
+    .{ .format = format_u8, .sample_rate = 8000, .batch = 4 },
+};
+
+/// Sender settings picked by the adaptation.
+pub const Settings = struct {
+    /// Index into qualities.
+    level: u8 = 0,
+    fec_group: u8,
+    fec_parity: u8,
+
+    pub fn quality(self: Settings) Quality {
+        return qualities[self.level];
+    }
+
+    fn pack(self: Settings) u32 {
+        return @as(u32, self.level) | (@as(u32, self.fec_group) << 8) | (@as(u32, self.fec_parity) << 16);
+    }
+
+    fn unpack(value: u32) Settings {
+        return .{
+            .level = @truncate(value),
+            .fec_group = @truncate(value >> 8),
+            .fec_parity = @truncate(value >> 16),
+        };
+    }
+};
+
+/// Sender side bitrate adaptation driven by receiver reports.
+/// Reports are fed in from one thread, the sending thread reads the settings.
+/// Every listener reports once per interval, the worst report of each
+/// interval decides, so the level moves at most one step per interval no
+/// matter how many listeners there are.
+pub const Adaptation = struct {
+    /// The configured FEC, used while the path is clean.
+    base_fec_group: u8,
+    base_fec_parity: u8,
+    /// Playout delay above which the path is considered queueing.
+    congested_delay_ms: u32,
+    /// Playout delay under which the path may recover.
+    clean_delay_ms: u32,
+    settings: std.atomic.Value(u32),
+    smoothed_loss: f64 = 0,
+    good_intervals: u32 = 0,
+    /// Worst loss and delay reported in the current interval, null until
+    /// the first report of it.
+    worst: ?ReceiverReport = null,
+    /// When the current interval started, in milliseconds.
+    interval_start_ms: i64 = 0,
+
+    /// Loss above which the sender degrades.
+    const congested_loss = 0.05;
+    /// Loss under which the sender may recover.
+    const clean_loss = 0.01;
+    /// Clean intervals in a row before stepping back up a level.
+    const recover_intervals = 5;
+
+    /// `buffer_ms` is the length of the listeners' jitter buffers. Audio
+    /// queueing past half of it is congestion, it is about to overflow, a
+    /// quarter of it or less is clean.
+    pub fn init(fec_group: u8, fec_parity: u8, buffer_ms: u32) Adaptation {
+        const settings: Settings = .{ .fec_group = fec_group, .fec_parity = fec_parity };
+        return .{
+            .base_fec_group = fec_group,
+            .base_fec_parity = fec_parity,
+            .congested_delay_ms = buffer_ms / 2,
+            .clean_delay_ms = buffer_ms / 4,
+            .settings = .init(settings.pack()),
+        };
+    }
+
+    pub fn current(self: *const Adaptation) Settings {
+        return Settings.unpack(self.settings.load(.monotonic));
+    }
+
+    /// Take a report about this sender, received at `now_ms`.
+    /// The interval it belongs to is acted on once the next one starts.
+    pub fn on_report(self: *Adaptation, report: ReceiverReport, now_ms: i64) void {
+        if (self.worst) |worst| {
+            if (now_ms - self.interval_start_ms >= report_interval_ms) {
+                self.adapt(worst);
+                self.worst = null;
+            }
+        }
+        if (self.worst) |*worst| {
+            worst.fraction_lost = @max(worst.fraction_lost, report.fraction_lost);
+            worst.playout_delay_ms = @max(worst.playout_delay_ms, report.playout_delay_ms);
+        } else {
+            self.worst = report;
+            self.interval_start_ms = now_ms;
+        }
+    }
+
+    fn adapt(self: *Adaptation, report: ReceiverReport) void {
+        var settings = self.current();
+        const loss = @as(f64, @floatFromInt(report.fraction_lost)) / 256.0;
+        self.smoothed_loss += (loss - self.smoothed_loss) / 4.0;
+
+        const congested = loss > congested_loss or report.playout_delay_ms > self.congested_delay_ms;
+        const clean = loss < clean_loss and report.playout_delay_ms < self.clean_delay_ms;
+        if (congested) {
+            self.good_intervals = 0;
+            if (settings.level + 1 < qualities.len) {
+                settings.level += 1;
+            }
+        } else if (clean) {
+            self.good_intervals += 1;
+            if (self.good_intervals >= recover_intervals and settings.level > 0) {
+                settings.level -= 1;
+                self.good_intervals = 0;
+            }
+        }
+
+        // random loss is better fixed with redundancy than a lower bitrate.
+        settings.fec_group = self.base_fec_group;
+        settings.fec_parity = self.base_fec_parity;
+        if (self.smoothed_loss >= 0.15) {
+            settings.fec_group = 4;
+            settings.fec_parity = @max(self.base_fec_parity, 2);
+        } else if (self.smoothed_loss >= clean_loss) {
+            settings.fec_group = @min(self.base_fec_group, 4);
+            settings.fec_parity = @max(self.base_fec_parity, 1);
+        }
+        self.settings.store(settings.pack(), .monotonic);
+    }
+};
+
+test "receiver stats count loss across sequence wraparound" {
+    var stats: ReceiverStats = .{};
+    const first: u32 = std.math.maxInt(u32) - 4;
+    // ten packets, one lost on each side of the wrap.
+    for (0..10) |i| {
+        const sequence = first +% @as(u32, @intCast(i));
+        if (sequence == std.math.maxInt(u32) - 1 or sequence == 2) {
+            continue;
+        }
+        stats.on_packet(sequence, 0, 0);
+    }
+    var result = stats.report(1, 9, 0);
+    try std.testing.expectEqual(@as(u32, 4), result.highest_sequence);
+    try std.testing.expectEqual(@as(u8, 2 * 256 / 10), result.fraction_lost);
+    try std.testing.expectEqual(@as(u32, 2), result.cumulative_lost);
+
+    for (5..15) |sequence| {
+        stats.on_packet(@intCast(sequence), 0, 0);
+    }
+    result = stats.report(1, 9, 0);
+    try std.testing.expectEqual(@as(u32, 14), result.highest_sequence);
+    try std.testing.expectEqual(@as(u8, 0), result.fraction_lost);
+    try std.testing.expectEqual(@as(u32, 2), result.cumulative_lost);
+
+    // every other packet of the interval lost.
+    for (15..25) |sequence| {
+        if (sequence % 2 == 0) {
+            stats.on_packet(@intCast(sequence), 0, 0);
+        }
+    }
+    result = stats.report(1, 9, 0);
+    try std.testing.expectEqual(@as(u32, 24), result.highest_sequence);
+    try std.testing.expectEqual(@as(u8, 128), result.fraction_lost);
+    try std.testing.expectEqual(@as(u32, 7), result.cumulative_lost);
+}
+
+test "adaptation steps down once per interval whatever the number of listeners" {
+    var adaptation: Adaptation = .init(4, 0, 200);
+    const reporters = 5;
+    for (0..3) |interval| {
+        for (0..reporters) |reporter| {
+            // one listener losing a quarter of the packets is enough.
+            const report: ReceiverReport = .{
+                .reporter_id = @intCast(reporter),
+                .fraction_lost = if (reporter == 3) 64 else 0,
+            };
+            const now_ms: i64 = @intCast(interval * report_interval_ms + reporter);
+            adaptation.on_report(report, now_ms);
+            // the interval before this one has been acted on, once.
+            try std.testing.expectEqual(@as(u8, @intCast(interval)), adaptation.current().level);
+        }
+    }
+}
+
+test "adaptation recovers only after enough clean intervals" {
+    var adaptation: Adaptation = .init(4, 0, 200);
+    adaptation.adapt(.{ .fraction_lost = 64 });
+    try std.testing.expectEqual(@as(u8, 1), adaptation.current().level);
+    for (0..Adaptation.recover_intervals - 1) |_| {
+        adaptation.adapt(.{});
+        try std.testing.expectEqual(@as(u8, 1), adaptation.current().level);
+    }
+    // congestion starts the count over.
+    adaptation.adapt(.{ .playout_delay_ms = 150 });
+    try std.testing.expectEqual(@as(u8, 2), adaptation.current().level);
+    for (0..Adaptation.recover_intervals - 1) |_| {
+        adaptation.adapt(.{});
+        try std.testing.expectEqual(@as(u8, 2), adaptation.current().level);
+    }
+    adaptation.adapt(.{});
+    try std.testing.expectEqual(@as(u8, 1), adaptation.current().level);
+}
+
+test "adaptation adds FEC as smoothed loss crosses its thresholds" {
+    var adaptation: Adaptation = .init(8, 0, 200);
+    adaptation.adapt(.{});
+    try std.testing.expectEqual(@as(u8, 8), adaptation.current().fec_group);
+    try std.testing.expectEqual(@as(u8, 0), adaptation.current().fec_parity);
+    // smoothed to just over 1%.
+    adaptation.adapt(.{ .fraction_lost = 12 });
+    try std.testing.expectEqual(@as(u8, 4), adaptation.current().fec_group);
+    try std.testing.expectEqual(@as(u8, 1), adaptation.current().fec_parity);
+    // one interval at 50% is not yet 15% smoothed, two are.
+    adaptation.adapt(.{ .fraction_lost = 128 });
+    try std.testing.expectEqual(@as(u8, 1), adaptation.current().fec_parity);
+    adaptation.adapt(.{ .fraction_lost = 128 });
+    try std.testing.expectEqual(@as(u8, 4), adaptation.current().fec_group);
+    try std.testing.expectEqual(@as(u8, 2), adaptation.current().fec_parity);
+    // clean intervals bring the configured FEC back.
+    var clean_intervals: usize = 0;
+    while (adaptation.smoothed_loss >= Adaptation.clean_loss) {
+        try std.testing.expect(adaptation.current().fec_parity > 0);
+        adaptation.adapt(.{});
+        clean_intervals += 1;
+    }
+    try std.testing.expect(clean_intervals > 1);
+    try std.testing.expectEqual(@as(u8, 8), adaptation.current().fec_group);
+    try std.testing.expectEqual(@as(u8, 0), adaptation.current().fec_parity);
+
+    // configured parity is never lowered.
+    var configured: Adaptation = .init(8, 3, 200);
+    configured.adapt(.{ .fraction_lost = 255 });
+    try std.testing.expectEqual(@as(u8, 4), configured.current().fec_group);
+    try std.testing.expectEqual(@as(u8, 3), configured.current().fec_parity);
+}
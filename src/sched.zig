@@ -0,0 +1,178 @@
+const std = @import("std");
+
+const c = @cImport({
+    @cInclude("audio_sched.h");
+});
+
+const Error = error{
+    invalid_sched,
+};
+
+/// Highest CPU index a thread can be pinned to, exclusive.
+pub const max_cpus: usize = @intCast(c.THREAD_SCHED_MAX_CPUS);
+
+/// Pipeline threads scheduling can be set for.
+pub const Thread = enum {
+    /// Drains the capture device, handle_capture.
+    capture,
+    /// Paces and publishes captured audio, handle_ring_buffer_data.
+    broadcast,
+    /// Reads the bus, the main thread.
+    receive,
+    /// Jitter buffer, FEC and playback of each room, handle_received.
+    playout,
+};
+
+pub const Policy = enum {
+    other,
+    fifo,
+    rr,
+};
+
+/// Scheduling of one thread.
+pub const ThreadConfig = struct {
+    policy: Policy = .other,
+    /// 1 to 99 for fifo and rr.
+    priority: u8 = 0,
+    /// CPUs the thread may run on, empty leaves the affinity as is.
+    cpus: std.StaticBitSet(max_cpus) = .initEmpty(),
+
+    /// Parse "policy[:priority][@cpus]", cpus being a comma separated list
+    /// of CPUs and ranges, for example "fifo:80@2,4-5" or "other@0-1".
+    pub fn parse(spec: []const u8) !ThreadConfig {
+        var result: ThreadConfig = .{};
+        var rest = spec;
+        if (std.mem.indexOfScalar(u8, rest, '@')) |at| {
+            try parse_cpus(&result.cpus, rest[at + 1 ..]);
+            rest = rest[0..at];
+        }
+        var parts = std.mem.splitScalar(u8, rest, ':');
+        result.policy = std.meta.stringToEnum(Policy, parts.first()) orelse return Error.invalid_sched;
+        if (parts.next()) |priority| {
+            result.priority = std.fmt.parseInt(u8, priority, 10) catch return Error.invalid_sched;
+        }
+        if (parts.next() != null) {
+            return Error.invalid_sched;
+        }
+        const real_time = result.policy != .other;
+        if (real_time and (result.priority < 1 or result.priority > 99)) {
+            return Error.invalid_sched;
+        }
+        if (!real_time and result.priority != 0) {
+            return Error.invalid_sched;
+        }
+        return result;
+    }
+
+    fn parse_cpus(cpus: *std.StaticBitSet(max_cpus), list: []const u8) !void {
+        var it = std.mem.splitScalar(u8, list, ',');
+        while (it.next()) |item| {
+            var bounds = std.mem.splitScalar(u8, item, '-');
+            const first = try parse_cpu(bounds.first());
+            const last = if (bounds.next()) |bound| try parse_cpu(bound) else first;
+            if (bounds.next() != null or last < first) {
+                return Error.invalid_sched;
+            }
+            cpus.setRangeValue(.{ .start = first, .end = last + 1 }, true);
+        }
+    }
+
+    fn parse_cpu(value: []const u8) !usize {
+        const cpu = std.fmt.parseInt(usize, value, 10) catch return Error.invalid_sched;
+        if (cpu >= max_cpus) {
+            return Error.invalid_sched;
+        }
+        return cpu;
+    }
+};
+
+/// Scheduling of each pipeline thread, threads without an entry are left
+/// as they start.
+pub const Config = struct {
+    threads: std.EnumArray(Thread, ?ThreadConfig) = .initFill(null),
+
+    /// Add one "thread=policy[:priority][@cpus]" entry, for example
+    /// "capture=fifo:80@2". A later entry for the same thread replaces it.
+    pub fn add(self: *Config, spec: []const u8) !void {
+        const eq = std.mem.indexOfScalar(u8, spec, '=') orelse return Error.invalid_sched;
+        const thread = std.meta.stringToEnum(Thread, spec[0..eq]) orelse return Error.invalid_sched;
+        self.threads.set(thread, try ThreadConfig.parse(spec[eq + 1 ..]));
+    }
+};
+
+/// Apply the scheduling configured for `thread` to the calling thread.
+/// A failure, most often missing permission for a real time policy, is
+/// logged and the thread carries on as it was.
+pub fn apply(config: Config, thread: Thread) void {
+    const thread_config = config.threads.get(thread) orelse return;
+    const policy: c.enum_thread_sched_policy = switch (thread_config.policy) {
+        .other => c.THREAD_SCHED_OTHER,
+        .fifo => c.THREAD_SCHED_FIFO,
+        .rr => c.THREAD_SCHED_RR,
+    };
+    var cpus: [max_cpus]c.ma_uint32 = undefined;
+    var count: usize = 0;
+    var it = thread_config.cpus.iterator(.{});
+    while (it.next()) |cpu| {
+        cpus[count] = @intCast(cpu);
+        count += 1;
+    }
+    const result = c.thread_sched_apply(policy, thread_config.priority, &cpus, count);
+    if (result != c.MA_SUCCESS) {
+        std.debug.print("failed to set scheduling of the {s} thread: code({})\n", .{ @tagName(thread), result });
+        return;
+    }
+    std.log.info("{s} thread: policy = {s}, priority = {}, pinned to {} cpus", .{
+        @tagName(thread),
+        @tagName(thread_config.policy),
+        thread_config.priority,
+        count,
+    });
+}
+
+test "thread config parses policy, priority and cpus" {
+    const pinned = try ThreadConfig.parse("fifo:80@2,4-5");
+    try std.testing.expectEqual(Policy.fifo, pinned.policy);
+    try std.testing.expectEqual(@as(u8, 80), pinned.priority);
+    try std.testing.expectEqual(@as(usize, 3), pinned.cpus.count());
+    try std.testing.expect(pinned.cpus.isSet(2) and pinned.cpus.isSet(4) and pinned.cpus.isSet(5));
+
+    const other = try ThreadConfig.parse("other@0-1");
+    try std.testing.expectEqual(Policy.other, other.policy);
+    try std.testing.expectEqual(@as(u8, 0), other.priority);
+    try std.testing.expectEqual(@as(usize, 2), other.cpus.count());
+
+    try std.testing.expectEqual(@as(u8, 1), (try ThreadConfig.parse("rr:1")).priority);
+    try std.testing.expectEqual(@as(u8, 99), (try ThreadConfig.parse("rr:99")).priority);
+    try std.testing.expectEqual(@as(usize, 0), (try ThreadConfig.parse("other")).cpus.count());
+    const last_cpu = std.fmt.comptimePrint("other@{d}", .{max_cpus - 1});
+    try std.testing.expect((try ThreadConfig.parse(last_cpu)).cpus.isSet(max_cpus - 1));
+}
+
+test "thread config rejects bad specs" {
+    const specs = [_][]const u8{
+        "",
+        "idle",
+        "fifo",
+        "fifo:0",
+        "fifo:100",
+        "rr:abc",
+        "other:5",
+        "fifo:80:1",
+        "fifo:80@",
+        "fifo:80@3-2",
+        "fifo:80@1-2-3",
+        "fifo:80@x",
+        std.fmt.comptimePrint("fifo:80@{d}", .{max_cpus}),
+    };
+    for (specs) |spec| {
+        try std.testing.expectError(Error.invalid_sched, ThreadConfig.parse(spec));
+    }
+
+    var config: Config = .{};
+    try config.add("capture=fifo:80@2");
+    try std.testing.expectEqual(Policy.fifo, config.threads.get(.capture).?.policy);
+    try std.testing.expect(config.threads.get(.playout) == null);
+    try std.testing.expectError(Error.invalid_sched, config.add("gpu=fifo:80"));
+    try std.testing.expectError(Error.invalid_sched, config.add("capture"));
+}
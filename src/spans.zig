@@ -0,0 +1,39 @@
+const std = @import("std");
+const build_options = @import("build_options");
+
+const audio = @cImport({
+    @cInclude("audio_spans.h");
+});
+
+/// If span tracing was compiled in with -Dtrace_events.
+pub const enabled = build_options.trace_events;
+
+/// Name the calling thread in the trace.
+pub inline fn thread_name(comptime name: [:0]const u8) void {
+    if (enabled) {
+        audio.spans_thread_name(name);
+    }
+}
+
+pub inline fn begin(comptime name: [:0]const u8) void {
+    if (enabled) {
+        audio.spans_begin(name);
+    }
+}
+
+pub inline fn end(comptime name: [:0]const u8) void {
+    if (enabled) {
+        audio.spans_end(name);
+    }
+}
+
+/// Write the trace recorded so far to path as Chrome trace event JSON.
+pub fn write(path: [:0]const u8) void {
+    if (!enabled) {
+        return;
+    }
+    const result = audio.spans_write_chrome(path.ptr);
+    if (result != audio.MA_SUCCESS) {
+        std.debug.print("failed to write trace events to {s}: code({})\n", .{ path, result });
+    }
+}
@@ -0,0 +1,143 @@
+const std = @import("std");
+const Futex = std.Thread.Futex;
+
+/// Bounded queue between exactly one producer and one consumer thread.
+/// Pushing never blocks or takes a lock, so the producer can hand items
+/// over without waiting on the consumer. The consumer may sleep until an
+/// item arrives, the producer only pays for a wake when it does.
+pub fn Spsc(comptime T: type, comptime capacity: usize) type {
+    if (!std.math.isPowerOfTwo(capacity)) {
+        @compileError("Spsc capacity must be a power of two");
+    }
+    return struct {
+        const Self = @This();
+        const mask = capacity - 1;
+
+        items: [capacity]T = undefined,
+        /// Next position to write, only stored by the producer.
+        head: std.atomic.Value(usize) align(std.atomic.cache_line) = .init(0),
+        /// Next position to read, only stored by the consumer.
+        tail: std.atomic.Value(usize) align(std.atomic.cache_line) = .init(0),
+        /// Bumped on every push, the consumer sleeps on it.
+        signal: std.atomic.Value(u32) align(std.atomic.cache_line) = .init(0),
+        waiting: std.atomic.Value(bool) = .init(false),
+
+        /// Add an item, false if the queue is full.
+        pub fn push(self: *Self, item: T) bool {
+            const head = self.head.load(.monotonic);
+            if (head -% self.tail.load(.acquire) >= capacity) {
+                return false;
+            }
+            self.items[head & mask] = item;
+            self.head.store(head +% 1, .release);
+            _ = self.signal.fetchAdd(1, .seq_cst);
+            if (self.waiting.load(.seq_cst)) {
+                Futex.wake(&self.signal, 1);
+            }
+            return true;
+        }
+
+        /// Take the oldest item, null if the queue is empty.
+        pub fn pop(self: *Self) ?T {
+            const tail = self.tail.load(.monotonic);
+            if (tail == self.head.load(.acquire)) {
+                return null;
+            }
+            const item = self.items[tail & mask];
+            self.tail.store(tail +% 1, .release);
+            return item;
+        }
+
+        /// Take the oldest item, waiting up to timeout_ns for one to arrive.
+        pub fn pop_timeout(self: *Self, timeout_ns: u64) ?T {
+            if (self.pop()) |item| {
+                return item;
+            }
+            const signal = self.signal.load(.seq_cst);
+            self.waiting.store(true, .seq_cst);
+            defer self.waiting.store(false, .monotonic);
+            // a push between the first pop and reading the signal changed
+            // it, so the wait returns straight away instead of missing it.
+            if (self.pop()) |item| {
+                return item;
+            }
+            Futex.timedWait(&self.signal, signal, timeout_ns) catch {};
+            return self.pop();
+        }
+
+        /// Items waiting, exact only on the consumer thread.
+        pub fn len(self: *const Self) usize {
+            return self.head.load(.acquire) -% self.tail.load(.acquire);
+        }
+    };
+}
+
+test "spsc pops in push order and reports full and empty" {
+    var queue: Spsc(u32, 4) = .{};
+    try std.testing.expectEqual(@as(?u32, null), queue.pop());
+    try std.testing.expectEqual(@as(?u32, null), queue.pop_timeout(std.time.ns_per_ms));
+    for (0..4) |i| {
+        try std.testing.expect(queue.push(@intCast(i)));
+    }
+    try std.testing.expect(!queue.push(4));
+    try std.testing.expectEqual(@as(usize, 4), queue.len());
+    for (0..4) |i| {
+        const want: u32 = @intCast(i);
+        try std.testing.expectEqual(@as(?u32, want), queue.pop());
+    }
+    try std.testing.expectEqual(@as(?u32, null), queue.pop());
+    try std.testing.expectEqual(@as(usize, 0), queue.len());
+}
+
+test "spsc wraps around its slots and its positions" {
+    // positions start just short of overflowing.
+    const start = std.math.maxInt(usize) - 5;
+    var queue: Spsc(u32, 4) = .{ .head = .init(start), .tail = .init(start) };
+    var pushed: u32 = 0;
+    var popped: u32 = 0;
+    for (0..8) |_| {
+        for (0..3) |_| {
+            try std.testing.expect(queue.push(pushed));
+            pushed += 1;
+        }
+        try std.testing.expectEqual(@as(usize, 3), queue.len());
+        for (0..3) |_| {
+            try std.testing.expectEqual(@as(?u32, popped), queue.pop());
+            popped += 1;
+        }
+        try std.testing.expectEqual(@as(?u32, null), queue.pop());
+    }
+}
+
+test "spsc hands items from one thread to another through pop_timeout" {
+    const Handover = struct {
+        const count = 10_000;
+        queue: Spsc(u32, 64) = .{},
+        stop: std.atomic.Value(bool) = .init(false),
+
+        fn produce(self: *@This()) void {
+            var i: u32 = 0;
+            while (i < count and !self.stop.load(.monotonic)) {
+                if (!self.queue.push(i)) {
+                    std.Thread.yield() catch {};
+                    continue;
+                }
+                i += 1;
+                // pause now and then so the consumer has to sleep.
+                if (i % 1000 == 0) {
+                    std.Thread.sleep(std.time.ns_per_ms);
+                }
+            }
+        }
+    };
+    var handover: Handover = .{};
+    const producer = try std.Thread.spawn(.{}, Handover.produce, .{&handover});
+    defer producer.join();
+    // a failed check must not leave the producer spinning on a full queue.
+    defer handover.stop.store(true, .monotonic);
+    for (0..Handover.count) |i| {
+        const want: u32 = @intCast(i);
+        try std.testing.expectEqual(@as(?u32, want), handover.queue.pop_timeout(std.time.ns_per_s));
+    }
+    try std.testing.expectEqual(@as(?u32, null), handover.queue.pop());
+}